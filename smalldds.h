@@ -26,12 +26,20 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <new>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace smalldds
@@ -66,6 +74,119 @@ constexpr uint32_t MakeFourCC(char ch0, char ch1, char ch2, char ch3)
 std::string fourCC_to_string(const std::array<char, 4> &fourCC);
 std::string fourCC_to_string(uint32_t fourCC);
 
+/// Interleave the lower 16 bits of x and y into a Morton (Z-order) code, with x in the even bits.
+inline uint32_t morton_encode(uint32_t x, uint32_t y)
+{
+    auto spread = [](uint32_t v)
+    {
+        v &= 0x0000FFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+/// Inverse of morton_encode().
+inline void morton_decode(uint32_t code, uint32_t &x, uint32_t &y)
+{
+    auto compact = [](uint32_t v)
+    {
+        v &= 0x55555555;
+        v = (v | (v >> 1)) & 0x33333333;
+        v = (v | (v >> 2)) & 0x0F0F0F0F;
+        v = (v | (v >> 4)) & 0x00FF00FF;
+        v = (v | (v >> 8)) & 0x0000FFFF;
+        return v;
+    };
+    x = compact(code);
+    y = compact(code >> 1);
+}
+
+enum class LayoutType : uint32_t
+{
+    Linear, ///< Row-major scanlines
+    Morton, ///< Z-order curve over the image padded to power-of-two dimensions
+    Tiled   ///< Row-major grid of square tiles, each stored row-major
+};
+
+/** Describes how the texels of a decoded w x h image are arranged in memory.
+
+    Besides plain row-major scanlines, decoded images can be written in Morton order or in square tiles to improve
+    locality for 2D sampling. Since a BC block is already a 4x4 tile, the decoders write these layouts directly.
+    Use offset() to look up texels in the result.
+
+    Morton layouts pad each dimension to the next power of two. For non-square images, the Z-order curve covers the
+    largest square power-of-two tile, and those tiles are stored one after another along the longer axis. Tiled
+    layouts pad the image to a multiple of tile_size (e.g. a tile_size of 128 at 4 bytes per texel gives 64 KiB
+    tiles).
+*/
+struct Layout
+{
+    LayoutType type      = LayoutType::Linear;
+    uint32_t   tile_size = 8; ///< Edge length of a tile for LayoutType::Tiled; must be a power of two >= 4
+
+    /// Number of texels, including padding, needed to store a w x h image in this layout.
+    size_t size(uint32_t w, uint32_t h) const
+    {
+        switch (type)
+        {
+        case LayoutType::Morton: return size_t(next_pow2(w)) * next_pow2(h);
+        case LayoutType::Tiled:
+            return size_t((w + tile_size - 1) / tile_size) * ((h + tile_size - 1) / tile_size) * tile_size *
+                   tile_size;
+        default: return size_t(w) * h;
+        }
+    }
+
+    /// Index of texel (x, y) of a w x h image stored in this layout.
+    size_t offset(uint32_t x, uint32_t y, uint32_t w, uint32_t h) const
+    {
+        switch (type)
+        {
+        case LayoutType::Morton:
+        {
+            uint32_t k    = log2(std::min(next_pow2(w), next_pow2(h)));
+            uint32_t mask = (1u << k) - 1;
+            return morton_encode(x & mask, y & mask) + (size_t((x >> k) + (y >> k)) << (2 * k));
+        }
+        case LayoutType::Tiled:
+        {
+            uint32_t tiles_x = (w + tile_size - 1) / tile_size;
+            size_t   tile    = size_t(y / tile_size) * tiles_x + x / tile_size;
+            return tile * tile_size * tile_size + (y % tile_size) * tile_size + x % tile_size;
+        }
+        default: return size_t(y) * w + x;
+        }
+    }
+
+    /// Whether 4 horizontally adjacent texels starting at a multiple of 4 are contiguous in memory.
+    bool rows_contiguous() const { return type != LayoutType::Morton; }
+
+    bool is_valid() const
+    {
+        return type != LayoutType::Tiled || (tile_size >= 4 && (tile_size & (tile_size - 1)) == 0);
+    }
+
+private:
+    static uint32_t next_pow2(uint32_t v)
+    {
+        uint32_t p = 1;
+        while (p < v) p <<= 1;
+        return p;
+    }
+    static uint32_t log2(uint32_t pow2)
+    {
+        uint32_t k = 0;
+        while ((1u << k) < pow2) ++k;
+        return k;
+    }
+};
+
+struct EmbeddedDDS;
+
 /** Represents and loads a DirectDraw Surface (DDS) file, providing access to its header, pixel format, and image data.
 
     This class encapsulates the logic for parsing, validating, and extracting image data from DDS files, including
@@ -565,25 +686,181 @@ public:
         const uint8_t *bytes() const { return reinterpret_cast<const uint8_t *>(chars.data()); }
     };
 
+    /// The data of a DDS file after it was detached with release_buffer()
+    struct Buffer
+    {
+        std::shared_ptr<const void> storage;        ///< Owns the memory of `bytes`; empty if nobody owns it
+        std::string_view            bytes;          ///< The complete DDS file
+        std::vector<ImageData>      images;         ///< The subresource table, pointing into `bytes`
+        uint32_t                    mip_count  = 0; ///< Mips per array slice in `images`
+        uint32_t                    array_size = 0; ///< Array slices in `images`
+
+        const ImageData *get_image_data(uint32_t mipIdx = 0, uint32_t arrayIdx = 0) const
+        {
+            size_t index = size_t(mip_count) * arrayIdx + mipIdx;
+            if (mipIdx < mip_count && arrayIdx < array_size && index < images.size())
+                return images.data() + index;
+            return nullptr;
+        }
+    };
+
+    /// Location of a subresource within the file, see compute_layout()
+    struct Subresource
+    {
+        uint32_t width  = 0;
+        uint32_t height = 0;
+        uint32_t depth  = 0;
+        uint64_t offset = 0; ///< Offset of the pixel data from the start of the file
+        uint64_t size   = 0; ///< Size of the pixel data in bytes
+    };
+
+    /// Precomputed facts about a file, kept in an optional chunk after its last subresource (see read_metadata())
+    struct Metadata
+    {
+        /// Statistics of the decoded texels of a subresource, per RGBA channel, ignoring NaNs
+        struct Stats
+        {
+            float min[4]  = {0.f, 0.f, 0.f, 0.f};
+            float max[4]  = {0.f, 0.f, 0.f, 0.f};
+            float mean[4] = {0.f, 0.f, 0.f, 0.f};
+        };
+
+        struct Entry
+        {
+            Subresource location;          ///< Where the subresource lies, as compute_layout() finds it
+            uint64_t    hash      = 0;     ///< XXH64 of its pixel data
+            bool        has_stats = false; ///< False for formats that decode() doesn't handle, or if not requested
+            Stats       stats;
+        };
+
+        uint64_t           header_hash = 0;  ///< XXH64 of the bytes before the first subresource
+        std::vector<Entry> subresources;     ///< Ordered like the image_data table
+        std::string        encoder_settings; ///< Free-form; e.g. the options of the tool that wrote the file
+    };
+
+    /// Selects one channel for decode_channel()
+    enum class Channel : uint32_t
+    {
+        R = 0,
+        G = 1,
+        B = 2,
+        A = 3
+    };
+
 public:
     static bool     is_compressed(DXGIFormat fmt);
     static DataType data_type(DXGIFormat fmt);
     static size_t   data_type_size(DataType type);
+    /// Bits per pixel of a DXGI format (bits per block for ASTC), or 0 if unsupported
+    static int      bits_per_pixel(DXGIFormat fmt);
+    /// Size in bytes of a w x h x d image in DXGI format `fmt`, or 0 if unsupported
+    static size_t   surface_size(DXGIFormat fmt, uint32_t w, uint32_t h, uint32_t d = 1);
     static void     calc_shifts(uint32_t mask, uint32_t &count, uint32_t &right);
 
     Result load(const char *filepath);
     Result load(std::istream &input);
     Result load(const uint8_t *data, size_t size);
     Result load(std::vector<uint8_t> &&dds);
+    /** Make this a read-only view of a DDS file embedded with tools/dds2header.
+
+        The header and subresource table were parsed and verified when the embedded header was generated (and checked
+        again at compile time), so this only copies a few fields: there is no parsing or allocation, and there is no
+        need to call populate_image_data(). The `dds` and `image_data` members stay empty; use get_image_data().
+    */
+    Result load(const EmbeddedDDS &embedded);
+    /** Make this a read-only view of a DDS file in memory owned by someone else, e.g. an entry of a memory-mapped
+        archive (see smalldds_io.h).
+
+        The header is parsed as by load(), and populate_image_data() points the subresource table into `data`, so
+        nothing is copied. `backing` is kept alive for as long as this DDSFile views the data; if it is empty, the
+        caller must keep `data` alive instead.
+    */
+    Result load_view(const uint8_t *data, size_t size, std::shared_ptr<const void> backing = {});
     Result populate_image_data();
+    /** Compute where the subresources lie in a DDS file of `file_size` bytes, using only the parsed header.
+
+        This is what populate_image_data() uses, and is meant for reading subresources on demand without loading the
+        whole file (see SubresourceReader in smalldds_io.h). Like populate_image_data(), it reduces mip_count() and
+        array_size() if the file is too small for all the subresources the header declares. The subresources are
+        ordered like the image_data table: all mips of the first array slice, then the second, etc.
+    */
+    Result compute_layout(uint64_t file_size, std::vector<Subresource> &subresources);
+    /** Read the metadata chunk that DDSWriter::add_metadata() appended after the last subresource.
+
+        Other readers, including populate_image_data(), ignore the chunk, so such files remain plain DDS files. The
+        chunk is only returned if it is intact and describes this file: its checksum, the hash of the header and the
+        layout table are always checked. With `verify`, so is the hash of each subresource, which costs a pass over
+        the pixel data but is far cheaper than recomputing the statistics; without it, the caller trusts that nobody
+        changed the pixel data in place. Requires populate_image_data(), and returns an Error if there is no valid
+        chunk.
+    */
+    Result read_metadata(Metadata &metadata, bool verify = false) const;
 
     const ImageData *get_image_data(uint32_t mipIdx = 0, uint32_t arrayIdx = 0) const
     {
-        if (mipIdx < header.mipmap_count && arrayIdx < header_DXT10.array_size)
-            return &image_data[header.mipmap_count * arrayIdx + mipIdx];
+        size_t index = size_t(header.mipmap_count) * arrayIdx + mipIdx;
+        if (mipIdx < header.mipmap_count && arrayIdx < header_DXT10.array_size &&
+            (m_view_images || index < image_data.size()))
+            return (m_view_images ? m_view_images : image_data.data()) + index;
         return nullptr;
     }
 
+    /// Whether the pixel data is a view of memory not owned by this DDSFile (see load(const EmbeddedDDS &) and
+    /// load_view())
+    bool is_view() const { return m_view_bytes.data() != nullptr; }
+
+    /** Hand the file data, and the subresource table pointing into it, over to the caller without copying the data.
+
+        Works with every kind of storage: an owned `dds` vector is moved to the heap, and views pass on their backing
+        (a MappedFile, a DDSFilePool slab, the buffer of load_parallel(), ...), so the data outlives this DDSFile.
+        Views without a backing (embedded files, or load_view() without one) return an empty `storage`, and their
+        memory stays owned by whoever owned it before. The subresource table is that of populate_image_data(), if it
+        has been called. Afterwards, this DDSFile is empty, as if default-constructed.
+    */
+    Buffer release_buffer();
+
+    /// The complete DDS file, whether it is owned (the `dds` member) or viewed
+    std::string_view file_bytes() const
+    {
+        return is_view() ? m_view_bytes : std::string_view{reinterpret_cast<const char *>(dds.data()), dds.size()};
+    }
+
+    /** Decode a single channel of a BC1-BC5 compressed image into tightly packed, row-major output.
+
+        Only the part of each block that contributes to the requested channel is decoded: the alpha block of BC2/BC3
+        without touching the colors, the punch-through alpha of BC1 without interpolating the palette, the red channel
+        of a BC4 height map, etc. Swizzling color transforms (e.g. ATI2, RXGB) are taken into account, so `channel`
+        refers to the logical channel of the texture.
+
+        Channels that are not stored in the format decode to 0, or to 1 for alpha. With 8-bit output, SNorm data is
+        remapped from [-1,1] to [0,255].
+
+        @param channel  The channel to decode.
+        @param dst      Destination with room for layout.size(width, height) * depth values of the subresource.
+        @param mipIdx   The mip level to decode.
+        @param arrayIdx The array slice to decode.
+        @param layout   Memory layout of each depth slice of the output.
+    */
+    Result decode_channel(Channel channel, uint8_t *dst, uint32_t mipIdx = 0, uint32_t arrayIdx = 0,
+                          const Layout &layout = Layout{}) const;
+    Result decode_channel(Channel channel, float *dst, uint32_t mipIdx = 0, uint32_t arrayIdx = 0,
+                          const Layout &layout = Layout{}) const;
+
+    /** Decode an image to 32-bit float RGBA.
+
+        Handles the uncompressed formats with a fixed number of 8, 16 or 32-bit channels, the bitmasked and packed
+        formats (including R11G11B10_Float, R9G9B9E5_SHAREDEXP and the XR_BIAS format), and BC1-BC7. Swizzling color
+        transforms and luminance are resolved, so the output is always in R, G, B, A order. Missing color channels are 0
+        and missing alpha is 1. Normalized formats decode to [0,1] (or [-1,1] for SNorm), integer formats to their
+        integer values, and sRGB-encoded data is returned as-is.
+
+        @param dst      Destination with room for 4 * layout.size(width, height) * depth floats.
+        @param mipIdx   The mip level to decode.
+        @param arrayIdx The array slice to decode.
+        @param layout   Memory layout of each depth slice of the output.
+    */
+    Result decode(float *dst, uint32_t mipIdx = 0, uint32_t arrayIdx = 0, const Layout &layout = Layout{}) const;
+
     // Convenient access to some header fields
     uint32_t         width() const { return header.width; }
     uint32_t         height() const { return header.height; }
@@ -631,11 +908,225 @@ private:
     DXGIFormat deduce_format_from_fourCC(Result &res);
     void       deduce_bitmasks_from_pixel_format();
     Result     verify_header();
+    Result     read_header(const uint8_t *data, size_t size);
+    /// Call `emit(const Subresource &)` for each subresource that fits in a file of `file_size` bytes
+    template <typename Emit> Result layout_subresources(uint64_t file_size, Emit &&emit);
+    /// Like populate_image_data(), but fill in `table` (with room for mip_count() * array_size() entries) instead
+    Result     populate_image_table(ImageData *table);
     size_t     image_data_size(uint32_t w, uint32_t h, uint32_t d, Result &res) const;
+    Channel    stored_channel(Channel c) const;
+    void       apply_color_transform(float *rgba, size_t count) const;
+
+    template <typename T>
+    Result decode_channel_impl(Channel channel, T *dst, uint32_t mipIdx, uint32_t arrayIdx,
+                               const Layout &layout) const;
+
+    bool                        m_header_verified = false;
+    const ImageData            *m_view_images     = nullptr; ///< Subresource table of a view, instead of image_data
+    std::string_view            m_view_bytes;                ///< The viewed file, used instead of dds
+    std::shared_ptr<const void> m_view_backing;              ///< Keeps the memory of m_view_bytes alive, if set
+    bool                        m_report_info     = true;    ///< Whether to add Result::Info messages
+
+    friend class DDSFilePool;
+};
+
+/** A DDS file embedded in the executable, as generated by tools/dds2header.
+
+    Besides the raw file, this holds the state that DDSFile::load() and DDSFile::populate_image_data() computed for it
+    at generation time, so DDSFile::load(const EmbeddedDDS &) can construct a view of it without parsing anything.
+    Generated headers check validate() in a static_assert, so a corrupt or mismatched table fails to compile.
+*/
+struct EmbeddedDDS
+{
+    std::string_view          bytes; ///< The complete DDS file
+    DDSFile::Header           header;
+    bool                      has_DXT10_header;
+    DDSFile::HeaderDXT10      header_DXT10;
+    bool                      is_cubemap;
+    DDSFile::Compression      compression;
+    int                       bpp;
+    int                       num_channels;
+    uint32_t                  alpha_mode;
+    DDSFile::ColorTransform   color_transform;
+    bool                      bitmasked;
+    bool                      bitmask_has_alpha;
+    bool                      bitmask_has_rgb;
+    bool                      bitmask_was_bump_du_dv;
+    uint32_t                  bit_counts[4];
+    uint32_t                  right_shifts[4];
+    const DDSFile::ImageData *image_data; ///< mip_count * array_size subresources, referencing `bytes`
+    size_t                    num_images;
+
+    /// Check the layout against the raw file: magic, header, subresource count, and that the subresources are
+    /// contiguous, in order, and within the file.
+    constexpr bool validate() const
+    {
+        auto read_u32 = [this](size_t offset)
+        {
+            return uint32_t(uint8_t(bytes[offset])) | uint32_t(uint8_t(bytes[offset + 1])) << 8 |
+                   uint32_t(uint8_t(bytes[offset + 2])) << 16 | uint32_t(uint8_t(bytes[offset + 3])) << 24;
+        };
+
+        const size_t header_size = 4 + sizeof(DDSFile::Header) + (has_DXT10_header ? sizeof(DDSFile::HeaderDXT10) : 0);
+        if (bytes.size() <= header_size || bytes[0] != 'D' || bytes[1] != 'D' || bytes[2] != 'S' || bytes[3] != ' ')
+            return false;
+        // offsets of width, height and the DXT10 format in the file
+        if (read_u32(16) != header.width || read_u32(12) != header.height)
+            return false;
+        if (has_DXT10_header && read_u32(4 + sizeof(DDSFile::Header)) != uint32_t(header_DXT10.format))
+            return false;
+        if (!image_data || num_images == 0 || num_images != size_t(header.mipmap_count) * header_DXT10.array_size)
+            return false;
+
+        const char *next = bytes.data() + header_size;
+        for (size_t i = 0; i < num_images; ++i)
+        {
+            const auto &img = image_data[i];
+            if (img.chars.data() != next || img.chars.size() > bytes.size() - size_t(next - bytes.data()) ||
+                img.width == 0 || img.height == 0 || img.depth == 0)
+                return false;
+            next += img.chars.size();
+        }
+        return true;
+    }
+};
+
+/** Writes DDS files with a DXT10 header.
+
+    The writer allocates the complete file up front; fill in each subresource through image_data() and then save()
+    it. The layout of the pixel data is the same as the one DDSFile reads, and file() gives access to it as a fully
+    populated DDSFile.
+
+    Usage example:
+    @code
+    DDSWriter writer;
+    writer.init(DDSFile::R16G16B16A16_Float, 256, 256, 1, 9, 1, true); // cubemap with 9 mips
+    for (uint32_t face = 0; face < 6; ++face)
+        for (uint32_t mip = 0; mip < 9; ++mip)
+            fill(writer.image_data(mip, face), *writer.file().get_image_data(mip, face));
+    writer.save("probe.dds");
+    @endcode
+ */
+class DDSWriter
+{
+public:
+    /** Allocate a new texture.
 
-    bool m_header_verified = false;
+        @param format     The DXGI format of the pixel data.
+        @param width      Width of the base mip.
+        @param height     Height of the base mip.
+        @param depth      Depth of the base mip; values > 1 create a 3D texture.
+        @param mip_count  Number of mip levels.
+        @param array_size Number of array slices, or number of cubes if `cubemap` is true.
+        @param cubemap    Whether to create a cubemap (array), with 6 slices per cube.
+    */
+    Result init(DDSFile::DXGIFormat format, uint32_t width, uint32_t height, uint32_t depth = 1,
+                uint32_t mip_count = 1, uint32_t array_size = 1, bool cubemap = false);
+
+    /// Writable pixel data of a subresource, or nullptr if it doesn't exist. Faces of cube `c` are slices 6c..6c+5.
+    uint8_t *image_data(uint32_t mipIdx = 0, uint32_t arrayIdx = 0);
+
+    /// Copy `size` bytes into a subresource, which must be exactly its size.
+    Result set_image_data(uint32_t mipIdx, uint32_t arrayIdx, const void *data, size_t size);
+
+    /** Append a metadata chunk, computed from the current pixel data, to the file (see DDSFile::read_metadata()).
+
+        Call it once all subresources are filled in: image_data() and set_image_data() drop the chunk, since they may
+        change the pixel data. With `stats`, each subresource is decoded to compute its statistics, on up to
+        `num_threads` threads (0 uses all hardware threads).
+    */
+    Result add_metadata(const std::string &encoder_settings = {}, bool stats = true, uint32_t num_threads = 0);
+
+    /// The texture being written, for header information and subresource sizes and dimensions.
+    const DDSFile &file() const { return m_file; }
+
+    Result save(const char *filepath) const;
+    Result save(std::ostream &output) const;
+
+private:
+    DDSFile m_file;
+    size_t  m_pixel_end = 0; ///< Size of the file without a metadata chunk
+};
+
+/** Storage for large numbers of small DDS files, such as UI icons, with few heap allocations.
+
+    The DDSFile object, the subresource table and the bytes of every loaded file are carved out of large slabs. The
+    files are views of their slab (see DDSFile::is_view()) and don't record Result::Info messages, so loading
+    thousands of files costs a handful of allocations rather than several per file. Files larger than a quarter of the
+    slab size get a block of their own.
+
+    Usage example:
+    @code
+    DDSFilePool pool;
+    for (const auto &path : icon_paths)
+        if (const DDSFile *icon = pool.load(path.c_str()))
+            upload(icon->get_image_data());
+    @endcode
+
+    @note The DDSFile objects are owned by the pool and stay valid until clear() is called or the pool is destroyed.
+          They are ready to use: there is no need to call populate_image_data(). Their subresource table is not in
+          image_data, so read it through get_image_data(), which is what decode(), Sampler etc. do.
+*/
+class DDSFilePool
+{
+public:
+    explicit DDSFilePool(size_t slab_size = 256 << 10) : m_slab_size(slab_size) {}
+    ~DDSFilePool() { clear(); }
+    DDSFilePool(const DDSFilePool &)            = delete;
+    DDSFilePool &operator=(const DDSFilePool &) = delete;
+
+    /// Copy a DDS file from memory into the pool, or return nullptr on error (with the reason in `result`, if given)
+    DDSFile *load(const uint8_t *data, size_t size, Result *result = nullptr);
+    /// Read a DDS file into the pool, or return nullptr on error (with the reason in `result`, if given)
+    DDSFile *load(const char *filepath, Result *result = nullptr);
+
+    /// Number of files in the pool
+    size_t size() const { return m_files.size(); }
+    /// Destroy all files and release the slabs
+    void clear();
+
+private:
+    /// Allocate `size` bytes, and return the slab that holds them
+    uint8_t *allocate(size_t size, std::shared_ptr<uint8_t> *slab = nullptr);
+    DDSFile *load_into(uint8_t *block, size_t size, const std::shared_ptr<uint8_t> &slab, Result *result);
+
+    size_t                                m_slab_size;
+    size_t                                m_slab_used = 0;
+    std::vector<std::shared_ptr<uint8_t>> m_slabs; ///< The last one is current, unless it was a dedicated block
+    uint8_t                              *m_slab    = nullptr;
+    std::vector<DDSFile *>                m_files;
 };
 
+/// Run `fn(i)` for every i in [begin, end) on up to `num_threads` threads (0 uses all hardware threads).
+void parallel_for(size_t begin, size_t end, const std::function<void(size_t)> &fn, uint32_t num_threads = 0);
+
+/// Compress 16 RGBA float texels (a 4x4 block in row-major order) into a BC6H_UF16 block. Alpha is ignored, and
+/// negative values and NaNs are clamped to zero.
+void encode_bc6h_block(const float rgba[64], uint8_t block[16]);
+
+/// Compress 16 RGBA float texels in [0,1] into a BC1 block. With `punch_through_alpha`, texels with alpha below 0.5
+/// become transparent (using the 3-color palette); otherwise alpha is ignored.
+void encode_bc1_block(const float rgba[64], uint8_t block[8], bool punch_through_alpha = false);
+
+/// Compress 16 RGBA float texels in [0,1] into a BC3 block (BC1 colors and interpolated alpha).
+void encode_bc3_block(const float rgba[64], uint8_t block[16]);
+
+/// Compress the red channel of 16 RGBA float texels into a BC4 block; values are in [0,1], or [-1,1] if `is_signed`.
+void encode_bc4_block(const float rgba[64], uint8_t block[8], bool is_signed = false);
+
+/// Compress the red and green channels of 16 RGBA float texels into a BC5 block, like two BC4 blocks.
+void encode_bc5_block(const float rgba[64], uint8_t block[16], bool is_signed = false);
+
+/// Compress 16 RGBA float texels in [0,1] into a BC7 block. Only the single-subset modes are used: 6 (7-bit RGBA
+/// endpoints with a p-bit each, 4-bit indices) and 5 (7-bit color and 8-bit alpha endpoints with separate 2-bit color
+/// and alpha indices). They suit smooth color and alpha but not blocks with several distinct colors. Opaque blocks
+/// decode to an alpha of exactly 1.
+void encode_bc7_block(const float rgba[64], uint8_t block[16]);
+
+/// Compress 16 RGBA float texels into a block of `format`: any BC1, BC3, BC4, BC5 or BC7 format, or BC6H_UF16. BC1
+/// uses punch-through alpha, and sRGB formats store the values as given. Returns false for other formats.
+bool encode_bc_block(DDSFile::DXGIFormat format, const float rgba[64], uint8_t *block);
+
 /// Convert 11-bit float (5 exp + 6 mantissa) to 32-bit float
 inline float decode_float11(uint32_t bits)
 {
@@ -690,6 +1181,78 @@ inline float decode_float10(uint32_t bits)
     }
 }
 
+/// Convert IEEE 754 half-precision float bits to 32-bit float
+inline float half_to_float(uint16_t h)
+{
+    uint32_t sign     = uint32_t(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+            bits = sign;
+        else
+        {
+            // Denormalized half, renormalize it
+            exponent = 113;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+    }
+    else if (exponent == 31)
+        bits = sign | 0x7F800000 | (mantissa << 13); // Infinity or NaN
+    else
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/// Convert a 32-bit float to IEEE 754 half-precision float bits, rounding to nearest even
+inline uint16_t float_to_half(float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    uint32_t sign     = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF) // Infinity or NaN
+        return uint16_t(sign | 0x7C00 | (mantissa ? 0x200 | (mantissa >> 13) : 0));
+
+    int e = int(exponent) - 127 + 15;
+    if (e >= 31) // Overflow to infinity
+        return uint16_t(sign | 0x7C00);
+
+    if (e <= 0)
+    {
+        // Denormalized half or zero
+        if (e < -10)
+            return uint16_t(sign);
+        mantissa |= 0x800000;
+        uint32_t shift = uint32_t(14 - e);
+        uint32_t half  = mantissa >> shift;
+        uint32_t rest  = mantissa & ((1u << shift) - 1);
+        uint32_t mid   = 1u << (shift - 1);
+        if (rest > mid || (rest == mid && (half & 1)))
+            ++half;
+        return uint16_t(sign | half);
+    }
+
+    uint32_t half = sign | (uint32_t(e) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        ++half; // may carry into the exponent, which correctly rounds up to the next power of two or infinity
+    return uint16_t(half);
+}
+
 /// Useful for sign-extended right shifts for signed types
 template <typename T>
 inline T arithmetic_right_shift(T value, unsigned int n)
@@ -710,10 +1273,7 @@ inline float decode_float9_exp_5(uint32_t mantissa9, uint32_t shared_exp_bits)
 {
     constexpr int bias = 15;
 
-    if (shared_exp_bits == 0)
-        // Exponent = 0 means zero or subnormal → result is 0.0f in this format
-        return 0.0f;
-
+    // There are no implicit leading ones, so a shared exponent of 0 needs no special treatment
     int exponent = shared_exp_bits - bias;
 
     // mantissa9 is 9-bit fraction representing fraction/512 (2^9)
@@ -726,6 +1286,173 @@ inline float decode_float9_exp_5(uint32_t mantissa9, uint32_t shared_exp_bits)
 // see https://learn.microsoft.com/en-us/windows-hardware/drivers/display/xr-bias-to-float-conversion-rules
 inline float xr_bias_to_float(int bits) { return (bits - 384) / 510.f; }
 
+namespace detail
+{
+
+/// Branch-free conversion of half-float bits to float (exact, including denormals, infinities and NaNs) that compilers
+/// can vectorize, unlike half_to_float()
+inline float half_to_float_branchless(uint16_t h)
+{
+    // Move exponent and mantissa into place and rebias the exponent; infinities and NaNs need the maximum exponent, and
+    // denormals are renormalized by adding and then subtracting the smallest normal half
+    uint32_t bits     = uint32_t(h & 0x7FFF) << 13;
+    uint32_t exponent = bits & 0x0F800000;
+    uint32_t special  = 0u - uint32_t(exponent == 0x0F800000); // all ones for infinities and NaNs
+    uint32_t denormal = 0u - uint32_t(exponent == 0);          // all ones for zeros and denormals
+    bits += (112u << 23) + (special & (112u << 23)) + (denormal & (1u << 23));
+    uint32_t min_normal = denormal & (113u << 23); // 2^-14
+    float    f, bias;
+    std::memcpy(&f, &bits, sizeof(f));
+    std::memcpy(&bias, &min_normal, sizeof(bias));
+    f -= bias;
+    std::memcpy(&bits, &f, sizeof(bits));
+    bits |= uint32_t(h & 0x8000) << 16;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+/// Apply `convert` to `count` consecutive values of type Src (which need not be aligned) and store them to `dst`
+template <typename Src, typename Dst, typename Convert>
+inline void convert_values(const uint8_t *src, size_t count, Dst *dst, Convert convert)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        Src v;
+        std::memcpy(&v, src + i * sizeof(Src), sizeof(Src));
+        dst[i] = convert(v);
+    }
+}
+
+/// Whether integer type T holds every value in [lo, hi]
+template <typename T>
+constexpr bool holds_range(int64_t lo, uint64_t hi)
+{
+    return (std::is_signed<T>::value ? lo >= int64_t(std::numeric_limits<T>::min()) : lo >= 0) &&
+           hi <= uint64_t(std::numeric_limits<T>::max());
+}
+
+} // namespace detail
+
+/** Widen rows of typed (see DDSFile::data_type()) channel values to float, or to an integer type that can hold all of
+    their values, e.g. the next wider one.
+
+    With a float destination, UNorm values map to [0,1], SNorm values to [-1,1] (both -128 and -127 map to -1 for
+    SNorm8, and likewise for SNorm16), Float16 is expanded exactly and integer values are converted as-is. With an
+    integer destination, the stored integers are copied (with the most negative SNorm value clamped as above), and
+    float sources are not supported. Typeless data is treated as unsigned integers. The conversion is a plain loop
+    over the values of each row, which compilers vectorize for the target ISA.
+
+    @param src       First row of the source values.
+    @param src_pitch Bytes from one source row to the next, or 0 for tightly packed rows.
+    @param type      Type of each channel.
+    @param channels  Number of channels of each pixel.
+    @param width     Number of pixels in a row.
+    @param height    Number of rows.
+    @param dst       First row of the destination, with room for width * channels values per row.
+    @param dst_pitch Bytes from one destination row to the next, or 0 for tightly packed rows.
+    @returns false (without writing anything) if the conversion is not supported, e.g. for packed formats.
+*/
+template <typename Dst>
+bool convert_typed(const uint8_t *src, size_t src_pitch, DDSFile::DataType type, uint32_t channels, uint32_t width,
+                   uint32_t height, Dst *dst, size_t dst_pitch = 0)
+{
+    static_assert(std::is_same<Dst, float>::value || std::is_integral<Dst>::value,
+                  "convert_typed() converts to float or to an integer type");
+    using DataType = DDSFile::DataType;
+
+    const size_t size  = DDSFile::data_type_size(type);
+    const size_t count = size_t(width) * channels;
+    if (size == 0)
+        return false;
+    if (src_pitch == 0)
+        src_pitch = count * size;
+    if (dst_pitch == 0)
+        dst_pitch = count * sizeof(Dst);
+
+    auto rows = [&](auto tag, auto convert)
+    {
+        using Src = decltype(tag);
+        auto *out = reinterpret_cast<uint8_t *>(dst);
+        for (uint32_t y = 0; y < height; ++y, src += src_pitch, out += dst_pitch)
+            detail::convert_values<Src>(src, count, reinterpret_cast<Dst *>(out), convert);
+        return true;
+    };
+
+    if constexpr (std::is_same<Dst, float>::value)
+    {
+        switch (type)
+        {
+        case DataType::UNorm8: return rows(uint8_t(), [](uint8_t v) { return float(v) / 255.f; });
+        case DataType::SNorm8: return rows(int8_t(), [](int8_t v) { return std::max(-1.f, float(v) / 127.f); });
+        case DataType::UNorm16: return rows(uint16_t(), [](uint16_t v) { return float(v) / 65535.f; });
+        case DataType::SNorm16: return rows(int16_t(), [](int16_t v) { return std::max(-1.f, float(v) / 32767.f); });
+        case DataType::Float16: return rows(uint16_t(), detail::half_to_float_branchless);
+        case DataType::Float32: return rows(float(), [](float v) { return v; });
+        case DataType::Typeless8:
+        case DataType::UInt8: return rows(uint8_t(), [](uint8_t v) { return float(v); });
+        case DataType::SInt8: return rows(int8_t(), [](int8_t v) { return float(v); });
+        case DataType::Typeless16:
+        case DataType::UInt16: return rows(uint16_t(), [](uint16_t v) { return float(v); });
+        case DataType::SInt16: return rows(int16_t(), [](int16_t v) { return float(v); });
+        case DataType::Typeless32:
+        case DataType::UInt32: return rows(uint32_t(), [](uint32_t v) { return float(v); });
+        case DataType::SInt32: return rows(int32_t(), [](int32_t v) { return float(v); });
+        default: return false;
+        }
+    }
+    else
+    {
+        auto copy = [&](auto tag, int64_t lo, uint64_t hi)
+        {
+            using Src = decltype(tag);
+            if (!detail::holds_range<Dst>(lo, hi))
+                return false;
+            return rows(tag, [lo](Src v) { return Dst(std::max<int64_t>(v, lo)); });
+        };
+        switch (type)
+        {
+        case DataType::Typeless8:
+        case DataType::UNorm8:
+        case DataType::UInt8: return copy(uint8_t(), 0, 255);
+        case DataType::SNorm8: return copy(int8_t(), -127, 127);
+        case DataType::SInt8: return copy(int8_t(), -128, 127);
+        case DataType::Typeless16:
+        case DataType::UNorm16:
+        case DataType::UInt16: return copy(uint16_t(), 0, 65535);
+        case DataType::SNorm16: return copy(int16_t(), -32767, 32767);
+        case DataType::SInt16: return copy(int16_t(), -32768, 32767);
+        case DataType::Typeless32:
+        case DataType::UInt32: return copy(uint32_t(), 0, 4294967295u);
+        case DataType::SInt32: return copy(int32_t(), -2147483647 - 1, 2147483647);
+        default: return false;
+        }
+    }
+}
+
+/** Quantize RGBA float texels to an uncompressed format, the inverse of DDSFile::decode().
+
+    UNorm and SNorm channels are clamped to [0,1] and [-1,1], and integer channels saturate to their range; all of them
+    round to nearest (halfway cases away from zero) and store NaNs as 0. Float16 channels round to nearest even and
+    overflow to infinity, like float_to_half(). The unsigned floats of R11G11B10_Float and R9G9B9E5_SHAREDEXP also round
+    to nearest, but store negative values as 0 and clamp finite values that are too large to the largest finite one.
+    R10G10B10_XR_BIAS_A2_UNorm applies the XR bias, and depth/stencil formats take depth from R and stencil from G.
+    Typeless formats are stored the way decode() reads them: packed ones as UNorm, others as unsigned integers.
+    Channels that the format lacks are dropped, X channels of B8G8R8X8 formats store 1, A8_UNorm stores alpha, and sRGB
+    formats store the values as given.
+
+    Each format has its own branch-free loop over the texels, which compilers vectorize for the target ISA.
+
+    @param rgba   `count` RGBA texels.
+    @param count  Number of texels.
+    @param format Format to quantize to.
+    @param dst    Receives `count` texels of `format`, i.e. count * DDSFile::bits_per_pixel(format) / 8 bytes.
+    @returns false (without writing anything) for block-compressed, video, palettized and R1_UNorm formats.
+*/
+bool quantize_rgba(const float *rgba, size_t count, DDSFile::DXGIFormat format, uint8_t *dst);
+
+/// Quantize RGBA half-float texels (e.g. a GPU readback) to an uncompressed format, like the float overload
+bool quantize_rgba(const uint16_t *rgba, size_t count, DDSFile::DXGIFormat format, uint8_t *dst);
+
 } // namespace smalldds
 
 #ifdef SMALLDDS_IMPLEMENTATION
@@ -735,7 +1462,17 @@ inline float xr_bias_to_float(int bits) { return (bits - 384) / 510.f; }
 #undef max
 #endif // _Win32
 
+#include <atomic>
+#include <cstdio>
 #include <fstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace smalldds
 {
@@ -1023,7 +1760,8 @@ void DDSFile::calc_shifts(uint32_t mask, uint32_t &count, uint32_t &right)
 
 bool DDSFile::is_compressed(DXGIFormat fmt)
 {
-    return (fmt >= BC1_Typeless && fmt <= BC7_UNorm_SRGB) || (fmt >= ASTC_4X4_Typeless && fmt <= ASTC_12X12_UNorm_SRGB);
+    return (fmt >= BC1_Typeless && fmt <= BC5_SNorm) || (fmt >= BC6H_Typeless && fmt <= BC7_UNorm_SRGB) ||
+           (fmt >= ASTC_4X4_Typeless && fmt <= ASTC_12X12_UNorm_SRGB);
 }
 
 DDSFile::DataType DDSFile::data_type(DDSFile::DXGIFormat fmt)
@@ -1533,7 +2271,7 @@ DDSFile::DXGIFormat DDSFile::deduce_format_from_fourCC(Result &res)
                 header.pixel_format.masks[0]  = 0x0f00;
                 header.pixel_format.masks[1]  = 0x00f0;
                 header.pixel_format.masks[2]  = 0x000f;
-                header.pixel_format.masks[3]  = 0xff00;
+                header.pixel_format.masks[3]  = 0xf000;
                 bitmasked                     = true;
                 bitmask_has_rgb               = true;
                 bitmask_has_alpha             = true;
@@ -1560,8 +2298,8 @@ DDSFile::DXGIFormat DDSFile::deduce_format_from_fourCC(Result &res)
                 break;
             case R11G11B10_Float:
                 header.pixel_format.bit_count = 32;
-                header.pixel_format.masks[0]  = 0x000003FF;
-                header.pixel_format.masks[1]  = 0x007FF000;
+                header.pixel_format.masks[0]  = 0x000007FF;
+                header.pixel_format.masks[1]  = 0x003FF800;
                 header.pixel_format.masks[2]  = 0xFFC00000;
                 bitmasked                     = true;
                 bitmask_has_rgb               = true;
@@ -1799,203 +2537,216 @@ DDSFile::DXGIFormat DDSFile::deduce_format_from_fourCC(Result &res)
     return header_DXT10.format;
 }
 
-void DDSFile::calc_channel_info(Result &res)
+int DDSFile::bits_per_pixel(DXGIFormat fmt)
 {
-    auto fmt = format();
-
-    if (!bitmasked && fmt != 0)
+    switch (fmt)
     {
-        switch (fmt)
-        {
-        case R32G32B32A32_Typeless:
-        case R32G32B32A32_Float:
-        case R32G32B32A32_UInt:
-        case R32G32B32A32_SInt: bpp = 128; break;
+    case R32G32B32A32_Typeless:
+    case R32G32B32A32_Float:
+    case R32G32B32A32_UInt:
+    case R32G32B32A32_SInt: return 128;
+
+    case R32G32B32_Typeless:
+    case R32G32B32_Float:
+    case R32G32B32_UInt:
+    case R32G32B32_SInt: return 96;
+
+    case R16G16B16A16_Typeless:
+    case R16G16B16A16_Float:
+    case R16G16B16A16_UNorm:
+    case R16G16B16A16_UInt:
+    case R16G16B16A16_SNorm:
+    case R16G16B16A16_SInt:
+    case R32G32_Typeless:
+    case R32G32_Float:
+    case R32G32_UInt:
+    case R32G32_SInt:
+    case R32G8X24_Typeless:
+    case D32_Float_S8X24_UInt:
+    case R32_Float_X8X24_Typeless:
+    case X32_Typeless_G8X24_UInt:
+    case Y416:
+    case Y210:
+    case Y216: return 64;
+
+    case R10G10B10A2_Typeless:
+    case R10G10B10A2_UNorm:
+    case R10G10B10A2_UInt:
+    case R11G11B10_Float:
+    case R8G8B8A8_Typeless:
+    case R8G8B8A8_UNorm:
+    case R8G8B8A8_UNorm_SRGB:
+    case R8G8B8A8_UInt:
+    case R8G8B8A8_SNorm:
+    case R8G8B8A8_SInt:
+    case R16G16_Typeless:
+    case R16G16_Float:
+    case R16G16_UNorm:
+    case R16G16_UInt:
+    case R16G16_SNorm:
+    case R16G16_SInt:
+    case R32_Typeless:
+    case D32_Float:
+    case R32_Float:
+    case R32_UInt:
+    case R32_SInt:
+    case R24G8_Typeless:
+    case D24_UNorm_S8_UInt:
+    case R24_UNorm_X8_Typeless:
+    case X24_Typeless_G8_UInt:
+    case R9G9B9E5_SHAREDEXP:
+    case R8G8_B8G8_UNorm:
+    case G8R8_G8B8_UNorm:
+    case B8G8R8A8_UNorm:
+    case R10G10B10_XR_BIAS_A2_UNorm:
+    case B8G8R8A8_Typeless:
+    case B8G8R8A8_UNorm_SRGB:
+    case B8G8R8X8_Typeless:
+    case B8G8R8X8_UNorm:
+    case B8G8R8X8_UNorm_SRGB:
+    case AYUV:
+    case Y410:
+    case YUY2: return 32;
+
+    case P010:
+    case P016: return 24;
+
+    case R8G8_Typeless:
+    case R8G8_UNorm:
+    case R8G8_UInt:
+    case R8G8_SNorm:
+    case R8G8_SInt:
+    case R16_Typeless:
+    case R16_Float:
+    case D16_UNorm:
+    case R16_UNorm:
+    case R16_UInt:
+    case R16_SNorm:
+    case R16_SInt:
+    case B5G6R5_UNorm:
+    case B5G5R5A1_UNorm:
+    case B4G4R4A4_UNorm:
+    case A4B4G4R4_UNorm:
+    case A8P8: return 16;
+
+    case NV12:
+    case YUV420_OPAQUE:
+    case NV11: return 12;
+
+    case R8_Typeless:
+    case R8_UNorm:
+    case R8_UInt:
+    case R8_SNorm:
+    case R8_SInt:
+    case A8_UNorm:
+    case AI44:
+    case IA44:
+    case P8: return 8;
 
-        case R32G32B32_Typeless:
-        case R32G32B32_Float:
-        case R32G32B32_UInt:
-        case R32G32B32_SInt: bpp = 96; break;
+    case BC2_Typeless:
+    case BC2_UNorm:
+    case BC2_UNorm_SRGB:
+    case BC3_Typeless:
+    case BC3_UNorm:
+    case BC3_UNorm_SRGB:
+    case BC5_Typeless:
+    case BC5_UNorm:
+    case BC5_SNorm:
+    case BC6H_Typeless:
+    case BC6H_UF16:
+    case BC6H_SF16:
+    case BC7_Typeless:
+    case BC7_UNorm:
+    case BC7_UNorm_SRGB:
+        // actually 16 bytes per block (= 16 bytes per block * 8 bits per byte / 16 pixels per block)
+        return 8;
 
-        case R16G16B16A16_Typeless:
-        case R16G16B16A16_Float:
-        case R16G16B16A16_UNorm:
-        case R16G16B16A16_UInt:
-        case R16G16B16A16_SNorm:
-        case R16G16B16A16_SInt:
-        case R32G32_Typeless:
-        case R32G32_Float:
-        case R32G32_UInt:
-        case R32G32_SInt:
-        case R32G8X24_Typeless:
-        case D32_Float_S8X24_UInt:
-        case R32_Float_X8X24_Typeless:
-        case X32_Typeless_G8X24_UInt:
-        case Y416:
-        case Y210:
-        case Y216: bpp = 64; break;
+    case BC1_Typeless:
+    case BC1_UNorm:
+    case BC1_UNorm_SRGB:
+    case BC4_Typeless:
+    case BC4_UNorm:
+    case BC4_SNorm:
+        // actually 8 bytes per block (= 8 bytes per block * 8 bits per byte / 16 pixels per block)
+        return 4;
 
-        case R10G10B10A2_Typeless:
-        case R10G10B10A2_UNorm:
-        case R10G10B10A2_UInt:
-        case R11G11B10_Float:
-        case R8G8B8A8_Typeless:
-        case R8G8B8A8_UNorm:
-        case R8G8B8A8_UNorm_SRGB:
-        case R8G8B8A8_UInt:
-        case R8G8B8A8_SNorm:
-        case R8G8B8A8_SInt:
-        case R16G16_Typeless:
-        case R16G16_Float:
-        case R16G16_UNorm:
-        case R16G16_UInt:
-        case R16G16_SNorm:
-        case R16G16_SInt:
-        case R32_Typeless:
-        case D32_Float:
-        case R32_Float:
-        case R32_UInt:
-        case R32_SInt:
-        case R24G8_Typeless:
-        case D24_UNorm_S8_UInt:
-        case R24_UNorm_X8_Typeless:
-        case X24_Typeless_G8_UInt:
-        case R9G9B9E5_SHAREDEXP:
-        case R8G8_B8G8_UNorm:
-        case G8R8_G8B8_UNorm:
-        case B8G8R8A8_UNorm:
-        case R10G10B10_XR_BIAS_A2_UNorm:
-        case B8G8R8A8_Typeless:
-        case B8G8R8A8_UNorm_SRGB:
-        case B8G8R8X8_Typeless:
-        case B8G8R8X8_UNorm:
-        case B8G8R8X8_UNorm_SRGB:
-        case AYUV:
-        case Y410:
-        case YUY2: bpp = 32; break;
-
-        case P010:
-        case P016: bpp = 24; break;
-
-        case R8G8_Typeless:
-        case R8G8_UNorm:
-        case R8G8_UInt:
-        case R8G8_SNorm:
-        case R8G8_SInt:
-        case R16_Typeless:
-        case R16_Float:
-        case D16_UNorm:
-        case R16_UNorm:
-        case R16_UInt:
-        case R16_SNorm:
-        case R16_SInt:
-        case B5G6R5_UNorm:
-        case B5G5R5A1_UNorm:
-        case B4G4R4A4_UNorm:
-        case A4B4G4R4_UNorm:
-        case A8P8: bpp = 16; break;
-
-        case NV12:
-        case YUV420_OPAQUE:
-        case NV11: bpp = 12; break;
+    case R1_UNorm: return 1;
 
-        case R8_Typeless:
-        case R8_UNorm:
-        case R8_UInt:
-        case R8_SNorm:
-        case R8_SInt:
-        case A8_UNorm:
-        case AI44:
-        case IA44:
-        case P8: bpp = 8; break;
+    case ASTC_4X4_Typeless:
+    case ASTC_4X4_UNorm:
+    case ASTC_4X4_UNorm_SRGB:
+    case ASTC_5X4_Typeless:
+    case ASTC_5X4_UNorm:
+    case ASTC_5X4_UNorm_SRGB:
+    case ASTC_5X5_Typeless:
+    case ASTC_5X5_UNorm:
+    case ASTC_5X5_UNorm_SRGB:
+    case ASTC_6X5_Typeless:
+    case ASTC_6X5_UNorm:
+    case ASTC_6X5_UNorm_SRGB:
+    case ASTC_6X6_Typeless:
+    case ASTC_6X6_UNorm:
+    case ASTC_6X6_UNorm_SRGB:
+    case ASTC_8X5_Typeless:
+    case ASTC_8X5_UNorm:
+    case ASTC_8X5_UNorm_SRGB:
+    case ASTC_8X6_Typeless:
+    case ASTC_8X6_UNorm:
+    case ASTC_8X6_UNorm_SRGB:
+    case ASTC_8X8_Typeless:
+    case ASTC_8X8_UNorm:
+    case ASTC_8X8_UNorm_SRGB:
+    case ASTC_10X5_Typeless:
+    case ASTC_10X5_UNorm:
+    case ASTC_10X5_UNorm_SRGB:
+    case ASTC_10X6_Typeless:
+    case ASTC_10X6_UNorm:
+    case ASTC_10X6_UNorm_SRGB:
+    case ASTC_10X8_Typeless:
+    case ASTC_10X8_UNorm:
+    case ASTC_10X8_UNorm_SRGB:
+    case ASTC_10X10_Typeless:
+    case ASTC_10X10_UNorm:
+    case ASTC_10X10_UNorm_SRGB:
+    case ASTC_12X10_Typeless:
+    case ASTC_12X10_UNorm:
+    case ASTC_12X10_UNorm_SRGB:
+    case ASTC_12X12_Typeless:
+    case ASTC_12X12_UNorm:
+    case ASTC_12X12_UNorm_SRGB:
+        return 128; // this is bits per block, not per pixel
 
-        case BC2_Typeless:
-        case BC2_UNorm:
-        case BC2_UNorm_SRGB:
-        case BC3_Typeless:
-        case BC3_UNorm:
-        case BC3_UNorm_SRGB:
-        case BC5_Typeless:
-        case BC5_UNorm:
-        case BC5_SNorm:
-        case BC6H_Typeless:
-        case BC6H_UF16:
-        case BC6H_SF16:
-        case BC7_Typeless:
-        case BC7_UNorm:
-        case BC7_UNorm_SRGB:
-            // actually 16 bytes per block (= 16 bytes per block * 8 bits per byte / 16 pixels per block)
-            bpp = 8;
-            break;
+    // we don't support these at all
+    case P208:
+    case V208:
+    case V408:
+    default: return 0;
+    }
+}
 
-        case BC1_Typeless:
-        case BC1_UNorm:
-        case BC1_UNorm_SRGB:
-        case BC4_Typeless:
-        case BC4_UNorm:
-        case BC4_SNorm:
-            // actually 8 bytes per block (= 8 bytes per block * 8 bits per byte / 16 pixels per block)
-            bpp = 4;
-            break;
+size_t DDSFile::surface_size(DXGIFormat fmt, uint32_t w, uint32_t h, uint32_t d)
+{
+    DDSFile tmp;
+    tmp.header              = Header{};
+    tmp.header_DXT10.format = fmt;
+    tmp.bpp                 = bits_per_pixel(fmt);
+    if (tmp.bpp == 0 || w == 0 || h == 0 || d == 0)
+        return 0;
 
-        case R1_UNorm: bpp = 1; break;
+    Result res{Result::Success};
+    return tmp.image_data_size(w, h, d, res);
+}
 
-        case ASTC_4X4_Typeless:
-        case ASTC_4X4_UNorm:
-        case ASTC_4X4_UNorm_SRGB:
-        case ASTC_5X4_Typeless:
-        case ASTC_5X4_UNorm:
-        case ASTC_5X4_UNorm_SRGB:
-        case ASTC_5X5_Typeless:
-        case ASTC_5X5_UNorm:
-        case ASTC_5X5_UNorm_SRGB:
-        case ASTC_6X5_Typeless:
-        case ASTC_6X5_UNorm:
-        case ASTC_6X5_UNorm_SRGB:
-        case ASTC_6X6_Typeless:
-        case ASTC_6X6_UNorm:
-        case ASTC_6X6_UNorm_SRGB:
-        case ASTC_8X5_Typeless:
-        case ASTC_8X5_UNorm:
-        case ASTC_8X5_UNorm_SRGB:
-        case ASTC_8X6_Typeless:
-        case ASTC_8X6_UNorm:
-        case ASTC_8X6_UNorm_SRGB:
-        case ASTC_8X8_Typeless:
-        case ASTC_8X8_UNorm:
-        case ASTC_8X8_UNorm_SRGB:
-        case ASTC_10X5_Typeless:
-        case ASTC_10X5_UNorm:
-        case ASTC_10X5_UNorm_SRGB:
-        case ASTC_10X6_Typeless:
-        case ASTC_10X6_UNorm:
-        case ASTC_10X6_UNorm_SRGB:
-        case ASTC_10X8_Typeless:
-        case ASTC_10X8_UNorm:
-        case ASTC_10X8_UNorm_SRGB:
-        case ASTC_10X10_Typeless:
-        case ASTC_10X10_UNorm:
-        case ASTC_10X10_UNorm_SRGB:
-        case ASTC_12X10_Typeless:
-        case ASTC_12X10_UNorm:
-        case ASTC_12X10_UNorm_SRGB:
-        case ASTC_12X12_Typeless:
-        case ASTC_12X12_UNorm:
-        case ASTC_12X12_UNorm_SRGB:
-            bpp = 128; // this is bits per block, not per pixel
-            break;
+void DDSFile::calc_channel_info(Result &res)
+{
+    auto fmt = format();
 
-        // we don't support these at all
-        case P208:
-        case V208:
-        case V408:
-        default:
-        {
+    if (!bitmasked && fmt != 0)
+    {
+        bpp = bits_per_pixel(fmt);
+        if (bpp == 0)
             res.add_message(Result::Warning, std::string("Unsupported format in bits_per_pixel: ") + format_name(fmt) +
                                                  " (" + std::to_string((uint32_t)fmt) + ")");
-            bpp = 0;
-        }
-        }
     }
     else if (header.pixel_format.bit_count != 0)
     {
@@ -2218,22 +2969,53 @@ Result DDSFile::load(const uint8_t *data, size_t size)
 Result DDSFile::load(std::vector<uint8_t> &&_dds)
 {
     dds.clear();
+    m_view_images = nullptr;
+    m_view_bytes  = {};
+    m_view_backing.reset();
+
+    auto res = read_header(_dds.data(), _dds.size());
+    if (res.type == Result::Error)
+        return res;
+
+    dds = std::move(_dds);
+
+    return verify_header();
+}
+
+Result DDSFile::load_view(const uint8_t *data, size_t size, std::shared_ptr<const void> backing)
+{
+    dds.clear();
+    image_data.clear();
+    m_view_images = nullptr;
+    m_view_bytes  = {};
+    m_view_backing.reset();
+
+    auto res = read_header(data, size);
+    if (res.type == Result::Error)
+        return res;
+
+    m_view_bytes   = std::string_view{reinterpret_cast<const char *>(data), size};
+    m_view_backing = std::move(backing);
+
+    return verify_header();
+}
+
+Result DDSFile::read_header(const uint8_t *data, size_t size)
+{
+    m_header_verified = false;
 
-    if (_dds.size() < 4)
+    if (size < 4)
         return Result{Result::Error, "File too small for magic number"};
 
     for (int i = 0; i < 4; i++)
-        if (_dds[i] != Magic[i])
+        if (data[i] != Magic[i])
             return Result{Result::Error, "Magic number not found"};
 
-    if ((sizeof(uint32_t) + sizeof(Header)) >= _dds.size())
+    if ((sizeof(uint32_t) + sizeof(Header)) >= size)
         return Result{Result::Error, "File too small for DDS header"};
 
-    std::memcpy(&header, _dds.data() + sizeof(uint32_t), sizeof(Header));
-
-    dds = std::move(_dds);
-
-    return verify_header();
+    std::memcpy(&header, data + sizeof(uint32_t), sizeof(Header));
+    return Result{Result::Success};
 }
 
 Result DDSFile::verify_header()
@@ -2275,22 +3057,23 @@ Result DDSFile::verify_header()
     has_DXT10_header = false;
     if (hasFourCC && header.pixel_format.fourCC == FOURCC_DX10)
     {
-        res.add_message(Result::Info, "DDS: DXT10 header found.");
+        if (m_report_info)
+            res.add_message(Result::Info, "DDS: DXT10 header found.");
 
         // check header exists
-        if ((sizeof(uint32_t) + sizeof(Header) + sizeof(HeaderDXT10)) >= dds.size())
+        if ((sizeof(uint32_t) + sizeof(Header) + sizeof(HeaderDXT10)) > file_bytes().size())
         {
             res.add_message(Result::Error, "DDS: DXT10 header found, but file is too small for it. "
                                            "Expected at least " +
                                                std::to_string(sizeof(uint32_t) + sizeof(Header) + sizeof(HeaderDXT10)) +
-                                               " bytes, but got only " + std::to_string(dds.size()));
+                                               " bytes, but got only " + std::to_string(file_bytes().size()));
             return res;
         }
 
         has_DXT10_header = true;
 
         // Copy the DXT10 header from dds
-        std::memcpy(&header_DXT10, dds.data() + sizeof(uint32_t) + sizeof(Header), sizeof(HeaderDXT10));
+        std::memcpy(&header_DXT10, file_bytes().data() + sizeof(uint32_t) + sizeof(Header), sizeof(HeaderDXT10));
 
         if (header_DXT10.array_size == 0)
         {
@@ -2340,7 +3123,8 @@ Result DDSFile::verify_header()
     else
     {
         // No DX10 header.
-        res.add_message(Result::Info, "DDS: No DXT10 header found. Assuming this is a DX9 file.");
+        if (m_report_info)
+            res.add_message(Result::Info, "DDS: No DXT10 header found. Assuming this is a DX9 file.");
 
         if (header.flags & uint32_t(HeaderFlagBits::Depth))
             header_DXT10.resource_dimension = Texture3D;
@@ -2601,19 +3385,43 @@ size_t DDSFile::image_data_size(uint32_t w, uint32_t h, uint32_t d, Result &res)
     }
 }
 
-Result DDSFile::populate_image_data()
+Result DDSFile::load(const EmbeddedDDS &embedded)
+{
+    dds.clear();
+    image_data.clear();
+
+    header                 = embedded.header;
+    has_DXT10_header       = embedded.has_DXT10_header;
+    header_DXT10           = embedded.header_DXT10;
+    is_cubemap             = embedded.is_cubemap;
+    compression            = embedded.compression;
+    bpp                    = embedded.bpp;
+    num_channels           = embedded.num_channels;
+    alpha_mode             = embedded.alpha_mode;
+    color_transform        = embedded.color_transform;
+    bitmasked              = embedded.bitmasked;
+    bitmask_has_alpha      = embedded.bitmask_has_alpha;
+    bitmask_has_rgb        = embedded.bitmask_has_rgb;
+    bitmask_was_bump_du_dv = embedded.bitmask_was_bump_du_dv;
+    std::copy(embedded.bit_counts, embedded.bit_counts + 4, bit_counts);
+    std::copy(embedded.right_shifts, embedded.right_shifts + 4, right_shifts);
+
+    m_view_images = embedded.image_data;
+    m_view_bytes  = embedded.bytes;
+    m_view_backing.reset();
+    m_header_verified = true;
+    return Result{Result::Success};
+}
+
+template <typename Emit> Result DDSFile::layout_subresources(uint64_t file_size, Emit &&emit)
 {
     auto res = verify_header();
     if (res.type != Result::Success)
         return res;
 
-    ptrdiff_t offset = sizeof(uint32_t) + sizeof(Header) + (has_DXT10_header ? sizeof(HeaderDXT10) : 0);
-
-    image_data.resize(0);
-    image_data.reserve(header_DXT10.array_size * header.mipmap_count);
-
-    uint8_t *src_bytes = dds.data() + offset;
-    uint8_t *end       = dds.data() + dds.size();
+    uint64_t offset = sizeof(uint32_t) + sizeof(Header) + (has_DXT10_header ? sizeof(HeaderDXT10) : 0);
+    uint64_t end    = std::max(file_size, offset);
+    size_t   count  = 0;
     for (uint32_t j = 0; j < header_DXT10.array_size; j++)
     {
         uint32_t w = header.width;
@@ -2630,27 +3438,27 @@ Result DDSFile::populate_image_data()
                                                      std::to_string(header.mipmap_count) +
                                                      ") is 0. Will try to continue with the image data we "
                                                      "already read.");
-                header.mipmap_count     = i;
+                if (i > 0 || j == 0) // a slice that is missing entirely leaves the mip count of the others intact
+                    header.mipmap_count = i;
                 header_DXT10.array_size = j + (i > 0 ? 1 : 0);
 
                 break;
             }
 
-            if (data_size > static_cast<size_t>(end - src_bytes))
+            if (data_size > end - offset)
             {
                 res.add_message(Result::Warning,
                                 "DDS: Image data for image " + std::to_string(j + 1) + " (of " +
                                     std::to_string(header_DXT10.array_size) + ") and mip " + std::to_string(i + 1) +
                                     " (of " + std::to_string(header.mipmap_count) + ") is too large (" +
                                     std::to_string(data_size) + " bytes) and goes past the end of the file (" +
-                                    std::to_string(end - src_bytes) +
+                                    std::to_string(end - offset) +
                                     " bytes to go). "
                                     "Will try to continue with the data we have.");
-                header.mipmap_count     = i;
+                if (i > 0 || j == 0)
+                    header.mipmap_count = i;
                 header_DXT10.array_size = j + (i > 0 ? 1 : 0);
                 break;
-                // src_bytes = end - data_size;
-                // data_size = end - src_bytes;
             }
 
             // Also, make sure this isn't impossibly large.
@@ -2668,8 +3476,9 @@ Result DDSFile::populate_image_data()
                 break;
             }
 
-            image_data.emplace_back(ImageData{w, h, d, {(const char *)src_bytes, data_size}});
-            src_bytes += data_size;
+            emit(Subresource{w, h, d, offset, data_size});
+            offset += data_size;
+            count++;
 
             w = std::max<uint32_t>(1, w / 2);
             h = std::max<uint32_t>(1, h / 2);
@@ -2677,12 +3486,2400 @@ Result DDSFile::populate_image_data()
         }
     }
 
-    if (image_data.empty())
+    if (count == 0)
         res.add_message(Result::Error, "DDS: Could not read any image data from the file.");
 
     return res;
 }
 
+Result DDSFile::populate_image_data()
+{
+    if (m_view_images)
+        return Result{Result::Success}; // views come with their subresource table
+
+    auto bytes = file_bytes();
+    auto emit  = [&](const Subresource &s)
+    { image_data.emplace_back(ImageData{s.width, s.height, s.depth, bytes.substr(size_t(s.offset), size_t(s.size))}); };
+
+    image_data.resize(0);
+    image_data.reserve(header_DXT10.array_size * header.mipmap_count);
+    return layout_subresources(bytes.size(), emit);
+}
+
+Result DDSFile::populate_image_table(ImageData *table)
+{
+    auto   bytes = file_bytes();
+    size_t count = 0;
+    auto   emit  = [&](const Subresource &s)
+    { new (table + count++) ImageData{s.width, s.height, s.depth, bytes.substr(size_t(s.offset), size_t(s.size))}; };
+
+    auto res      = layout_subresources(bytes.size(), emit);
+    m_view_images = table;
+    return res;
+}
+
+DDSFile::Buffer DDSFile::release_buffer()
+{
+    Buffer buffer;
+    buffer.mip_count  = header.mipmap_count;
+    buffer.array_size = header_DXT10.array_size;
+    if (m_view_images)
+        buffer.images.assign(m_view_images, m_view_images + size_t(buffer.mip_count) * buffer.array_size);
+    else
+        buffer.images = std::move(image_data); // moving keeps the string_views into `dds` valid
+
+    if (is_view())
+    {
+        buffer.storage = std::move(m_view_backing);
+        buffer.bytes   = m_view_bytes;
+    }
+    else
+    {
+        auto owned     = std::make_shared<std::vector<uint8_t>>(std::move(dds));
+        buffer.bytes   = std::string_view{reinterpret_cast<const char *>(owned->data()), owned->size()};
+        buffer.storage = std::move(owned);
+    }
+    if (buffer.images.empty())
+        buffer.mip_count = buffer.array_size = 0;
+
+    *this = DDSFile{};
+    return buffer;
+}
+
+Result DDSFile::compute_layout(uint64_t file_size, std::vector<Subresource> &subresources)
+{
+    subresources.clear();
+    return layout_subresources(file_size, [&](const Subresource &s) { subresources.push_back(s); });
+}
+
+namespace detail
+{
+
+/// XXH64 hash of `size` bytes (read as little-endian words)
+inline uint64_t xxh64(const uint8_t *data, size_t size, uint64_t seed)
+{
+    constexpr uint64_t P1 = 0x9E3779B185EBCA87ull, P2 = 0xC2B2AE3D27D4EB4Full, P3 = 0x165667B19E3779F9ull,
+                       P4 = 0x85EBCA77C2B2AE63ull, P5 = 0x27D4EB2F165667C5ull;
+
+    auto rotl   = [](uint64_t v, int r) { return (v << r) | (v >> (64 - r)); };
+    auto read64 = [](const uint8_t *p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    };
+    auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; };
+
+    const uint8_t *p = data, *end = data + size;
+    uint64_t       h;
+    if (size >= 32)
+    {
+        uint64_t v[4] = {seed + P1 + P2, seed + P2, seed, seed - P1};
+        for (; end - p >= 32; p += 32)
+            for (int i = 0; i < 4; ++i) v[i] = round(v[i], read64(p + 8 * i));
+        h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+        for (int i = 0; i < 4; ++i) h = (h ^ round(0, v[i])) * P1 + P4;
+    }
+    else
+        h = seed + P5;
+
+    h += uint64_t(size);
+    for (; end - p >= 8; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+    if (end - p >= 4)
+    {
+        uint32_t k;
+        std::memcpy(&k, p, 4);
+        h = rotl(h ^ (uint64_t(k) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p) h = rotl(h ^ (*p * P5), 11) * P1;
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    return h ^ (h >> 32);
+}
+
+// The metadata chunk: a 32-byte header (magic, version, chunk size, entry count, size of the encoder settings, a
+// reserved word and the header hash), 88 bytes per subresource (width, height, depth, flags, offset, size, hash and
+// the statistics), the encoder settings, and an XXH64 checksum of all that. Numbers are little-endian, like the rest
+// of the file.
+constexpr char     metadata_magic[4]        = {'S', 'D', 'M', 'D'};
+constexpr uint32_t metadata_version         = 1;
+constexpr size_t   metadata_header_size     = 32;
+constexpr size_t   metadata_entry_size      = 88;
+constexpr size_t   metadata_checksum_size   = 8;
+constexpr uint32_t metadata_entry_has_stats = 1;
+
+} // namespace detail
+
+Result DDSFile::read_metadata(Metadata &metadata, bool verify) const
+{
+    const size_t     count  = size_t(header.mipmap_count) * header_DXT10.array_size;
+    const ImageData *images = m_view_images ? m_view_images : image_data.data();
+    if (count == 0 || (!m_view_images && image_data.size() < count))
+        return Result{Result::Error, "DDS: No image data. Did you call populate_image_data()?"};
+
+    const auto     bytes = file_bytes();
+    const auto    &last  = images[count - 1];
+    const size_t   start = size_t(last.chars.data() - bytes.data()) + last.chars.size();
+    const uint8_t *chunk = reinterpret_cast<const uint8_t *>(bytes.data()) + start;
+    const size_t   avail = bytes.size() - start;
+    if (avail < detail::metadata_header_size + detail::metadata_checksum_size ||
+        std::memcmp(chunk, detail::metadata_magic, sizeof(detail::metadata_magic)) != 0)
+        return Result{Result::Error, "DDS: The file has no metadata chunk."};
+
+    size_t pos = sizeof(detail::metadata_magic);
+    auto   get = [&](auto &value)
+    {
+        std::memcpy(&value, chunk + pos, sizeof(value));
+        pos += sizeof(value);
+    };
+    uint32_t version, size, entries, settings_size, reserved;
+    uint64_t header_hash;
+    get(version);
+    get(size);
+    get(entries);
+    get(settings_size);
+    get(reserved);
+    get(header_hash);
+    if (version != detail::metadata_version)
+        return Result{Result::Error, "DDS: Unsupported metadata chunk version " + std::to_string(version) + "."};
+    if (size > avail || size != detail::metadata_header_size + uint64_t(entries) * detail::metadata_entry_size +
+                                    settings_size + detail::metadata_checksum_size)
+        return Result{Result::Error, "DDS: The metadata chunk is truncated or malformed."};
+
+    uint64_t checksum;
+    std::memcpy(&checksum, chunk + size - detail::metadata_checksum_size, sizeof(checksum));
+    if (checksum != detail::xxh64(chunk, size - detail::metadata_checksum_size, 0))
+        return Result{Result::Error, "DDS: The metadata chunk is corrupt."};
+    if (header_hash != detail::xxh64(reinterpret_cast<const uint8_t *>(bytes.data()),
+                                     size_t(images[0].chars.data() - bytes.data()), 0))
+        return Result{Result::Error, "DDS: The metadata chunk was written for a different header."};
+    if (entries != count)
+        return Result{Result::Error, "DDS: The metadata chunk was written for a different layout."};
+
+    Metadata read;
+    read.header_hash = header_hash;
+    read.subresources.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto    &entry = read.subresources[i];
+        uint32_t flags;
+        get(entry.location.width);
+        get(entry.location.height);
+        get(entry.location.depth);
+        get(flags);
+        get(entry.location.offset);
+        get(entry.location.size);
+        get(entry.hash);
+        get(entry.stats.min);
+        get(entry.stats.max);
+        get(entry.stats.mean);
+        entry.has_stats = (flags & detail::metadata_entry_has_stats) != 0;
+
+        const auto &img = images[i];
+        if (entry.location.width != img.width || entry.location.height != img.height ||
+            entry.location.depth != img.depth || entry.location.offset != uint64_t(img.chars.data() - bytes.data()) ||
+            entry.location.size != img.chars.size())
+            return Result{Result::Error, "DDS: The metadata chunk was written for a different layout."};
+        if (verify && entry.hash != detail::xxh64(img.bytes(), img.chars.size(), 0))
+            return Result{Result::Error, "DDS: Subresource " + std::to_string(i) +
+                                             " changed after the metadata chunk was written."};
+    }
+    read.encoder_settings.assign(reinterpret_cast<const char *>(chunk + pos), settings_size);
+
+    metadata = std::move(read);
+    return Result{Result::Success};
+}
+
+
+namespace detail
+{
+
+/// Expand the 5:6:5 endpoint `c` into normalized r, g, b values.
+inline void unpack_565(uint32_t c, float rgb[3])
+{
+    rgb[0] = float((c >> 11) & 0x1F) / 31.f;
+    rgb[1] = float((c >> 5) & 0x3F) / 63.f;
+    rgb[2] = float(c & 0x1F) / 31.f;
+}
+
+/// Decode one channel (0 = r, 1 = g, 2 = b, 3 = punch-through alpha) of a BC1 color block.
+/// `allow_3_color` must be false for the color blocks of BC2 and BC3, which always use the 4-color palette.
+inline void decode_bc1_channel(const uint8_t *block, uint32_t channel, bool allow_3_color, float out[16])
+{
+    uint32_t c0      = block[0] | (block[1] << 8);
+    uint32_t c1      = block[2] | (block[3] << 8);
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (uint32_t(block[7]) << 24);
+    bool     three   = allow_3_color && c0 <= c1;
+
+    float palette[4];
+    if (channel == 3)
+    {
+        // only the punch-through entry can be transparent, no need to look at the colors
+        palette[0] = palette[1] = palette[2] = 1.f;
+        palette[3]                           = three ? 0.f : 1.f;
+    }
+    else
+    {
+        float rgb0[3], rgb1[3];
+        unpack_565(c0, rgb0);
+        unpack_565(c1, rgb1);
+        float e0 = rgb0[channel], e1 = rgb1[channel];
+        palette[0] = e0;
+        palette[1] = e1;
+        if (three)
+        {
+            palette[2] = 0.5f * (e0 + e1);
+            palette[3] = 0.f;
+        }
+        else
+        {
+            palette[2] = (2.f * e0 + e1) / 3.f;
+            palette[3] = (e0 + 2.f * e1) / 3.f;
+        }
+    }
+
+    for (int i = 0; i < 16; ++i, indices >>= 2) out[i] = palette[indices & 3];
+}
+
+/// Decode the explicit 4-bit alpha block of BC2.
+inline void decode_bc2_alpha(const uint8_t *block, float out[16])
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        out[2 * i + 0] = float(block[i] & 0xF) / 15.f;
+        out[2 * i + 1] = float(block[i] >> 4) / 15.f;
+    }
+}
+
+/// The 8 palette values defined by the two endpoints at the start of a BC4 block.
+inline void bc4_palette(const uint8_t *block, bool is_signed, float palette[8])
+{
+    bool six;
+    if (is_signed)
+    {
+        int8_t s0  = int8_t(block[0]), s1 = int8_t(block[1]);
+        palette[0] = std::max(-127, int(s0)) / 127.f;
+        palette[1] = std::max(-127, int(s1)) / 127.f;
+        six        = s0 > s1;
+    }
+    else
+    {
+        palette[0] = block[0] / 255.f;
+        palette[1] = block[1] / 255.f;
+        six        = block[0] > block[1];
+    }
+
+    if (six)
+        for (int i = 1; i < 7; ++i) palette[i + 1] = (float(7 - i) * palette[0] + float(i) * palette[1]) / 7.f;
+    else
+    {
+        for (int i = 1; i < 5; ++i) palette[i + 1] = (float(5 - i) * palette[0] + float(i) * palette[1]) / 5.f;
+        palette[6] = is_signed ? -1.f : 0.f;
+        palette[7] = 1.f;
+    }
+}
+
+/// Decode an 8-byte BC4 block (also used for BC3 alpha and each BC5 channel) into [0,1], or [-1,1] if `is_signed`.
+inline void decode_bc4_block(const uint8_t *block, bool is_signed, float out[16])
+{
+    float palette[8];
+    bc4_palette(block, is_signed, palette);
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) indices |= uint64_t(block[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i, indices >>= 3) out[i] = palette[indices & 7];
+}
+
+inline void store_channel(float v, bool, float &dst) { dst = v; }
+inline void store_channel(float v, bool is_signed, uint8_t &dst)
+{
+    if (is_signed)
+        v = 0.5f * v + 0.5f;
+    dst = uint8_t(std::min(std::max(v, 0.f), 1.f) * 255.f + 0.5f);
+}
+
+} // namespace detail
+
+DDSFile::Channel DDSFile::stored_channel(Channel c) const
+{
+    auto swap = [c](Channel a, Channel b) { return c == a ? b : (c == b ? a : c); };
+    switch (color_transform)
+    {
+    case ColorTransform::eSwapRG: return swap(Channel::R, Channel::G);
+    case ColorTransform::eSwapRB: return swap(Channel::R, Channel::B);
+    case ColorTransform::eAGBR: return c == Channel::R ? Channel::A : c; // stored R is unused, logical A is 1
+    default: return c;
+    }
+}
+
+template <typename T>
+Result DDSFile::decode_channel_impl(Channel channel, T *dst, uint32_t mipIdx, uint32_t arrayIdx,
+                                   const Layout &layout) const
+{
+    if (!layout.is_valid())
+        return Result{Result::Error, "DDS: Tile size of a tiled layout must be a power of two >= 4."};
+
+    const ImageData *img = get_image_data(mipIdx, arrayIdx);
+    if (!img)
+        return Result{Result::Error, "DDS: Requested image does not exist. Did you call populate_image_data()?"};
+
+    enum Kind
+    {
+        BC1,
+        BC2,
+        BC3,
+        BC4,
+        BC5
+    } kind;
+    bool is_signed = false;
+    switch (format())
+    {
+    case BC1_Typeless:
+    case BC1_UNorm:
+    case BC1_UNorm_SRGB: kind = BC1; break;
+    case BC2_Typeless:
+    case BC2_UNorm:
+    case BC2_UNorm_SRGB: kind = BC2; break;
+    case BC3_Typeless:
+    case BC3_UNorm:
+    case BC3_UNorm_SRGB: kind = BC3; break;
+    case BC4_SNorm: is_signed = true; // fall through
+    case BC4_Typeless:
+    case BC4_UNorm: kind = BC4; break;
+    case BC5_SNorm: is_signed = true; // fall through
+    case BC5_Typeless:
+    case BC5_UNorm: kind = BC5; break;
+    default:
+        return Result{Result::Error, std::string("DDS: decode_channel() only supports BC1-BC5, but format is ") +
+                                         format_name(format())};
+    }
+
+    const uint32_t c           = uint32_t(stored_channel(channel));
+    const size_t   block_bytes = (kind == BC1 || kind == BC4) ? 8 : 16;
+    const uint32_t bw          = (img->width + 3) / 4;
+    const uint32_t bh          = (img->height + 3) / 4;
+    if (img->chars.size() < size_t(bw) * bh * img->depth * block_bytes)
+        return Result{Result::Error, "DDS: Image data is too small for its dimensions."};
+
+    // channels the format doesn't store decode to a constant
+    float constant = -1.f;
+    if ((kind == BC4 && c != 0) || (kind == BC5 && c > 1))
+        constant = c == 3 ? 1.f : 0.f;
+    if (channel == Channel::A && color_transform == ColorTransform::eAGBR)
+        constant = 1.f;
+    if (constant >= 0.f)
+    {
+        T v;
+        detail::store_channel(constant, false, v);
+        std::fill(dst, dst + layout.size(img->width, img->height) * img->depth, v);
+        return Result{Result::Success};
+    }
+
+    const uint8_t *block = img->bytes();
+    float          texels[16];
+    for (uint32_t z = 0; z < img->depth; ++z)
+    {
+        T *slice = dst + size_t(z) * layout.size(img->width, img->height);
+        for (uint32_t by = 0; by < bh; ++by)
+            for (uint32_t bx = 0; bx < bw; ++bx, block += block_bytes)
+            {
+                switch (kind)
+                {
+                case BC1: detail::decode_bc1_channel(block, c, true, texels); break;
+                case BC2:
+                    if (c == 3)
+                        detail::decode_bc2_alpha(block, texels);
+                    else
+                        detail::decode_bc1_channel(block + 8, c, false, texels);
+                    break;
+                case BC3:
+                    if (c == 3)
+                        detail::decode_bc4_block(block, false, texels);
+                    else
+                        detail::decode_bc1_channel(block + 8, c, false, texels);
+                    break;
+                case BC4: detail::decode_bc4_block(block, is_signed, texels); break;
+                case BC5: detail::decode_bc4_block(block + 8 * c, is_signed, texels); break;
+                }
+
+                // clip the block against the image boundary
+                uint32_t nx = std::min(4u, img->width - 4 * bx);
+                uint32_t ny = std::min(4u, img->height - 4 * by);
+                for (uint32_t y = 0; y < ny; ++y)
+                {
+                    if (layout.rows_contiguous())
+                    {
+                        T *row = slice + layout.offset(4 * bx, 4 * by + y, img->width, img->height);
+                        for (uint32_t x = 0; x < nx; ++x) detail::store_channel(texels[4 * y + x], is_signed, row[x]);
+                    }
+                    else
+                        for (uint32_t x = 0; x < nx; ++x)
+                            detail::store_channel(texels[4 * y + x], is_signed,
+                                                  slice[layout.offset(4 * bx + x, 4 * by + y, img->width, img->height)]);
+                }
+            }
+    }
+
+    return Result{Result::Success};
+}
+
+Result DDSFile::decode_channel(Channel channel, uint8_t *dst, uint32_t mipIdx, uint32_t arrayIdx,
+                               const Layout &layout) const
+{
+    return decode_channel_impl(channel, dst, mipIdx, arrayIdx, layout);
+}
+
+Result DDSFile::decode_channel(Channel channel, float *dst, uint32_t mipIdx, uint32_t arrayIdx,
+                               const Layout &layout) const
+{
+    return decode_channel_impl(channel, dst, mipIdx, arrayIdx, layout);
+}
+
+namespace detail
+{
+
+/// Subset masks of the 2-subset partitions shared by BC6H and BC7; bit i is set if texel i is in subset 1.
+static constexpr uint16_t bc_partitions2[64] = {
+    0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80, 0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8,
+    0xFF00, 0xFFF0, 0xF000, 0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE, 0x088C, 0x3110,
+    0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C, 0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696,
+    0xA55A, 0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660, 0x0272, 0x04E4, 0x4E40, 0x2720,
+    0xC936, 0x936C, 0x39C6, 0x639C, 0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22};
+
+/// Anchor (fix-up) texel of subset 1 for each 2-subset partition.
+static constexpr uint8_t bc_anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 2,  8, 2,  2, 8, 8, 15, 2,  8, 2,  2,
+    8,  8,  2,  2,  15, 15, 6,  8,  2,  8,  15, 15, 2,  8,  2,  2,  2,  15, 15, 6, 6, 2, 6,  8,  15, 15, 2,  2,
+    15, 15, 15, 15, 15, 2,  2,  15};
+
+/// Little-endian bit reader over a 128-bit block
+struct BlockBits
+{
+    const uint8_t *block;
+    uint32_t       pos = 0;
+
+    uint32_t read(uint32_t count)
+    {
+        uint32_t v = 0;
+        for (uint32_t i = 0; i < count; ++i, ++pos) v |= uint32_t((block[pos >> 3] >> (pos & 7)) & 1) << i;
+        return v;
+    }
+};
+
+inline int32_t sign_extend(int32_t v, uint32_t bits)
+{
+    int32_t m = int32_t(1) << (bits - 1);
+    return ((v & ((m << 1) - 1)) ^ m) - m;
+}
+
+/// Endpoint fields of a BC6H header: w/x are the endpoints of subset 0, y/z those of subset 1, d is the partition
+enum BC6HField : uint8_t
+{
+    RW, GW, BW, RX, GX, BX, RY, GY, BY, RZ, GZ, BZ, D
+};
+
+/// Bits f[a:b] of a BC6H header field, stored in the block starting with bit b
+struct BC6HSegment
+{
+    uint8_t field, a, b;
+};
+
+struct BC6HMode
+{
+    uint8_t            id; ///< Value of the 2 or 5 mode bits
+    bool               transformed;
+    uint8_t            endpoint_bits;
+    uint8_t            delta_bits[3];
+    const BC6HSegment *segments;
+    uint8_t            num_segments;
+};
+
+/// The BC6H mode with mode bits `id`, or nullptr for the reserved modes
+inline const BC6HMode *find_bc6h_mode(uint32_t id)
+{
+    static constexpr BC6HSegment m0[]  = {{GY, 4, 4}, {BY, 4, 4}, {BZ, 4, 4}, {RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0},
+                                          {RX, 4, 0}, {GZ, 4, 4}, {GY, 3, 0}, {GX, 4, 0}, {BZ, 0, 0}, {GZ, 3, 0},
+                                          {BX, 4, 0}, {BZ, 1, 1}, {BY, 3, 0}, {RY, 4, 0}, {BZ, 2, 2}, {RZ, 4, 0},
+                                          {BZ, 3, 3}, {D, 4, 0}};
+    static constexpr BC6HSegment m1[]  = {{GY, 5, 5}, {GZ, 4, 4}, {GZ, 5, 5}, {RW, 6, 0}, {BZ, 0, 0}, {BZ, 1, 1},
+                                          {BY, 4, 4}, {GW, 6, 0}, {BY, 5, 5}, {BZ, 2, 2}, {GY, 4, 4}, {BW, 6, 0},
+                                          {BZ, 3, 3}, {BZ, 5, 5}, {BZ, 4, 4}, {RX, 5, 0}, {GY, 3, 0}, {GX, 5, 0},
+                                          {GZ, 3, 0}, {BX, 5, 0}, {BY, 3, 0}, {RY, 5, 0}, {RZ, 5, 0}, {D, 4, 0}};
+    static constexpr BC6HSegment m2[]  = {{RW, 9, 0}, {GW, 9, 0},   {BW, 9, 0}, {RX, 4, 0}, {RW, 10, 10},
+                                          {GY, 3, 0}, {GX, 3, 0},   {GW, 10, 10}, {BZ, 0, 0}, {GZ, 3, 0},
+                                          {BX, 3, 0}, {BW, 10, 10}, {BZ, 1, 1}, {BY, 3, 0}, {RY, 4, 0},
+                                          {BZ, 2, 2}, {RZ, 4, 0},   {BZ, 3, 3}, {D, 4, 0}};
+    static constexpr BC6HSegment m6[]  = {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 3, 0}, {RW, 10, 10}, {GZ, 4, 4},
+                                          {GY, 3, 0}, {GX, 4, 0}, {GW, 10, 10}, {GZ, 3, 0}, {BX, 3, 0}, {BW, 10, 10},
+                                          {BZ, 1, 1}, {BY, 3, 0}, {RY, 3, 0}, {BZ, 0, 0}, {BZ, 2, 2}, {RZ, 3, 0},
+                                          {GY, 4, 4}, {BZ, 3, 3}, {D, 4, 0}};
+    static constexpr BC6HSegment m10[] = {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 3, 0}, {RW, 10, 10}, {BY, 4, 4},
+                                          {GY, 3, 0}, {GX, 3, 0}, {GW, 10, 10}, {BZ, 0, 0}, {GZ, 3, 0}, {BX, 4, 0},
+                                          {BW, 10, 10}, {BY, 3, 0}, {RY, 3, 0}, {BZ, 1, 1}, {BZ, 2, 2}, {RZ, 3, 0},
+                                          {BZ, 4, 4}, {BZ, 3, 3}, {D, 4, 0}};
+    static constexpr BC6HSegment m14[] = {{RW, 8, 0}, {BY, 4, 4}, {GW, 8, 0}, {GY, 4, 4}, {BW, 8, 0}, {BZ, 4, 4},
+                                          {RX, 4, 0}, {GZ, 4, 4}, {GY, 3, 0}, {GX, 4, 0}, {BZ, 0, 0}, {GZ, 3, 0},
+                                          {BX, 4, 0}, {BZ, 1, 1}, {BY, 3, 0}, {RY, 4, 0}, {BZ, 2, 2}, {RZ, 4, 0},
+                                          {BZ, 3, 3}, {D, 4, 0}};
+    static constexpr BC6HSegment m18[] = {{RW, 7, 0}, {GZ, 4, 4}, {BY, 4, 4}, {GW, 7, 0}, {BZ, 2, 2}, {GY, 4, 4},
+                                          {BW, 7, 0}, {BZ, 3, 3}, {BZ, 4, 4}, {RX, 5, 0}, {GY, 3, 0}, {GX, 4, 0},
+                                          {BZ, 0, 0}, {GZ, 3, 0}, {BX, 4, 0}, {BZ, 1, 1}, {BY, 3, 0}, {RY, 5, 0},
+                                          {RZ, 5, 0}, {D, 4, 0}};
+    static constexpr BC6HSegment m22[] = {{RW, 7, 0}, {BZ, 0, 0}, {BY, 4, 4}, {GW, 7, 0}, {GY, 5, 5}, {GY, 4, 4},
+                                          {BW, 7, 0}, {GZ, 5, 5}, {BZ, 4, 4}, {RX, 4, 0}, {GZ, 4, 4}, {GY, 3, 0},
+                                          {GX, 5, 0}, {GZ, 3, 0}, {BX, 4, 0}, {BZ, 1, 1}, {BY, 3, 0}, {RY, 4, 0},
+                                          {BZ, 2, 2}, {RZ, 4, 0}, {BZ, 3, 3}, {D, 4, 0}};
+    static constexpr BC6HSegment m26[] = {{RW, 7, 0}, {BZ, 1, 1}, {BY, 4, 4}, {GW, 7, 0}, {BY, 5, 5}, {GY, 4, 4},
+                                          {BW, 7, 0}, {BZ, 5, 5}, {BZ, 4, 4}, {RX, 4, 0}, {GZ, 4, 4}, {GY, 3, 0},
+                                          {GX, 4, 0}, {BZ, 0, 0}, {GZ, 3, 0}, {BX, 5, 0}, {BY, 3, 0}, {RY, 4, 0},
+                                          {BZ, 2, 2}, {RZ, 4, 0}, {BZ, 3, 3}, {D, 4, 0}};
+    static constexpr BC6HSegment m30[] = {{RW, 5, 0}, {GZ, 4, 4}, {BZ, 0, 0}, {BZ, 1, 1}, {BY, 4, 4}, {GW, 5, 0},
+                                          {GY, 5, 5}, {BY, 5, 5}, {BZ, 2, 2}, {GY, 4, 4}, {BW, 5, 0}, {GZ, 5, 5},
+                                          {BZ, 3, 3}, {BZ, 5, 5}, {BZ, 4, 4}, {RX, 5, 0}, {GY, 3, 0}, {GX, 5, 0},
+                                          {GZ, 3, 0}, {BX, 5, 0}, {BY, 3, 0}, {RY, 5, 0}, {RZ, 5, 0}, {D, 4, 0}};
+    static constexpr BC6HSegment m3[]  = {{RW, 9, 0}, {GW, 9, 0}, {BW, 9, 0}, {RX, 9, 0}, {GX, 9, 0}, {BX, 9, 0}};
+    static constexpr BC6HSegment m7[]  = {{RW, 9, 0}, {GW, 9, 0},   {BW, 9, 0}, {RX, 8, 0},  {RW, 10, 10},
+                                          {GX, 8, 0}, {GW, 10, 10}, {BX, 8, 0}, {BW, 10, 10}};
+    static constexpr BC6HSegment m11[] = {{RW, 9, 0}, {GW, 9, 0},   {BW, 9, 0}, {RX, 7, 0},  {RW, 10, 11},
+                                          {GX, 7, 0}, {GW, 10, 11}, {BX, 7, 0}, {BW, 10, 11}};
+    static constexpr BC6HSegment m15[] = {{RW, 9, 0}, {GW, 9, 0},   {BW, 9, 0}, {RX, 3, 0},  {RW, 10, 15},
+                                          {GX, 3, 0}, {GW, 10, 15}, {BX, 3, 0}, {BW, 10, 15}};
+
+#define SMALLDDS_BC6H_MODE(id, tr, bits, dr, dg, db)                                                                   \
+    {id, tr, bits, {dr, dg, db}, m##id, sizeof(m##id) / sizeof(BC6HSegment)}
+    static constexpr BC6HMode modes[] = {
+        SMALLDDS_BC6H_MODE(0, true, 10, 5, 5, 5),    SMALLDDS_BC6H_MODE(1, true, 7, 6, 6, 6),
+        SMALLDDS_BC6H_MODE(2, true, 11, 5, 4, 4),    SMALLDDS_BC6H_MODE(6, true, 11, 4, 5, 4),
+        SMALLDDS_BC6H_MODE(10, true, 11, 4, 4, 5),   SMALLDDS_BC6H_MODE(14, true, 9, 5, 5, 5),
+        SMALLDDS_BC6H_MODE(18, true, 8, 6, 5, 5),    SMALLDDS_BC6H_MODE(22, true, 8, 5, 6, 5),
+        SMALLDDS_BC6H_MODE(26, true, 8, 5, 5, 6),    SMALLDDS_BC6H_MODE(30, false, 6, 6, 6, 6),
+        SMALLDDS_BC6H_MODE(3, false, 10, 10, 10, 10), SMALLDDS_BC6H_MODE(7, true, 11, 9, 9, 9),
+        SMALLDDS_BC6H_MODE(11, true, 12, 8, 8, 8),   SMALLDDS_BC6H_MODE(15, true, 16, 4, 4, 4),
+    };
+#undef SMALLDDS_BC6H_MODE
+
+    for (const auto &m : modes)
+        if (m.id == id)
+            return &m;
+    return nullptr;
+}
+
+/// Unquantize a BC6H endpoint component with `bits` bits to 16 (unsigned) or 15 (signed) bits.
+inline int32_t unquantize_bc6h(int32_t v, uint32_t bits, bool is_signed)
+{
+    if (!is_signed)
+        return bits >= 15 ? v : (v == 0 ? 0 : (v == (1 << bits) - 1 ? 0xFFFF : ((v << 16) + 0x8000) >> bits));
+    if (bits >= 16)
+        return v;
+    bool    neg = v < 0;
+    int32_t a   = neg ? -v : v;
+    a           = a == 0 ? 0 : (a >= (1 << (bits - 1)) - 1 ? 0x7FFF : ((a << 15) + 0x4000) >> (bits - 1));
+    return neg ? -a : a;
+}
+
+/// Interpolate unquantized BC6H endpoints with a 6-bit weight, returning the bits of a half float.
+inline uint16_t interpolate_bc6h(int32_t a, int32_t b, int32_t weight, bool is_signed)
+{
+    int32_t v = (a * (64 - weight) + b * weight + 32) >> 6;
+    if (!is_signed)
+        return uint16_t((v * 31) >> 6);
+    return uint16_t(v < 0 ? 0x8000 | (((-v) * 31) >> 5) : (v * 31) >> 5);
+}
+
+static constexpr int32_t bc_weights3[8]  = {0, 9, 18, 27, 37, 46, 55, 64};
+static constexpr int32_t bc_weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/// Decode a 16-byte BC6H block into 16 RGBA texels.
+inline void decode_bc6h_block(const uint8_t *block, bool is_signed, float rgba[64])
+{
+    BlockBits bits{block};
+    uint32_t  id = bits.read(2);
+    if (id > 1)
+        id |= bits.read(3) << 2;
+
+    const BC6HMode *mode = find_bc6h_mode(id);
+    if (!mode)
+    {
+        // reserved modes decode to black
+        for (int i = 0; i < 16; ++i)
+        {
+            rgba[4 * i + 0] = rgba[4 * i + 1] = rgba[4 * i + 2] = 0.f;
+            rgba[4 * i + 3]                                     = 1.f;
+        }
+        return;
+    }
+
+    int32_t f[13] = {};
+    for (uint32_t s = 0; s < mode->num_segments; ++s)
+    {
+        const BC6HSegment &seg  = mode->segments[s];
+        int                step = seg.a > seg.b ? 1 : -1;
+        for (int b = seg.b;; b += step)
+        {
+            f[seg.field] |= int32_t(bits.read(1)) << b;
+            if (b == seg.a)
+                break;
+        }
+    }
+
+    const bool     two_subsets = (id & 3) != 3;
+    const uint32_t num_ep      = two_subsets ? 4 : 2;
+    const uint32_t epb         = mode->endpoint_bits;
+    int32_t        ep[4][3]; // w, x, y, z
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        ep[0][c] = f[RW + c];
+        if (is_signed)
+            ep[0][c] = sign_extend(ep[0][c], epb);
+        for (uint32_t e = 1; e < num_ep; ++e)
+        {
+            int32_t v = f[RX + 3 * (e - 1) + c];
+            if (mode->transformed)
+            {
+                v = (ep[0][c] + sign_extend(v, mode->delta_bits[c])) & ((1 << epb) - 1);
+                if (is_signed)
+                    v = sign_extend(v, epb);
+            }
+            else if (is_signed)
+                v = sign_extend(v, epb);
+            ep[e][c] = v;
+        }
+    }
+
+    for (uint32_t e = 0; e < num_ep; ++e)
+        for (uint32_t c = 0; c < 3; ++c) ep[e][c] = unquantize_bc6h(ep[e][c], epb, is_signed);
+
+    const uint32_t partition = two_subsets ? uint32_t(f[D]) : 0;
+    const uint32_t anchor    = two_subsets ? bc_anchors2[partition] : 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t index_bits = two_subsets ? 3 : 4;
+        if (i == 0 || (two_subsets && i == anchor))
+            --index_bits;
+        uint32_t       index  = bits.read(index_bits);
+        uint32_t       subset = two_subsets ? (bc_partitions2[partition] >> i) & 1 : 0;
+        int32_t        w      = two_subsets ? bc_weights3[index] : bc_weights4[index];
+        const int32_t *a      = ep[2 * subset];
+        const int32_t *b      = ep[2 * subset + 1];
+        for (uint32_t c = 0; c < 3; ++c) rgba[4 * i + c] = half_to_float(interpolate_bc6h(a[c], b[c], w, is_signed));
+        rgba[4 * i + 3] = 1.f;
+    }
+}
+
+/// Subset indices (2 bits per texel) of the 3-subset partitions of BC7
+static constexpr uint32_t bc_partitions3[64] = {
+    0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+    0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+    0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+    0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+    0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+    0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+    0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+    0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254};
+
+/// Anchor texels of subsets 1 and 2 for each 3-subset partition
+static constexpr uint8_t bc_anchors3[2][64] = {
+    { 3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+      3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+      8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+      3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3},
+    {15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+     15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+     15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+     15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8}};
+
+static constexpr int32_t bc_weights2[4] = {0, 21, 43, 64};
+
+struct BC7Mode
+{
+    uint8_t subsets, partition_bits, rotation_bits, index_selection_bits;
+    uint8_t color_bits, alpha_bits;       ///< Endpoint bits per channel, excluding p-bits; no alpha bits means A = 1
+    uint8_t endpoint_pbits, shared_pbits; ///< 1 if each endpoint, or each subset, has a p-bit
+    uint8_t index_bits, index_bits2;      ///< Bits of the primary and (modes 4 and 5) secondary indices
+};
+
+static constexpr BC7Mode bc7_modes[8] = {
+    {3, 4, 0, 0, 4, 0, 1, 0, 3, 0}, {2, 6, 0, 0, 6, 0, 0, 1, 3, 0}, {3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+    {2, 6, 0, 0, 7, 0, 1, 0, 2, 0}, {1, 0, 2, 1, 5, 6, 0, 0, 2, 3}, {1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+    {1, 0, 0, 0, 7, 7, 1, 0, 4, 0}, {2, 6, 0, 0, 5, 5, 1, 0, 2, 0}};
+
+inline int32_t interpolate_bc7(int32_t a, int32_t b, uint32_t index, uint32_t index_bits)
+{
+    const int32_t w = index_bits == 2 ? bc_weights2[index] : index_bits == 3 ? bc_weights3[index] : bc_weights4[index];
+    return ((64 - w) * a + w * b + 32) >> 6;
+}
+
+/// Decode a 16-byte BC7 block into 16 RGBA texels. Blocks with the reserved mode decode to transparent black.
+inline void decode_bc7_block(const uint8_t *block, float rgba[64])
+{
+    BlockBits bits{block};
+    uint32_t  id = 0;
+    while (id < 8 && !bits.read(1)) ++id;
+    if (id == 8)
+    {
+        std::fill(rgba, rgba + 64, 0.f);
+        return;
+    }
+
+    const BC7Mode &mode      = bc7_modes[id];
+    const uint32_t partition = bits.read(mode.partition_bits);
+    const uint32_t rotation  = bits.read(mode.rotation_bits);
+    const uint32_t isb       = bits.read(mode.index_selection_bits);
+
+    // endpoints of each subset, as 8-bit RGBA
+    const uint32_t num_ep = 2u * mode.subsets;
+    int32_t        ep[6][4];
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        const uint32_t n = c < 3 ? mode.color_bits : mode.alpha_bits;
+        for (uint32_t e = 0; e < num_ep; ++e) ep[e][c] = n ? int32_t(bits.read(n)) : 255;
+    }
+    if (mode.endpoint_pbits || mode.shared_pbits)
+    {
+        uint32_t pbits[6];
+        for (uint32_t e = 0; e < num_ep; ++e)
+            pbits[e] = mode.endpoint_pbits ? bits.read(1) : (e & 1) ? pbits[e - 1] : bits.read(1);
+        for (uint32_t e = 0; e < num_ep; ++e)
+            for (uint32_t c = 0; c < (mode.alpha_bits ? 4u : 3u); ++c) ep[e][c] = (ep[e][c] << 1) | int32_t(pbits[e]);
+    }
+    for (uint32_t c = 0; c < (mode.alpha_bits ? 4u : 3u); ++c)
+    {
+        // the p-bit (if any) is the lowest bit of the endpoint; expand by replicating the high bits
+        const uint32_t n = (c < 3 ? mode.color_bits : mode.alpha_bits) + mode.endpoint_pbits + mode.shared_pbits;
+        if (n >= 8)
+            continue;
+        for (uint32_t e = 0; e < num_ep; ++e) ep[e][c] = (ep[e][c] << (8 - n)) | (ep[e][c] >> (2 * n - 8));
+    }
+
+    auto subset_of = [&](uint32_t i) -> uint32_t
+    {
+        if (mode.subsets == 2)
+            return (bc_partitions2[partition] >> i) & 1;
+        if (mode.subsets == 3)
+            return (bc_partitions3[partition] >> (2 * i)) & 3;
+        return 0;
+    };
+    auto is_anchor = [&](uint32_t i)
+    {
+        return i == 0 || (mode.subsets == 2 && i == bc_anchors2[partition]) ||
+               (mode.subsets == 3 && (i == bc_anchors3[0][partition] || i == bc_anchors3[1][partition]));
+    };
+
+    // the most significant bit of the index of each anchor texel is implicitly 0
+    uint32_t index[16], index2[16] = {};
+    for (uint32_t i = 0; i < 16; ++i) index[i] = bits.read(mode.index_bits - is_anchor(i));
+    if (mode.index_bits2)
+        for (uint32_t i = 0; i < 16; ++i) index2[i] = bits.read(mode.index_bits2 - (i == 0));
+
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        const int32_t *a = ep[2 * subset_of(i)];
+        const int32_t *b = a + 4;
+        // with secondary indices, the index selection bit picks which set of indices the colors use
+        uint32_t color_index = index[i], color_bits = mode.index_bits;
+        uint32_t alpha_index = index[i], alpha_bits = mode.index_bits;
+        if (mode.index_bits2)
+        {
+            (isb ? color_index : alpha_index) = index2[i];
+            (isb ? color_bits : alpha_bits)   = mode.index_bits2;
+        }
+        int32_t texel[4];
+        for (uint32_t c = 0; c < 3; ++c) texel[c] = interpolate_bc7(a[c], b[c], color_index, color_bits);
+        texel[3] = interpolate_bc7(a[3], b[3], alpha_index, alpha_bits);
+        if (rotation)
+            std::swap(texel[3], texel[rotation - 1]);
+        for (uint32_t c = 0; c < 4; ++c) rgba[4 * i + c] = float(texel[c]) / 255.f;
+    }
+}
+
+/// Decode a 4x4 block of a BC1-BC7 format into 16 RGBA texels in storage order.
+inline void decode_bc_block_rgba(DDSFile::DXGIFormat fmt, const uint8_t *block, float rgba[64])
+{
+    if (fmt >= DDSFile::BC6H_Typeless && fmt <= DDSFile::BC6H_SF16)
+        return decode_bc6h_block(block, fmt == DDSFile::BC6H_SF16, rgba);
+    if (fmt >= DDSFile::BC7_Typeless && fmt <= DDSFile::BC7_UNorm_SRGB)
+        return decode_bc7_block(block, rgba);
+
+    float c[4][16];
+    auto  fill = [&c](int ch, float v) { std::fill(c[ch], c[ch] + 16, v); };
+    switch (fmt)
+    {
+    case DDSFile::BC1_Typeless:
+    case DDSFile::BC1_UNorm:
+    case DDSFile::BC1_UNorm_SRGB:
+        for (uint32_t ch = 0; ch < 4; ++ch) decode_bc1_channel(block, ch, true, c[ch]);
+        break;
+    case DDSFile::BC2_Typeless:
+    case DDSFile::BC2_UNorm:
+    case DDSFile::BC2_UNorm_SRGB:
+        for (uint32_t ch = 0; ch < 3; ++ch) decode_bc1_channel(block + 8, ch, false, c[ch]);
+        decode_bc2_alpha(block, c[3]);
+        break;
+    case DDSFile::BC3_Typeless:
+    case DDSFile::BC3_UNorm:
+    case DDSFile::BC3_UNorm_SRGB:
+        for (uint32_t ch = 0; ch < 3; ++ch) decode_bc1_channel(block + 8, ch, false, c[ch]);
+        decode_bc4_block(block, false, c[3]);
+        break;
+    case DDSFile::BC4_Typeless:
+    case DDSFile::BC4_UNorm:
+    case DDSFile::BC4_SNorm:
+        decode_bc4_block(block, fmt == DDSFile::BC4_SNorm, c[0]);
+        fill(1, 0.f);
+        fill(2, 0.f);
+        fill(3, 1.f);
+        break;
+    default: // BC5
+        decode_bc4_block(block, fmt == DDSFile::BC5_SNorm, c[0]);
+        decode_bc4_block(block + 8, fmt == DDSFile::BC5_SNorm, c[1]);
+        fill(2, 0.f);
+        fill(3, 1.f);
+        break;
+    }
+
+    for (int i = 0; i < 16; ++i)
+        for (int ch = 0; ch < 4; ++ch) rgba[4 * i + ch] = c[ch][i];
+}
+
+/// Read `num_bytes` (at most 4) little-endian bytes as an unsigned integer.
+inline uint32_t read_le(const uint8_t *p, uint32_t num_bytes)
+{
+    uint32_t v = 0;
+    for (uint32_t b = 0; b < num_bytes; ++b) v |= uint32_t(p[b]) << (8 * b);
+    return v;
+}
+
+/// Widen `n` pixels of `comps` channels stored as `type` into RGBA floats.
+inline bool decode_typed_row(const uint8_t *src, DDSFile::DataType type, uint32_t comps, uint32_t n, float *rgba)
+{
+    if (comps == 0 || comps > 4 || !convert_typed(src, 0, type, comps, n, 1, rgba))
+        return false;
+
+    // spread the channels out to RGBA in place, back to front so that nothing is overwritten before it is moved
+    if (comps < 4)
+        for (uint32_t i = n; i-- > 0;)
+            for (uint32_t c = 4; c-- > 0;) rgba[4 * i + c] = c < comps ? rgba[comps * i + c] : c == 3 ? 1.f : 0.f;
+    return true;
+}
+
+} // namespace detail
+
+void DDSFile::apply_color_transform(float *rgba, size_t count) const
+{
+    for (size_t i = 0; i < count; ++i, rgba += 4)
+    {
+        switch (color_transform)
+        {
+        case ColorTransform::eSwapRG: std::swap(rgba[0], rgba[1]); break;
+        case ColorTransform::eSwapRB: std::swap(rgba[0], rgba[2]); break;
+        case ColorTransform::eAGBR:
+            rgba[0] = rgba[3];
+            rgba[3] = 1.f;
+            break;
+        case ColorTransform::eLuminance: rgba[1] = rgba[2] = rgba[0]; break;
+        case ColorTransform::eOrthographicNormal:
+            rgba[2] = std::sqrt(std::max(0.f, 1.f - rgba[0] * rgba[0] - rgba[1] * rgba[1]));
+            break;
+        default: return;
+        }
+    }
+}
+
+Result DDSFile::decode(float *dst, uint32_t mipIdx, uint32_t arrayIdx, const Layout &layout) const
+{
+    if (!layout.is_valid())
+        return Result{Result::Error, "DDS: Tile size of a tiled layout must be a power of two >= 4."};
+
+    const ImageData *img = get_image_data(mipIdx, arrayIdx);
+    if (!img)
+        return Result{Result::Error, "DDS: Requested image does not exist. Did you call populate_image_data()?"};
+
+    const uint32_t w = img->width, h = img->height;
+    const size_t   slice_size = layout.size(w, h);
+    auto           store      = [&](const float *rgba, uint32_t x, uint32_t y, uint32_t z, uint32_t n)
+    {
+        float *slice = dst + 4 * slice_size * z;
+        if (layout.rows_contiguous() && n <= 4)
+            std::memcpy(slice + 4 * layout.offset(x, y, w, h), rgba, 4 * n * sizeof(float));
+        else
+            for (uint32_t i = 0; i < n; ++i)
+                std::memcpy(slice + 4 * layout.offset(x + i, y, w, h), rgba + 4 * i, 4 * sizeof(float));
+    };
+
+    const auto fmt = format();
+    if ((fmt >= BC1_Typeless && fmt <= BC5_SNorm) || (fmt >= BC6H_Typeless && fmt <= BC7_UNorm_SRGB))
+    {
+        const size_t   block_bytes = (fmt <= BC1_UNorm_SRGB || (fmt >= BC4_Typeless && fmt <= BC4_SNorm)) ? 8 : 16;
+        const uint32_t bw          = (w + 3) / 4;
+        const uint32_t bh          = (h + 3) / 4;
+        if (img->chars.size() < size_t(bw) * bh * img->depth * block_bytes)
+            return Result{Result::Error, "DDS: Image data is too small for its dimensions."};
+
+        const uint8_t *block = img->bytes();
+        float          rgba[64];
+        for (uint32_t z = 0; z < img->depth; ++z)
+            for (uint32_t by = 0; by < bh; ++by)
+                for (uint32_t bx = 0; bx < bw; ++bx, block += block_bytes)
+                {
+                    detail::decode_bc_block_rgba(fmt, block, rgba);
+                    apply_color_transform(rgba, 16);
+                    uint32_t nx = std::min(4u, w - 4 * bx);
+                    uint32_t ny = std::min(4u, h - 4 * by);
+                    for (uint32_t y = 0; y < ny; ++y) store(rgba + 16 * y, 4 * bx, 4 * by + y, z, nx);
+                }
+        return Result{Result::Success};
+    }
+
+    if (is_compressed(fmt) || bpp < 8 || bpp % 8 != 0)
+        return Result{Result::Error, std::string("DDS: decode() does not support format ") + format_name(fmt)};
+
+    const uint32_t pixel_bytes = uint32_t(bpp) / 8;
+    const size_t   row_bytes   = size_t(pixel_bytes) * w;
+    if (img->chars.size() < row_bytes * h * img->depth)
+        return Result{Result::Error, "DDS: Image data is too small for its dimensions."};
+
+    // Decode one row of pixels into `rgba` in storage order
+    std::function<bool(const uint8_t *, float *)> decode_row;
+    if (!bitmasked)
+    {
+        auto     type  = data_type(fmt);
+        auto     size  = data_type_size(type);
+        uint32_t comps = size ? uint32_t(pixel_bytes / size) : 0;
+        if (comps == 0 || comps > 4)
+            return Result{Result::Error, std::string("DDS: decode() does not support format ") + format_name(fmt)};
+
+        decode_row = [=](const uint8_t *src, float *rgba)
+        {
+            if (!detail::decode_typed_row(src, type, comps, w, rgba))
+                return false;
+            if (fmt == A8_UNorm)
+                for (uint32_t i = 0; i < w; ++i)
+                {
+                    rgba[4 * i + 3] = rgba[4 * i];
+                    rgba[4 * i]     = 0.f;
+                }
+            else if (fmt == B8G8R8X8_UNorm || fmt == B8G8R8X8_UNorm_SRGB || fmt == B8G8R8X8_Typeless)
+                for (uint32_t i = 0; i < w; ++i) rgba[4 * i + 3] = 1.f;
+            return true;
+        };
+    }
+    else if (pixel_bytes > 4)
+        return Result{Result::Error, "DDS: decode() does not support bitmasked formats wider than 32 bits."};
+    else
+    {
+        decode_row = [=](const uint8_t *src, float *rgba)
+        {
+            for (uint32_t i = 0; i < w; ++i, src += pixel_bytes, rgba += 4)
+            {
+                uint32_t px = detail::read_le(src, pixel_bytes);
+                uint32_t v[4];
+                for (int c = 0; c < 4; ++c)
+                    v[c] = bit_counts[c] ? (px >> right_shifts[c]) & uint32_t((uint64_t(1) << bit_counts[c]) - 1) : 0;
+
+                switch (fmt)
+                {
+                case R11G11B10_Float:
+                    rgba[0] = decode_float11(v[0]);
+                    rgba[1] = decode_float11(v[1]);
+                    rgba[2] = decode_float10(v[2]);
+                    rgba[3] = 1.f;
+                    break;
+                case R9G9B9E5_SHAREDEXP:
+                    for (int c = 0; c < 3; ++c) rgba[c] = decode_float9_exp_5(v[c], v[3]);
+                    rgba[3] = 1.f;
+                    break;
+                case R10G10B10_XR_BIAS_A2_UNorm:
+                    for (int c = 0; c < 3; ++c) rgba[c] = xr_bias_to_float(int(v[c]));
+                    rgba[3] = v[3] / 3.f;
+                    break;
+                case R10G10B10A2_UInt:
+                    for (int c = 0; c < 4; ++c) rgba[c] = float(v[c]);
+                    break;
+                default:
+                    for (int c = 0; c < 4; ++c)
+                        rgba[c] = bit_counts[c] ? float(v[c]) / float((uint64_t(1) << bit_counts[c]) - 1) : 0.f;
+                    if (!bitmask_has_alpha || !bit_counts[3])
+                        rgba[3] = 1.f;
+                    break;
+                }
+            }
+            return true;
+        };
+    }
+
+    std::vector<float> row(4 * size_t(w));
+    const uint8_t     *src = img->bytes();
+    for (uint32_t z = 0; z < img->depth; ++z)
+        for (uint32_t y = 0; y < h; ++y, src += row_bytes)
+        {
+            if (!decode_row(src, row.data()))
+                return Result{Result::Error, std::string("DDS: decode() does not support format ") + format_name(fmt)};
+            apply_color_transform(row.data(), w);
+            if (layout.type == LayoutType::Linear)
+                std::memcpy(dst + 4 * (slice_size * z + size_t(y) * w), row.data(), row.size() * sizeof(float));
+            else
+                for (uint32_t x = 0; x < w; x += 4) store(row.data() + 4 * x, x, y, z, std::min(4u, w - x));
+        }
+
+    return Result{Result::Success};
+}
+
+Result DDSWriter::init(DDSFile::DXGIFormat format, uint32_t width, uint32_t height, uint32_t depth, uint32_t mip_count,
+                       uint32_t array_size, bool cubemap)
+{
+    m_file      = DDSFile{};
+    m_pixel_end = 0;
+
+    if (width == 0 || height == 0 || depth == 0 || mip_count == 0 || array_size == 0)
+        return Result{Result::Error, "DDSWriter: Texture dimensions, mip count and array size must be non-zero."};
+    if (mip_count >= 32)
+        return Result{Result::Error, "DDSWriter: The number of mips must be less than 32."};
+    if (cubemap && (width != height || depth != 1))
+        return Result{Result::Error, "DDSWriter: Cubemap faces must be square 2D images."};
+    if (DDSFile::bits_per_pixel(format) == 0)
+        return Result{Result::Error, std::string("DDSWriter: Unsupported format ") + format_name(format)};
+
+    const bool   volume = depth > 1;
+    const size_t layers = size_t(array_size) * (cubemap ? 6 : 1);
+    size_t       total  = 0;
+    for (uint32_t m = 0; m < mip_count; ++m)
+        total += DDSFile::surface_size(format, std::max(1u, width >> m), std::max(1u, height >> m),
+                                       std::max(1u, depth >> m));
+    total *= layers;
+
+    using Flags = DDSFile::HeaderFlagBits;
+
+    DDSFile::Header header{};
+    header.size         = sizeof(DDSFile::Header);
+    header.flags        = uint32_t(Flags::Texture) | (mip_count > 1 ? uint32_t(Flags::Mipmap) : 0) |
+                          (volume ? uint32_t(Flags::Depth) : 0);
+    header.height       = height;
+    header.width        = width;
+    header.depth        = depth;
+    header.mipmap_count = mip_count;
+    if (DDSFile::is_compressed(format))
+    {
+        header.flags |= uint32_t(Flags::LinearSize);
+        header.pitch_or_linear_size = uint32_t(DDSFile::surface_size(format, width, height));
+    }
+    else
+    {
+        header.flags |= uint32_t(Flags::Pitch);
+        header.pitch_or_linear_size = uint32_t((uint64_t(DDSFile::bits_per_pixel(format)) * width + 7) / 8);
+    }
+    header.pixel_format.size   = sizeof(DDSFile::PixelFormat);
+    header.pixel_format.flags  = uint32_t(DDSFile::PixelFormatFlagBits::FourCC);
+    header.pixel_format.fourCC = DDSFile::FOURCC_DX10;
+    // DDSCAPS_TEXTURE, plus DDSCAPS_COMPLEX and DDSCAPS_MIPMAP where appropriate
+    header.caps1 = 0x1000 | (mip_count > 1 || cubemap || volume ? 0x8 : 0) | (mip_count > 1 ? 0x400000 : 0);
+    header.caps2 = (cubemap ? uint32_t(DDSFile::CubemapAllFaces) : 0) | (volume ? uint32_t(DDSFile::Volume) : 0);
+
+    DDSFile::HeaderDXT10 header_DXT10;
+    header_DXT10.format             = format;
+    header_DXT10.resource_dimension = volume ? DDSFile::Texture3D : DDSFile::Texture2D;
+    header_DXT10.misc_flag          = cubemap ? uint32_t(DDSFile::DXT10MiscFlagBits::TextureCube) : 0;
+    header_DXT10.array_size         = array_size;
+
+    const size_t         header_size = sizeof(DDSFile::Magic) + sizeof(header) + sizeof(header_DXT10);
+    std::vector<uint8_t> dds(header_size + total, 0);
+    std::memcpy(dds.data(), DDSFile::Magic, sizeof(DDSFile::Magic));
+    std::memcpy(dds.data() + sizeof(DDSFile::Magic), &header, sizeof(header));
+    std::memcpy(dds.data() + sizeof(DDSFile::Magic) + sizeof(header), &header_DXT10, sizeof(header_DXT10));
+
+    auto res = m_file.load(std::move(dds));
+    if (res.type == Result::Error)
+        return res;
+    m_pixel_end = m_file.dds.size();
+    return m_file.populate_image_data();
+}
+
+uint8_t *DDSWriter::image_data(uint32_t mipIdx, uint32_t arrayIdx)
+{
+    // The pixel data may change, so drop the metadata chunk; shrinking keeps the subresource table valid
+    m_file.dds.resize(std::min(m_file.dds.size(), m_pixel_end));
+
+    // The pixel data lives in m_file.dds, which we own and may modify
+    auto img = m_file.get_image_data(mipIdx, arrayIdx);
+    return img ? const_cast<uint8_t *>(img->bytes()) : nullptr;
+}
+
+Result DDSWriter::set_image_data(uint32_t mipIdx, uint32_t arrayIdx, const void *data, size_t size)
+{
+    auto img = m_file.get_image_data(mipIdx, arrayIdx);
+    if (!img)
+        return Result{Result::Error, "DDSWriter: Requested image does not exist."};
+    if (img->chars.size() != size)
+        return Result{Result::Error, "DDSWriter: Image data size mismatch: expected " +
+                                         std::to_string(img->chars.size()) + " bytes, but got " + std::to_string(size)};
+    std::memcpy(image_data(mipIdx, arrayIdx), data, size);
+    return Result{Result::Success};
+}
+
+Result DDSWriter::add_metadata(const std::string &encoder_settings, bool stats, uint32_t num_threads)
+{
+    if (m_file.dds.empty())
+        return Result{Result::Error, "DDSWriter: Nothing to describe. Did you call init()?"};
+    m_file.dds.resize(m_pixel_end);
+
+    const uint32_t mips  = m_file.mip_count();
+    const size_t   count = size_t(mips) * m_file.array_size();
+    const uint64_t size  = detail::metadata_header_size + count * detail::metadata_entry_size +
+                          encoder_settings.size() + detail::metadata_checksum_size;
+    if (size > std::numeric_limits<uint32_t>::max())
+        return Result{Result::Error, "DDSWriter: The metadata chunk would be too large."};
+
+    const uint8_t                        *file = m_file.dds.data();
+    std::vector<DDSFile::Metadata::Entry> entries(count);
+    parallel_for(
+        0, count,
+        [&](size_t i)
+        {
+            const auto &img   = m_file.image_data[i];
+            auto       &entry = entries[i];
+            entry.location    = {img.width, img.height, img.depth, uint64_t(img.bytes() - file), img.chars.size()};
+            entry.hash        = detail::xxh64(img.bytes(), img.chars.size(), 0);
+            if (!stats)
+                return;
+
+            std::vector<float> rgba(4 * size_t(img.width) * img.height * img.depth);
+            if (m_file.decode(rgba.data(), uint32_t(i % mips), uint32_t(i / mips)).type == Result::Error)
+                return;
+            const float inf    = std::numeric_limits<float>::infinity();
+            float       lo[4]  = {inf, inf, inf, inf}, hi[4] = {-inf, -inf, -inf, -inf};
+            double      sum[4] = {0., 0., 0., 0.};
+            size_t      n[4]   = {0, 0, 0, 0};
+            for (size_t t = 0; t < rgba.size(); t += 4)
+                for (int c = 0; c < 4; ++c)
+                {
+                    const float v = rgba[t + c];
+                    if (v != v)
+                        continue;
+                    lo[c] = std::min(lo[c], v);
+                    hi[c] = std::max(hi[c], v);
+                    sum[c] += v;
+                    ++n[c];
+                }
+            for (int c = 0; c < 4; ++c)
+            {
+                entry.stats.min[c]  = n[c] ? lo[c] : 0.f;
+                entry.stats.max[c]  = n[c] ? hi[c] : 0.f;
+                entry.stats.mean[c] = n[c] ? float(sum[c] / double(n[c])) : 0.f;
+            }
+            entry.has_stats = true;
+        },
+        num_threads);
+
+    std::vector<uint8_t> chunk;
+    chunk.reserve(size_t(size));
+    auto put = [&](const auto &value)
+    {
+        const auto *p = reinterpret_cast<const uint8_t *>(&value);
+        chunk.insert(chunk.end(), p, p + sizeof(value));
+    };
+    put(detail::metadata_magic);
+    put(detail::metadata_version);
+    put(uint32_t(size));
+    put(uint32_t(count));
+    put(uint32_t(encoder_settings.size()));
+    put(uint32_t(0));
+    put(detail::xxh64(file, size_t(m_file.image_data[0].bytes() - file), 0));
+    for (const auto &entry : entries)
+    {
+        put(entry.location.width);
+        put(entry.location.height);
+        put(entry.location.depth);
+        put(entry.has_stats ? detail::metadata_entry_has_stats : 0u);
+        put(entry.location.offset);
+        put(entry.location.size);
+        put(entry.hash);
+        put(entry.stats.min);
+        put(entry.stats.max);
+        put(entry.stats.mean);
+    }
+    chunk.insert(chunk.end(), encoder_settings.begin(), encoder_settings.end());
+    put(detail::xxh64(chunk.data(), chunk.size(), 0));
+
+    // appending may move the pixel data, so point the subresource table at it again
+    m_file.dds.insert(m_file.dds.end(), chunk.begin(), chunk.end());
+    return m_file.populate_image_data();
+}
+
+Result DDSWriter::save(const char *filepath) const
+{
+    std::ofstream ofs(filepath, std::ios_base::binary);
+    if (!ofs.is_open())
+        return Result{Result::Error, "Cannot open file for writing"};
+
+    return save(ofs);
+}
+
+Result DDSWriter::save(std::ostream &output) const
+{
+    if (m_file.dds.empty())
+        return Result{Result::Error, "DDSWriter: Nothing to write. Did you call init()?"};
+
+    output.write(reinterpret_cast<const char *>(m_file.dds.data()), m_file.dds.size());
+    if (!output)
+        return Result{Result::Error, "Cannot write file: I/O error"};
+    return Result{Result::Success};
+}
+
+namespace detail
+{
+/// Size of `size` rounded up to a multiple of `alignment` (a power of two)
+constexpr size_t align_up(size_t size, size_t alignment) { return (size + alignment - 1) & ~(alignment - 1); }
+} // namespace detail
+
+uint8_t *DDSFilePool::allocate(size_t size, std::shared_ptr<uint8_t> *slab)
+{
+    size = detail::align_up(size, alignof(std::max_align_t));
+    if (size > m_slab_size / 4)
+    {
+        m_slabs.emplace_back(new uint8_t[size], std::default_delete<uint8_t[]>());
+        if (slab)
+            *slab = m_slabs.back();
+        auto *block = m_slabs.back().get();
+        if (m_slab) // keep the current slab last
+            std::swap(m_slabs.back(), m_slabs[m_slabs.size() - 2]);
+        return block;
+    }
+    if (!m_slab || m_slab_used + size > m_slab_size)
+    {
+        m_slabs.emplace_back(new uint8_t[m_slab_size], std::default_delete<uint8_t[]>());
+        m_slab      = m_slabs.back().get();
+        m_slab_used = 0;
+    }
+    if (slab)
+        *slab = m_slabs.back();
+    m_slab_used += size;
+    return m_slab + m_slab_used - size;
+}
+
+DDSFile *DDSFilePool::load(const uint8_t *data, size_t size, Result *result)
+{
+    // the DDSFile object followed by the bytes; the subresource table is allocated once the header is known
+    const size_t             header = detail::align_up(sizeof(DDSFile), alignof(std::max_align_t));
+    std::shared_ptr<uint8_t> slab;
+    uint8_t                 *block = allocate(header + size, &slab);
+    std::memcpy(block + header, data, size);
+    return load_into(block, size, slab, result);
+}
+
+DDSFile *DDSFilePool::load(const char *filepath, Result *result)
+{
+    auto fail = [result](const char *message) -> DDSFile *
+    {
+        if (result)
+            *result = Result{Result::Error, message};
+        return nullptr;
+    };
+
+    // read straight into the slab, without the per-file allocations of a buffered stream
+    const size_t             header = detail::align_up(sizeof(DDSFile), alignof(std::max_align_t));
+    std::shared_ptr<uint8_t> slab;
+    size_t                   size = 0, done = 0;
+    uint8_t                 *block = nullptr;
+#ifdef _WIN32
+    std::FILE *file = std::fopen(filepath, "rb");
+    if (!file)
+        return fail("Cannot open file");
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    long end = std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1L;
+    if (end < 0 || std::fseek(file, 0, SEEK_SET) != 0)
+    {
+        std::fclose(file);
+        return fail("Cannot read file: I/O error");
+    }
+    size  = size_t(end);
+    block = allocate(header + size, &slab);
+    done  = std::fread(block + header, 1, size, file);
+    std::fclose(file);
+#else
+    int fd = ::open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return fail("Cannot open file");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return fail("Cannot open file");
+    }
+    size  = size_t(st.st_size);
+    block = allocate(header + size, &slab);
+    while (done < size)
+    {
+        ssize_t n = ::read(fd, block + header + done, size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += size_t(n);
+    }
+    ::close(fd);
+#endif
+    if (done != size)
+        return fail("Cannot read file: I/O error");
+    return load_into(block, size, slab, result);
+}
+
+DDSFile *DDSFilePool::load_into(uint8_t *block, size_t size, const std::shared_ptr<uint8_t> &slab, Result *result)
+{
+    auto *dds          = new (block) DDSFile;
+    dds->m_report_info = false;
+
+    // the bytes stay alive as long as the view, the table and the DDSFile object as long as the pool
+    auto res = dds->load_view(block + detail::align_up(sizeof(DDSFile), alignof(std::max_align_t)), size, slab);
+    if (res.type != Result::Error)
+    {
+        // Lay the file out once without storing anything, which trims the mip and array counts to the subresources
+        // the data actually holds, so a hostile header can't make the table larger than the file warrants
+        res = dds->layout_subresources(size, [](const DDSFile::Subresource &) {});
+    }
+    if (res.type != Result::Error)
+    {
+        const size_t count = size_t(dds->mip_count()) * dds->array_size();
+        auto        *table = reinterpret_cast<DDSFile::ImageData *>(allocate(sizeof(DDSFile::ImageData) * count));
+        for (size_t i = 0; i < count; ++i) new (table + i) DDSFile::ImageData{};
+        auto table_res = dds->populate_image_table(table);
+        if (table_res.type == Result::Error)
+            res = table_res;
+    }
+
+    if (result)
+        *result = res;
+    if (res.type == Result::Error)
+    {
+        dds->~DDSFile();
+        return nullptr;
+    }
+    m_files.push_back(dds);
+    return dds;
+}
+
+void DDSFilePool::clear()
+{
+    for (auto *dds : m_files) dds->~DDSFile();
+    m_files.clear();
+    m_slabs.clear();
+    m_slab      = nullptr;
+    m_slab_used = 0;
+}
+
+void parallel_for(size_t begin, size_t end, const std::function<void(size_t)> &fn, uint32_t num_threads)
+{
+    if (begin >= end)
+        return;
+
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = uint32_t(std::min<size_t>(num_threads, end - begin));
+
+    std::atomic<size_t> next{begin};
+    auto                worker = [&]
+    {
+        for (size_t i = next++; i < end; i = next++) fn(i);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (uint32_t t = 1; t < num_threads; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads) t.join();
+}
+
+namespace detail
+{
+
+/// Clamp a texel value to [lo,hi] for the block encoders, mapping NaN to `lo`
+inline float clamp_texel(float v, float lo, float hi) { return v >= lo ? (v < hi ? v : hi) : lo; }
+
+/// Unit-length principal axis of the first `channels` (at most 4) components of `count` points, by power iteration on
+/// their covariance. Returns false (with a zero axis) if all points coincide.
+inline bool principal_axis(const float (*px)[4], uint32_t count, uint32_t channels, float mean[4], float axis[4])
+{
+    std::fill(mean, mean + 4, 0.f);
+    std::fill(axis, axis + 4, 0.f);
+    if (count == 0)
+        return false;
+    for (uint32_t i = 0; i < count; ++i)
+        for (uint32_t c = 0; c < channels; ++c) mean[c] += px[i][c] / float(count);
+
+    float cov[4][4] = {};
+    for (uint32_t i = 0; i < count; ++i)
+        for (uint32_t a = 0; a < channels; ++a)
+            for (uint32_t b = 0; b < channels; ++b) cov[a][b] += (px[i][a] - mean[a]) * (px[i][b] - mean[b]);
+
+    // start from the column of the channel with the largest variance, which can't be orthogonal to the axis
+    uint32_t start = 0;
+    for (uint32_t c = 1; c < channels; ++c)
+        if (cov[c][c] > cov[start][start])
+            start = c;
+    if (cov[start][start] <= 0.f)
+        return false;
+    for (uint32_t c = 0; c < channels; ++c) axis[c] = cov[c][start];
+    for (int it = 0; it < 8; ++it)
+    {
+        float a[4] = {}, len = 0.f;
+        for (uint32_t r = 0; r < channels; ++r)
+        {
+            for (uint32_t c = 0; c < channels; ++c) a[r] += cov[r][c] * axis[c];
+            len = std::max(len, std::abs(a[r]));
+        }
+        if (len == 0.f)
+            break;
+        for (uint32_t c = 0; c < channels; ++c) axis[c] = a[c] / len;
+    }
+    float len = 0.f;
+    for (uint32_t c = 0; c < channels; ++c) len += axis[c] * axis[c];
+    len = std::sqrt(len);
+    for (uint32_t c = 0; c < channels; ++c) axis[c] /= len;
+    return true;
+}
+
+/// Endpoints `e0` and `e1` that minimize the squared error of the points `px`, given the interpolation weight `t[i]`
+/// of each point (0 for e0, 1 for e1). Points with `skip[i]` are ignored. Returns false if the system is singular.
+inline bool fit_endpoints(const float (*px)[4], const float t[16], const bool *skip, uint32_t channels, float e0[4],
+                          float e1[4])
+{
+    float aa = 0.f, ab = 0.f, bb = 0.f, ax[4] = {}, bx[4] = {};
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        if (skip && skip[i])
+            continue;
+        const float a = 1.f - t[i], b = t[i];
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+            ax[c] += a * px[i][c];
+            bx[c] += b * px[i][c];
+        }
+    }
+    const float det = aa * bb - ab * ab;
+    if (std::abs(det) < 1e-6f)
+        return false;
+    for (uint32_t c = 0; c < channels; ++c)
+    {
+        e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+        e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+    }
+    return true;
+}
+
+/// Compress the colors of a BC1 block (also the color part of BC2 and BC3). Texels with alpha below 0.5 become
+/// transparent if `punch_through_alpha`, which requires the 3-color palette; otherwise the 4-color palette is used.
+inline void encode_bc1_colors(const float rgba[64], uint8_t block[8], bool punch_through_alpha)
+{
+    float    px[16][4], opaque[16][4];
+    bool     transparent[16];
+    uint32_t num_opaque = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        for (uint32_t c = 0; c < 3; ++c) px[i][c] = clamp_texel(rgba[4 * i + c], 0.f, 1.f);
+        px[i][3]       = 0.f;
+        transparent[i] = punch_through_alpha && !(rgba[4 * i + 3] >= 0.5f);
+        if (!transparent[i])
+            std::memcpy(opaque[num_opaque++], px[i], sizeof(px[i]));
+    }
+    const bool three = num_opaque < 16;
+    if (num_opaque == 0)
+    {
+        // equal endpoints select the 3-color palette, and index 3 is transparent
+        std::memset(block, 0, 4);
+        std::memset(block + 4, 0xFF, 4);
+        return;
+    }
+
+    auto quantize = [](const float e[4])
+    {
+        auto q = [](float v, int32_t max) { return uint32_t(std::min(std::max(v, 0.f), 1.f) * float(max) + 0.5f); };
+        return (q(e[0], 31) << 11) | (q(e[1], 63) << 5) | q(e[2], 31);
+    };
+
+    // Order the endpoints for the intended palette, and assign each texel its closest palette entry
+    uint32_t indices[16];
+    auto     assign = [&](uint32_t &c0, uint32_t &c1)
+    {
+        if (three ? c0 > c1 : c0 < c1)
+            std::swap(c0, c1);
+        float e0[3], e1[3], palette[4][3];
+        unpack_565(c0, e0);
+        unpack_565(c1, e1);
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            palette[0][c] = e0[c];
+            palette[1][c] = e1[c];
+            palette[2][c] = three ? 0.5f * (e0[c] + e1[c]) : (2.f * e0[c] + e1[c]) / 3.f;
+            palette[3][c] = three ? 0.f : (e0[c] + 2.f * e1[c]) / 3.f;
+        }
+        // equal endpoints decode with the 3-color palette in BC1, where entry 3 is black
+        const uint32_t num_entries = (three || c0 == c1) ? 3 : 4;
+        float          total       = 0.f;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            if (transparent[i])
+            {
+                indices[i] = 3;
+                continue;
+            }
+            float best = std::numeric_limits<float>::max();
+            for (uint32_t k = 0; k < num_entries; ++k)
+            {
+                float err = 0.f;
+                for (uint32_t c = 0; c < 3; ++c) err += (palette[k][c] - px[i][c]) * (palette[k][c] - px[i][c]);
+                if (err < best)
+                {
+                    best       = err;
+                    indices[i] = k;
+                }
+            }
+            total += best;
+        }
+        return total;
+    };
+
+    // endpoints from the extent of the opaque texels along their principal axis
+    float mean[4], axis[4], lo = 0.f, hi = 0.f;
+    principal_axis(opaque, num_opaque, 3, mean, axis);
+    for (uint32_t i = 0; i < num_opaque; ++i)
+    {
+        float t = 0.f;
+        for (uint32_t c = 0; c < 3; ++c) t += (opaque[i][c] - mean[c]) * axis[c];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+    float e0[4], e1[4];
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        e0[c] = mean[c] + lo * axis[c];
+        e1[c] = mean[c] + hi * axis[c];
+    }
+
+    uint32_t best[18]; // indices, then the endpoints
+    uint32_t c0         = quantize(e0), c1 = quantize(e1);
+    float    best_error = assign(c0, c1);
+    auto     keep       = [&]
+    {
+        std::copy(indices, indices + 16, best);
+        best[16] = c0;
+        best[17] = c1;
+    };
+    keep();
+
+    // refine the endpoints by least squares on the current indices
+    static constexpr float weights4[4] = {0.f, 1.f, 1.f / 3.f, 2.f / 3.f}, weights3[4] = {0.f, 1.f, 0.5f, 0.f};
+    for (int it = 0; it < 2 && best_error > 0.f; ++it)
+    {
+        float t[16];
+        for (uint32_t i = 0; i < 16; ++i) t[i] = (three ? weights3 : weights4)[best[i]];
+        if (!fit_endpoints(px, t, transparent, 3, e0, e1))
+            break;
+        c0          = quantize(e0);
+        c1          = quantize(e1);
+        float error = assign(c0, c1);
+        if (error >= best_error)
+            break;
+        best_error = error;
+        keep();
+    }
+
+    block[0] = uint8_t(best[16]);
+    block[1] = uint8_t(best[16] >> 8);
+    block[2] = uint8_t(best[17]);
+    block[3] = uint8_t(best[17] >> 8);
+    uint32_t bits = 0;
+    for (uint32_t i = 0; i < 16; ++i) bits |= best[i] << (2 * i);
+    for (uint32_t b = 0; b < 4; ++b) block[4 + b] = uint8_t(bits >> (8 * b));
+}
+
+/// Compress 16 values (one channel) into a BC4 block, trying both the 8-value palette and the 6-value palette with
+/// exact extremes.
+inline void encode_bc4_values(const float values[16], bool is_signed, uint8_t block[8])
+{
+    const float lowest = is_signed ? -1.f : 0.f;
+    float       v[16];
+    for (uint32_t i = 0; i < 16; ++i) v[i] = clamp_texel(values[i], lowest, 1.f);
+
+    auto quantize = [&](float x)
+    { return is_signed ? uint8_t(int8_t(std::lround(x * 127.f))) : uint8_t(std::lround(x * 255.f)); };
+
+    float best_error    = std::numeric_limits<float>::max();
+    auto  try_endpoints = [&](uint8_t e0, uint8_t e1)
+    {
+        uint8_t candidate[8] = {e0, e1};
+        float   palette[8], total = 0.f;
+        bc4_palette(candidate, is_signed, palette);
+        uint64_t indices = 0;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t index = 0;
+            for (uint32_t k = 1; k < 8; ++k)
+                if (std::abs(palette[k] - v[i]) < std::abs(palette[index] - v[i]))
+                    index = k;
+            total += (palette[index] - v[i]) * (palette[index] - v[i]);
+            indices |= uint64_t(index) << (3 * i);
+        }
+        if (total >= best_error)
+            return;
+        best_error = total;
+        for (uint32_t b = 0; b < 6; ++b) candidate[2 + b] = uint8_t(indices >> (8 * b));
+        std::memcpy(block, candidate, 8);
+    };
+
+    // 8 values between the extremes (first endpoint greater), or 6 values between the extremes of the texels that the
+    // exact values at the ends of the range don't represent (first endpoint not greater)
+    float lo = 1.f, hi = lowest, inner_lo = 1.f, inner_hi = lowest;
+    for (float x : v)
+    {
+        lo = std::min(lo, x);
+        hi = std::max(hi, x);
+        if (x > lowest && x < 1.f)
+        {
+            inner_lo = std::min(inner_lo, x);
+            inner_hi = std::max(inner_hi, x);
+        }
+    }
+    try_endpoints(quantize(hi), quantize(lo));
+    if (inner_lo > inner_hi)
+        inner_lo = inner_hi = lowest;
+    try_endpoints(quantize(inner_lo), quantize(inner_hi));
+}
+
+} // namespace detail
+
+void encode_bc6h_block(const float rgba[64], uint8_t block[16])
+{
+    // BC6H interpolates the half-float bit patterns, so fit the endpoints in that (roughly logarithmic) domain
+    float px[16][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            px[i][c] = float(float_to_half(detail::clamp_texel(rgba[4 * i + c], 0.f, 65504.f)));
+
+    float mean[4], axis[4];
+    detail::principal_axis(px, 16, 3, mean, axis);
+    float lo = 0.f, hi = 0.f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = 0.f;
+        for (int c = 0; c < 3; ++c) t += (px[i][c] - mean[c]) * axis[c];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+
+    // Try each single-subset mode (10-bit endpoints, or a base with 11, 12 or 16 bits plus a delta) and keep the best
+    float best_error = std::numeric_limits<float>::max();
+    for (uint32_t id : {3u, 7u, 11u, 15u})
+    {
+        const detail::BC6HMode *mode = detail::find_bc6h_mode(id);
+        const uint32_t          epb  = mode->endpoint_bits;
+
+        // the decoder scales endpoints to about v << (16 - epb) and then by 31/64 to get half bits
+        int32_t ep[2][3];
+        for (int c = 0; c < 3; ++c)
+            for (int e = 0; e < 2; ++e)
+            {
+                float h  = std::min(std::max(mean[c] + (e ? hi : lo) * axis[c], 0.f), float(0x7BFF));
+                float v  = h * 64.f / 31.f / float(1u << (16 - epb));
+                ep[e][c] = std::min(int32_t(v + 0.5f), (1 << epb) - 1);
+            }
+
+        auto fit_deltas = [&]
+        {
+            if (!mode->transformed)
+                return;
+            for (int c = 0; c < 3; ++c)
+            {
+                int32_t range = 1 << (mode->delta_bits[c] - 1);
+                ep[1][c]      = ep[0][c] + std::min(std::max(ep[1][c] - ep[0][c], -range), range - 1);
+            }
+        };
+
+        float palette[16][3];
+        auto  build_palette = [&]
+        {
+            for (int k = 0; k < 16; ++k)
+                for (int c = 0; c < 3; ++c)
+                    palette[k][c] = float(detail::interpolate_bc6h(detail::unquantize_bc6h(ep[0][c], epb, false),
+                                                                   detail::unquantize_bc6h(ep[1][c], epb, false),
+                                                                   detail::bc_weights4[k], false));
+        };
+        auto closest = [&](int i, uint32_t num_indices, float &error)
+        {
+            uint32_t best = 0;
+            error         = std::numeric_limits<float>::max();
+            for (uint32_t k = 0; k < num_indices; ++k)
+            {
+                float err = 0.f;
+                for (int c = 0; c < 3; ++c) err += (palette[k][c] - px[i][c]) * (palette[k][c] - px[i][c]);
+                if (err < error)
+                {
+                    error = err;
+                    best  = k;
+                }
+            }
+            return best;
+        };
+
+        fit_deltas();
+        build_palette();
+        // the most significant index bit of the first texel is implicitly 0, so order the endpoints accordingly
+        float error;
+        if (closest(0, 16, error) >= 8)
+        {
+            std::swap(ep[0], ep[1]);
+            fit_deltas();
+            build_palette();
+        }
+
+        uint32_t indices[16];
+        float    total = 0.f;
+        for (int i = 0; i < 16; ++i)
+        {
+            indices[i] = closest(i, i == 0 ? 8 : 16, error);
+            total += error;
+        }
+        if (total >= best_error)
+            continue;
+        best_error = total;
+
+        int32_t f[13] = {};
+        for (int c = 0; c < 3; ++c)
+        {
+            f[detail::RW + c] = ep[0][c];
+            f[detail::RX + c] = mode->transformed ? (ep[1][c] - ep[0][c]) & ((1 << mode->delta_bits[c]) - 1) : ep[1][c];
+        }
+
+        std::memset(block, 0, 16);
+        uint32_t pos = 0;
+        auto     put = [&](uint32_t v, uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; ++i, ++pos) block[pos >> 3] |= uint8_t(((v >> i) & 1) << (pos & 7));
+        };
+        put(id, 5);
+        for (uint32_t s = 0; s < mode->num_segments; ++s)
+        {
+            const auto &seg  = mode->segments[s];
+            int         step = seg.a > seg.b ? 1 : -1;
+            for (int bit = seg.b;; bit += step)
+            {
+                put(uint32_t(f[seg.field] >> bit), 1);
+                if (bit == seg.a)
+                    break;
+            }
+        }
+        for (int i = 0; i < 16; ++i) put(indices[i], i == 0 ? 3 : 4);
+    }
+}
+
+void encode_bc1_block(const float rgba[64], uint8_t block[8], bool punch_through_alpha)
+{
+    detail::encode_bc1_colors(rgba, block, punch_through_alpha);
+}
+
+void encode_bc3_block(const float rgba[64], uint8_t block[16])
+{
+    float alpha[16];
+    for (uint32_t i = 0; i < 16; ++i) alpha[i] = rgba[4 * i + 3];
+    detail::encode_bc4_values(alpha, false, block);
+    detail::encode_bc1_colors(rgba, block + 8, false);
+}
+
+void encode_bc4_block(const float rgba[64], uint8_t block[8], bool is_signed)
+{
+    float red[16];
+    for (uint32_t i = 0; i < 16; ++i) red[i] = rgba[4 * i];
+    detail::encode_bc4_values(red, is_signed, block);
+}
+
+void encode_bc5_block(const float rgba[64], uint8_t block[16], bool is_signed)
+{
+    float red[16], green[16];
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        red[i]   = rgba[4 * i];
+        green[i] = rgba[4 * i + 1];
+    }
+    detail::encode_bc4_values(red, is_signed, block);
+    detail::encode_bc4_values(green, is_signed, block + 8);
+}
+
+void encode_bc7_block(const float rgba[64], uint8_t block[16])
+{
+    float px[16][4];
+    bool  opaque = true;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        for (uint32_t c = 0; c < 4; ++c) px[i][c] = detail::clamp_texel(rgba[4 * i + c], 0.f, 1.f) * 255.f;
+        opaque &= px[i][3] >= 254.5f;
+    }
+
+    float mean[4], axis[4], lo = 0.f, hi = 0.f;
+    detail::principal_axis(px, 16, 4, mean, axis);
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        float t = 0.f;
+        for (uint32_t c = 0; c < 4; ++c) t += (px[i][c] - mean[c]) * axis[c];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+    float fit[2][4];
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        fit[0][c] = mean[c] + lo * axis[c];
+        fit[1][c] = mean[c] + hi * axis[c];
+    }
+
+    // Mode 6 endpoints are 7 bits per channel plus a p-bit shared by the channels of the endpoint, which acts as the
+    // lowest bit of the 8-bit value. Opaque blocks need both p-bits set and alpha endpoints of 127 to decode to an
+    // alpha of exactly 255.
+    struct Candidate
+    {
+        int32_t  ep[2][4];
+        uint32_t pbits[2];
+        uint32_t indices[16];
+        float    error;
+    };
+    auto evaluate = [&](const float e[2][4], uint32_t p0, uint32_t p1, Candidate &out)
+    {
+        out.pbits[0] = p0;
+        out.pbits[1] = p1;
+        for (uint32_t n = 0; n < 2; ++n)
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                float q      = std::floor((e[n][c] - float(out.pbits[n])) / 2.f + 0.5f);
+                out.ep[n][c] = c == 3 && opaque ? 127 : std::min(std::max(int32_t(q), 0), 127);
+            }
+        int32_t palette[16][4];
+        for (uint32_t k = 0; k < 16; ++k)
+            for (uint32_t c = 0; c < 4; ++c)
+                palette[k][c] = detail::interpolate_bc7((out.ep[0][c] << 1) | int32_t(p0),
+                                                        (out.ep[1][c] << 1) | int32_t(p1), k, 4);
+        out.error = 0.f;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            float best = std::numeric_limits<float>::max();
+            for (uint32_t k = 0; k < 16; ++k)
+            {
+                float err = 0.f;
+                for (uint32_t c = 0; c < 4; ++c)
+                    err += (float(palette[k][c]) - px[i][c]) * (float(palette[k][c]) - px[i][c]);
+                if (err < best)
+                {
+                    best           = err;
+                    out.indices[i] = k;
+                }
+            }
+            out.error += best;
+        }
+    };
+
+    // try every combination of p-bits (only both set for opaque blocks), each refined once by least squares on its
+    // indices
+    Candidate best, candidate;
+    best.error = std::numeric_limits<float>::max();
+    for (uint32_t p = opaque ? 3 : 0; p < 4; ++p)
+    {
+        evaluate(fit, p & 1, p >> 1, candidate);
+        if (candidate.error < best.error)
+            best = candidate;
+
+        float t[16], refined[2][4];
+        for (uint32_t i = 0; i < 16; ++i) t[i] = float(detail::bc_weights4[candidate.indices[i]]) / 64.f;
+        if (candidate.error > 0.f && detail::fit_endpoints(px, t, nullptr, 4, refined[0], refined[1]))
+        {
+            evaluate(refined, p & 1, p >> 1, candidate);
+            if (candidate.error < best.error)
+                best = candidate;
+        }
+    }
+
+    // Mode 5 has 7-bit color and 8-bit alpha endpoints with separate 2-bit indices for each, so color and alpha that
+    // vary independently (e.g. a mask over a texture) don't have to share a line through RGBA space. Channels
+    // [first, last) are fitted at a time: the colors, then alpha.
+    struct Separate
+    {
+        int32_t  ep[2][4];
+        uint32_t indices[2][16]; ///< Color, then alpha
+    };
+    auto evaluate_separate = [&](const float e[2][4], uint32_t first, uint32_t last, Separate &out)
+    {
+        const uint32_t set    = first == 3;
+        auto           expand = [](uint32_t c, int32_t v) { return c < 3 ? (v << 1) | (v >> 6) : v; };
+        for (uint32_t n = 0; n < 2; ++n)
+            for (uint32_t c = first; c < last; ++c)
+            {
+                float q      = std::floor((c < 3 ? e[n][c] * 127.f / 255.f : e[n][c]) + 0.5f);
+                out.ep[n][c] = std::min(std::max(int32_t(q), 0), c < 3 ? 127 : 255);
+            }
+        int32_t palette[4][4];
+        for (uint32_t k = 0; k < 4; ++k)
+            for (uint32_t c = first; c < last; ++c)
+                palette[k][c] = detail::interpolate_bc7(expand(c, out.ep[0][c]), expand(c, out.ep[1][c]), k, 2);
+        float error = 0.f;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            float lowest = std::numeric_limits<float>::max();
+            for (uint32_t k = 0; k < 4; ++k)
+            {
+                float err = 0.f;
+                for (uint32_t c = first; c < last; ++c)
+                    err += (float(palette[k][c]) - px[i][c]) * (float(palette[k][c]) - px[i][c]);
+                if (err < lowest)
+                {
+                    lowest              = err;
+                    out.indices[set][i] = k;
+                }
+            }
+            error += lowest;
+        }
+        return error;
+    };
+
+    // the colors span their own principal axis and alpha its range
+    float separate_fit[2][4] = {{0.f, 0.f, 0.f, 255.f}, {0.f, 0.f, 0.f, 0.f}};
+    detail::principal_axis(px, 16, 3, mean, axis);
+    lo = hi = 0.f;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        float t = 0.f;
+        for (uint32_t c = 0; c < 3; ++c) t += (px[i][c] - mean[c]) * axis[c];
+        lo                 = std::min(lo, t);
+        hi                 = std::max(hi, t);
+        separate_fit[0][3] = std::min(separate_fit[0][3], px[i][3]);
+        separate_fit[1][3] = std::max(separate_fit[1][3], px[i][3]);
+    }
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        separate_fit[0][c] = mean[c] + lo * axis[c];
+        separate_fit[1][c] = mean[c] + hi * axis[c];
+    }
+    Separate separate, refined_separate;
+    float    separate_error = 0.f;
+    for (uint32_t first = 0; first < 4; first += 3)
+    {
+        const uint32_t last = first == 0 ? 3 : 4, set = first == 3;
+        float          error = evaluate_separate(separate_fit, first, last, separate);
+
+        float t[16], refined[2][4];
+        for (uint32_t i = 0; i < 16; ++i) t[i] = float(detail::bc_weights2[separate.indices[set][i]]) / 64.f;
+        refined_separate = separate;
+        if (error > 0.f && detail::fit_endpoints(px, t, nullptr, 4, refined[0], refined[1]))
+        {
+            float refined_error = evaluate_separate(refined, first, last, refined_separate);
+            if (refined_error < error)
+            {
+                separate = refined_separate;
+                error    = refined_error;
+            }
+        }
+        separate_error += error;
+    }
+
+    std::memset(block, 0, 16);
+    uint32_t pos = 0;
+    auto     put = [&](uint32_t v, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count; ++i, ++pos) block[pos >> 3] |= uint8_t(((v >> i) & 1) << (pos & 7));
+    };
+
+    if (separate_error < best.error)
+    {
+        // as in mode 6 below, but for the color and the alpha indices separately
+        for (uint32_t set = 0; set < 2; ++set)
+        {
+            if (separate.indices[set][0] < 2)
+                continue;
+            for (uint32_t c = set ? 3 : 0; c < (set ? 4u : 3u); ++c) std::swap(separate.ep[0][c], separate.ep[1][c]);
+            for (auto &index : separate.indices[set]) index = 3 - index;
+        }
+        put(1u << 5, 6);
+        put(0, 2); // no channel rotation
+        for (uint32_t c = 0; c < 4; ++c)
+            for (uint32_t n = 0; n < 2; ++n) put(uint32_t(separate.ep[n][c]), c < 3 ? 7 : 8);
+        for (uint32_t set = 0; set < 2; ++set)
+            for (uint32_t i = 0; i < 16; ++i) put(separate.indices[set][i], i == 0 ? 1 : 2);
+        return;
+    }
+
+    // the most significant index bit of texel 0 is implicitly 0; the weights are symmetric, so swapping the endpoints
+    // and inverting the indices decodes to the same texels
+    if (best.indices[0] >= 8)
+    {
+        std::swap(best.ep[0], best.ep[1]);
+        std::swap(best.pbits[0], best.pbits[1]);
+        for (auto &index : best.indices) index = 15 - index;
+    }
+
+    put(1u << 6, 7);
+    for (uint32_t c = 0; c < 4; ++c)
+        for (uint32_t n = 0; n < 2; ++n) put(uint32_t(best.ep[n][c]), 7);
+    put(best.pbits[0], 1);
+    put(best.pbits[1], 1);
+    for (uint32_t i = 0; i < 16; ++i) put(best.indices[i], i == 0 ? 3 : 4);
+}
+
+bool encode_bc_block(DDSFile::DXGIFormat format, const float rgba[64], uint8_t *block)
+{
+    switch (format)
+    {
+    case DDSFile::BC1_Typeless:
+    case DDSFile::BC1_UNorm:
+    case DDSFile::BC1_UNorm_SRGB: encode_bc1_block(rgba, block, true); return true;
+    case DDSFile::BC3_Typeless:
+    case DDSFile::BC3_UNorm:
+    case DDSFile::BC3_UNorm_SRGB: encode_bc3_block(rgba, block); return true;
+    case DDSFile::BC4_Typeless:
+    case DDSFile::BC4_UNorm:
+    case DDSFile::BC4_SNorm: encode_bc4_block(rgba, block, format == DDSFile::BC4_SNorm); return true;
+    case DDSFile::BC5_Typeless:
+    case DDSFile::BC5_UNorm:
+    case DDSFile::BC5_SNorm: encode_bc5_block(rgba, block, format == DDSFile::BC5_SNorm); return true;
+    case DDSFile::BC6H_UF16: encode_bc6h_block(rgba, block); return true;
+    case DDSFile::BC7_Typeless:
+    case DDSFile::BC7_UNorm:
+    case DDSFile::BC7_UNorm_SRGB: encode_bc7_block(rgba, block); return true;
+    default: return false;
+    }
+}
+
+namespace detail
+{
+
+// The quantizers below clamp after scaling and select NaNs away after converting: with GCC's default -ftrapping-math,
+// a float-to-int conversion of a clamped value keeps their loops from vectorizing.
+
+/// Clamp `v` to [0,max] (NaN to 0) and round to nearest
+inline uint32_t quantize_uint(float v, float max)
+{
+    v += 0.5f;
+    v = v > 0.f ? v : 0.f;
+    return uint32_t(int32_t(v < max ? v : max));
+}
+
+/// Clamp `v` to [0,1] (NaN to 0), scale it by `max` and round to nearest
+inline uint32_t quantize_unorm(float v, float max) { return quantize_uint(v * max, max); }
+
+/// Clamp `v` to [-1,1] (NaN to 0), scale it by `max` and round to nearest, halfway cases away from zero
+inline int32_t quantize_snorm(float v, float max)
+{
+    float w = v * max;
+    w += std::copysign(0.5f, w);
+    w         = w > -max ? w : -max;
+    int32_t r = int32_t(w < max ? w : max);
+    return v == v ? r : 0;
+}
+
+/// Saturate `v` to the range of integer type T (NaN to 0) and round to nearest, halfway cases away from zero. 32-bit
+/// types go through double, which holds their limits exactly, and UInt32 needs a 64-bit conversion (so it doesn't
+/// vectorize without AVX-512).
+template <typename T>
+inline T quantize_int(float v)
+{
+    using Wide        = typename std::conditional<sizeof(T) < 4, float, double>::type;
+    using Int         = typename std::conditional<std::is_same<T, uint32_t>::value, int64_t, int32_t>::type;
+    constexpr Wide lo = Wide(std::numeric_limits<T>::min());
+    constexpr Wide hi = Wide(std::numeric_limits<T>::max());
+    Wide           w  = Wide(v) + std::copysign(Wide(0.5), Wide(v));
+    w                 = w > lo ? w : lo;
+    Int r             = Int(w < hi ? w : hi);
+    return T(v == v ? r : 0);
+}
+
+/// Branch-free rounding of the bits of a non-negative float (or NaN) to nearest even in a float with 5 exponent bits
+/// (bias 15) and M mantissa bits: the half-float layout for M = 10, and those of R11G11B10_Float for M = 6 and 5.
+/// Too large values become infinity, and NaNs stay NaNs.
+template <uint32_t M>
+inline uint32_t round_to_small_float(uint32_t bits)
+{
+    constexpr uint32_t shift = 23 - M;
+    constexpr uint32_t inf   = 0x1Fu << M;
+
+    // Normal results: rebias the exponent and round the mantissa; a carry correctly bumps the exponent
+    uint32_t normal = (bits - (112u << 23) + (1u << (shift - 1)) - 1 + ((bits >> shift) & 1)) >> shift;
+    normal          = std::min(normal, inf);
+
+    // Denormal results: adding a power of two whose ulp is the smallest denormal makes the FPU do the rounding
+    constexpr uint32_t magic_bits = (127 - 15 + shift + 1) << 23;
+    float              f, magic;
+    std::memcpy(&f, &bits, sizeof(f));
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    f += magic;
+    uint32_t denormal;
+    std::memcpy(&denormal, &f, sizeof(denormal));
+    denormal -= magic_bits;
+
+    uint32_t nan         = inf | (1u << (M - 1)) | ((bits & 0x7FFFFF) >> shift);
+    uint32_t is_denormal = 0u - uint32_t(bits < (113u << 23)); // all ones below 2^-14
+    uint32_t is_nan      = 0u - uint32_t(bits > 0x7F800000u);
+    uint32_t result      = (normal & ~is_denormal) | (denormal & is_denormal);
+    return (result & ~is_nan) | (nan & is_nan);
+}
+
+/// Branch-free version of float_to_half(), with identical results, that compilers can vectorize
+inline uint16_t float_to_half_branchless(float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return uint16_t(((bits >> 16) & 0x8000) | round_to_small_float<10>(bits & 0x7FFFFFFF));
+}
+
+/// Convert a float to the unsigned 11-bit (M = 6) or 10-bit (M = 5) floats of R11G11B10_Float: negative values
+/// become 0 and finite values that are too large the largest finite value
+template <uint32_t M>
+inline uint32_t float_to_unsigned_small_float(float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    uint32_t result    = round_to_small_float<M>(magnitude);
+    uint32_t finite    = 0u - uint32_t(magnitude < 0x7F800000u);
+    uint32_t negative  = 0u - uint32_t(bits > 0x80000000u && magnitude <= 0x7F800000u); // but not NaN
+    result             = (std::min(result, (0x1Fu << M) - 1) & finite) | (result & ~finite);
+    return result & ~negative;
+}
+
+/// Encode an RGB triple with a shared exponent (R9G9B9E5_SHAREDEXP)
+inline uint32_t float_to_rgb9e5(const float *rgb)
+{
+    constexpr float max9 = 65408.f;             // 511/512 * 2^16, the largest value
+    constexpr float min9 = 1.f / 65536.f;       // 2^-16, the smallest maximum channel with a 0 shared exponent
+    float           c[3];
+    for (int i = 0; i < 3; ++i) c[i] = rgb[i] > 0.f ? std::min(rgb[i], max9) : 0.f;
+
+    // Round the largest channel to 9 mantissa bits first, since that may bump the exponent
+    float    largest = std::max(std::max(c[0], c[1]), std::max(c[2], min9));
+    uint32_t bits;
+    std::memcpy(&bits, &largest, sizeof(bits));
+    uint32_t exponent = (bits + 0x4000) >> 23;
+
+    // 2^(24 - shared exponent), scaling the largest channel to [256,512)
+    uint32_t scale_bits = (262u - exponent) << 23;
+    float    scale;
+    std::memcpy(&scale, &scale_bits, sizeof(scale));
+    return uint32_t(c[0] * scale + 0.5f) | uint32_t(c[1] * scale + 0.5f) << 9 | uint32_t(c[2] * scale + 0.5f) << 18 |
+           (exponent - 111) << 27;
+}
+
+/// Quantize N channels of each RGBA texel, starting at channel First and with R and B swapped if SwapRB, with
+/// `quantize` to values of type T
+template <uint32_t N, uint32_t First, bool SwapRB, typename T, typename Quantize>
+inline void quantize_channels(const float *rgba, size_t count, uint8_t *dst, Quantize quantize)
+{
+    for (size_t i = 0; i < count; ++i, rgba += 4, dst += N * sizeof(T))
+        for (uint32_t c = 0; c < N; ++c)
+        {
+            T v = quantize(rgba[SwapRB && (c == 0 || c == 2) ? 2 - c : First + c]);
+            std::memcpy(dst + c * sizeof(T), &v, sizeof(T));
+        }
+}
+
+/// Pack each RGBA texel into a value of type T with `pack`
+template <typename T, typename Pack>
+inline void pack_texels(const float *rgba, size_t count, uint8_t *dst, Pack pack)
+{
+    for (size_t i = 0; i < count; ++i, rgba += 4, dst += sizeof(T))
+    {
+        T v = T(pack(rgba));
+        std::memcpy(dst, &v, sizeof(T));
+    }
+}
+
+/// Store a float and 8 bits of stencil in the 64-bit depth/stencil layout (R32G8X24)
+inline void store_depth32_stencil8(float depth, uint32_t stencil, uint8_t *dst)
+{
+    std::memcpy(dst, &depth, 4);
+    std::memcpy(dst + 4, &stencil, 4);
+}
+
+} // namespace detail
+
+bool quantize_rgba(const float *rgba, size_t count, DDSFile::DXGIFormat format, uint8_t *dst)
+{
+    using detail::quantize_unorm;
+    using detail::quantize_uint;
+    using DDS = DDSFile;
+
+    switch (format)
+    {
+    case DDS::R11G11B10_Float:
+        detail::pack_texels<uint32_t>(rgba, count, dst,
+                                      [](const float *p)
+                                      {
+                                          return detail::float_to_unsigned_small_float<6>(p[0]) |
+                                                 detail::float_to_unsigned_small_float<6>(p[1]) << 11 |
+                                                 detail::float_to_unsigned_small_float<5>(p[2]) << 22;
+                                      });
+        return true;
+    case DDS::R9G9B9E5_SHAREDEXP: detail::pack_texels<uint32_t>(rgba, count, dst, detail::float_to_rgb9e5); return true;
+    case DDS::R10G10B10A2_Typeless:
+    case DDS::R10G10B10A2_UNorm:
+        detail::pack_texels<uint32_t>(rgba, count, dst,
+                                      [](const float *p)
+                                      {
+                                          return quantize_unorm(p[0], 1023.f) | quantize_unorm(p[1], 1023.f) << 10 |
+                                                 quantize_unorm(p[2], 1023.f) << 20 | quantize_unorm(p[3], 3.f) << 30;
+                                      });
+        return true;
+    case DDS::R10G10B10A2_UInt:
+        detail::pack_texels<uint32_t>(rgba, count, dst,
+                                      [](const float *p)
+                                      {
+                                          return quantize_uint(p[0], 1023.f) | quantize_uint(p[1], 1023.f) << 10 |
+                                                 quantize_uint(p[2], 1023.f) << 20 | quantize_uint(p[3], 3.f) << 30;
+                                      });
+        return true;
+    case DDS::R10G10B10_XR_BIAS_A2_UNorm:
+        detail::pack_texels<uint32_t>(rgba, count, dst,
+                                      [](const float *p)
+                                      {
+                                          auto xr = [](float v)
+                                          {
+                                              uint32_t bits = quantize_uint(v * 510.f + 384.f, 1023.f);
+                                              return v == v ? bits : 384u; // NaN to 0
+                                          };
+                                          return xr(p[0]) | xr(p[1]) << 10 | xr(p[2]) << 20 |
+                                                 quantize_unorm(p[3], 3.f) << 30;
+                                      });
+        return true;
+    case DDS::B5G6R5_UNorm:
+        detail::pack_texels<uint16_t>(rgba, count, dst,
+                                      [](const float *p)
+                                      {
+                                          return quantize_unorm(p[0], 31.f) << 11 | quantize_unorm(p[1], 63.f) << 5 |
+                                                 quantize_unorm(p[2], 31.f);
+                                      });
+        return true;
+    case DDS::B5G5R5A1_UNorm:
+        detail::pack_texels<uint16_t>(rgba, count, dst,
+                                      [](const float *p)
+                                      {
+                                          return quantize_unorm(p[0], 31.f) << 10 | quantize_unorm(p[1], 31.f) << 5 |
+                                                 quantize_unorm(p[2], 31.f) | quantize_unorm(p[3], 1.f) << 15;
+                                      });
+        return true;
+    case DDS::B4G4R4A4_UNorm:
+        detail::pack_texels<uint16_t>(rgba, count, dst,
+                                      [](const float *p)
+                                      {
+                                          return quantize_unorm(p[0], 15.f) << 8 | quantize_unorm(p[1], 15.f) << 4 |
+                                                 quantize_unorm(p[2], 15.f) | quantize_unorm(p[3], 15.f) << 12;
+                                      });
+        return true;
+    case DDS::A4B4G4R4_UNorm:
+        detail::pack_texels<uint16_t>(rgba, count, dst,
+                                      [](const float *p)
+                                      {
+                                          return quantize_unorm(p[0], 15.f) << 12 | quantize_unorm(p[1], 15.f) << 8 |
+                                                 quantize_unorm(p[2], 15.f) << 4 | quantize_unorm(p[3], 15.f);
+                                      });
+        return true;
+    case DDS::R24G8_Typeless:
+    case DDS::D24_UNorm_S8_UInt:
+        detail::pack_texels<uint32_t>(rgba, count, dst, [](const float *p)
+                                      { return quantize_unorm(p[0], 16777215.f) | quantize_uint(p[1], 255.f) << 24; });
+        return true;
+    case DDS::R24_UNorm_X8_Typeless:
+        detail::pack_texels<uint32_t>(rgba, count, dst,
+                                      [](const float *p) { return quantize_unorm(p[0], 16777215.f); });
+        return true;
+    case DDS::X24_Typeless_G8_UInt:
+        detail::pack_texels<uint32_t>(rgba, count, dst,
+                                      [](const float *p) { return quantize_uint(p[1], 255.f) << 24; });
+        return true;
+    case DDS::R32G8X24_Typeless:
+    case DDS::D32_Float_S8X24_UInt:
+    case DDS::R32_Float_X8X24_Typeless:
+    case DDS::X32_Typeless_G8X24_UInt:
+        for (size_t i = 0; i < count; ++i, rgba += 4, dst += 8)
+            detail::store_depth32_stencil8(format == DDS::X32_Typeless_G8X24_UInt ? 0.f : rgba[0],
+                                           format == DDS::R32_Float_X8X24_Typeless ? 0u : quantize_uint(rgba[1], 255.f),
+                                           dst);
+        return true;
+    default: break;
+    }
+
+    // Typed formats
+    using DataType  = DDS::DataType;
+    const auto type = DDS::data_type(format);
+    const int  size = int(DDS::data_type_size(type));
+    const int  bpp  = DDS::bits_per_pixel(format);
+    if (DDS::is_compressed(format) || size == 0 || bpp <= 0 || bpp % (8 * size) != 0 || bpp / (8 * size) > 4)
+        return false;
+    const uint32_t channels = uint32_t(bpp / (8 * size));
+    const bool     bgr      = format >= DDS::B8G8R8A8_UNorm && format <= DDS::B8G8R8X8_UNorm_SRGB; // XR_BIAS is above
+
+    auto store = [=](auto tag, auto quantize)
+    {
+        using T = decltype(tag);
+        if (format == DDS::A8_UNorm)
+            detail::quantize_channels<1, 3, false, T>(rgba, count, dst, quantize);
+        else if (bgr)
+        {
+            detail::quantize_channels<4, 0, true, T>(rgba, count, dst, quantize);
+            if (format == DDS::B8G8R8X8_UNorm || format == DDS::B8G8R8X8_Typeless || format == DDS::B8G8R8X8_UNorm_SRGB)
+                for (size_t i = 0; i < count; ++i) dst[4 * i + 3] = uint8_t(quantize(1.f));
+        }
+        else if (channels == 1)
+            detail::quantize_channels<1, 0, false, T>(rgba, count, dst, quantize);
+        else if (channels == 2)
+            detail::quantize_channels<2, 0, false, T>(rgba, count, dst, quantize);
+        else if (channels == 3)
+            detail::quantize_channels<3, 0, false, T>(rgba, count, dst, quantize);
+        else
+            detail::quantize_channels<4, 0, false, T>(rgba, count, dst, quantize);
+        return true;
+    };
+
+    switch (type)
+    {
+    case DataType::UNorm8: return store(uint8_t(), [](float v) { return uint8_t(quantize_unorm(v, 255.f)); });
+    case DataType::SNorm8: return store(int8_t(), [](float v) { return int8_t(detail::quantize_snorm(v, 127.f)); });
+    case DataType::UNorm16: return store(uint16_t(), [](float v) { return uint16_t(quantize_unorm(v, 65535.f)); });
+    case DataType::SNorm16:
+        return store(int16_t(), [](float v) { return int16_t(detail::quantize_snorm(v, 32767.f)); });
+    case DataType::Float16: return store(uint16_t(), detail::float_to_half_branchless);
+    case DataType::Float32: return store(float(), [](float v) { return v; });
+    case DataType::Typeless8:
+    case DataType::UInt8: return store(uint8_t(), detail::quantize_int<uint8_t>);
+    case DataType::SInt8: return store(int8_t(), detail::quantize_int<int8_t>);
+    case DataType::Typeless16:
+    case DataType::UInt16: return store(uint16_t(), detail::quantize_int<uint16_t>);
+    case DataType::SInt16: return store(int16_t(), detail::quantize_int<int16_t>);
+    case DataType::Typeless32:
+    case DataType::UInt32: return store(uint32_t(), detail::quantize_int<uint32_t>);
+    case DataType::SInt32: return store(int32_t(), detail::quantize_int<int32_t>);
+    default: return false;
+    }
+}
+
+bool quantize_rgba(const uint16_t *rgba, size_t count, DDSFile::DXGIFormat format, uint8_t *dst)
+{
+    if (format == DDSFile::R16G16B16A16_Float)
+    {
+        std::memcpy(dst, rgba, 8 * count);
+        return true;
+    }
+
+    // Widen chunks of texels on the stack
+    constexpr size_t chunk = 256;
+    float            buffer[4 * chunk];
+    const size_t     texel_bytes = size_t(std::max(DDSFile::bits_per_pixel(format), 0)) / 8;
+    size_t           i           = 0;
+    do // at least once, so that unsupported formats fail even without texels
+    {
+        size_t n = std::min(chunk, count - i);
+        for (size_t j = 0; j < 4 * n; ++j) buffer[j] = detail::half_to_float_branchless(rgba[4 * i + j]);
+        if (!quantize_rgba(buffer, n, format, dst + i * texel_bytes))
+            return false;
+    } while ((i += chunk) < count);
+    return true;
+}
+
 } // namespace smalldds
 
 #endif // !SMALLDDS_IMPLEMENTATION
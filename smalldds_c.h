@@ -0,0 +1,370 @@
+//
+// smalldds_c - A stable C interface to smalldds, for use from C and through FFI (Python, Rust, ...).
+//
+// Copyright (c) 2025 Wojciech Jarosz. Distributed under the
+// Apache 2.0 License (https://opensource.org/license/apache-2-0)
+//
+
+/** @file smalldds_c.h
+
+    The declarations are plain C. The implementation is C++ and is compiled into exactly one C++ translation unit:
+    @code
+    #define SMALLDDS_IMPLEMENTATION
+    #include "smalldds_c.h"
+    @endcode
+
+    All pointers returned by this interface reference buffers owned by the library, so foreign code can wrap them
+    without copying (e.g. with the Python buffer protocol or a Rust slice). Pixel data returned by
+    smalldds_get_image() stays valid until the file is closed or reloaded; buffers returned by smalldds_decode_alloc()
+    stay valid until they are passed to smalldds_free_buffer().
+
+    Usage example:
+    @code
+    smalldds_file *file = smalldds_create();
+    if (smalldds_open(file, "texture.dds") == SMALLDDS_ERROR || smalldds_load(file) == SMALLDDS_ERROR)
+        fprintf(stderr, "%s\n", smalldds_message(file));
+
+    smalldds_image image;
+    if (smalldds_get_image(file, 0, 0, &image) == SMALLDDS_SUCCESS)
+        upload(image.data, image.size, image.row_pitch);
+
+    smalldds_close(file);
+    @endcode
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// Bumped whenever the interface changes in an incompatible way
+#define SMALLDDS_C_API_VERSION 1
+
+/// Result codes; these match smalldds::Result::Type
+typedef enum smalldds_result
+{
+    SMALLDDS_SUCCESS = 0,
+    SMALLDDS_INFO    = 1,
+    SMALLDDS_WARNING = 2,
+    SMALLDDS_ERROR   = 3
+} smalldds_result;
+
+/// Opaque handle to a DDS file
+typedef struct smalldds_file smalldds_file;
+
+/// Header information of a DDS file
+typedef struct smalldds_info
+{
+    uint32_t width, height, depth;
+    uint32_t mip_count;
+    uint32_t array_size; ///< Number of array slices; each cube of a cubemap counts as 6 slices
+    uint32_t format;     ///< DXGI format, see smalldds::DDSFile::DXGIFormat
+    uint32_t dimension;  ///< 2 for 1D, 3 for 2D (including cubemaps) and 4 for 3D textures
+    uint32_t block_width, block_height;
+    uint32_t bits_per_pixel; ///< 0 if unknown
+    int32_t  is_cubemap;
+    int32_t  is_compressed;
+    int32_t  is_srgb;
+} smalldds_info;
+
+/// One subresource (mip level of an array slice); `data` points into library-owned memory
+typedef struct smalldds_image
+{
+    const uint8_t *data;
+    size_t         size;        ///< Size in bytes of all depth slices
+    size_t         row_pitch;   ///< Bytes per row of pixels (or of blocks, for block-compressed formats)
+    size_t         slice_pitch; ///< Bytes per depth slice
+    uint32_t       width, height, depth;
+} smalldds_image;
+
+/// Return SMALLDDS_C_API_VERSION of the compiled library
+uint32_t smalldds_api_version(void);
+
+/// Create an empty file handle, or return NULL if out of memory
+smalldds_file *smalldds_create(void);
+/// Destroy a file handle and release its pixel data; NULL is ignored
+void smalldds_close(smalldds_file *file);
+
+/// Read a DDS file from disk and parse its header
+smalldds_result smalldds_open(smalldds_file *file, const char *path);
+/// Copy a DDS file from memory and parse its header
+smalldds_result smalldds_open_memory(smalldds_file *file, const void *data, size_t size);
+/// Query the header information of an opened file
+smalldds_result smalldds_probe(const smalldds_file *file, smalldds_info *info);
+/// Locate the pixel data of all subresources; required before smalldds_get_image() and decoding
+smalldds_result smalldds_load(smalldds_file *file);
+
+/// The messages (errors, warnings and info) of the calling thread's most recent call on `file`. Calls on a const
+/// handle keep their messages per thread, so they can run concurrently; the string is valid until the thread's next
+/// call on `file`.
+const char *smalldds_message(const smalldds_file *file);
+/// Name of a DXGI format, or "Unknown"
+const char *smalldds_format_name(uint32_t format);
+
+/// Zero-copy access to a subresource; `array` counts cube faces for cubemaps
+smalldds_result smalldds_get_image(const smalldds_file *file, uint32_t mip, uint32_t array, smalldds_image *image);
+
+/// Number of floats that decoding a subresource to RGBA produces (4 * width * height * depth), or 0 if it doesn't exist
+size_t smalldds_decoded_size(const smalldds_file *file, uint32_t mip, uint32_t array);
+/// Decode a subresource to 32-bit float RGBA into a caller-owned buffer with room for `capacity` floats
+smalldds_result smalldds_decode(const smalldds_file *file, uint32_t mip, uint32_t array, float *dst, size_t capacity);
+/// Decode a subresource to 32-bit float RGBA into a library-owned buffer, or return NULL on error.
+/// `count` receives the number of floats. Release the buffer with smalldds_free_buffer().
+float *smalldds_decode_alloc(smalldds_file *file, uint32_t mip, uint32_t array, size_t *count);
+/// Release a buffer returned by smalldds_decode_alloc(); NULL is ignored
+void smalldds_free_buffer(float *buffer);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#if defined(__cplusplus) && defined(SMALLDDS_IMPLEMENTATION)
+
+#include "smalldds.h"
+
+#include <atomic>
+#include <new>
+
+namespace smalldds
+{
+namespace detail
+{
+/// Number of C handles created so far; gives each handle an id that is never reused
+inline std::atomic<uint64_t> c_handle_count{0};
+} // namespace detail
+} // namespace smalldds
+
+struct smalldds_file
+{
+    smalldds::DDSFile dds;
+    std::string       message; ///< Messages of the most recent call that modified the handle
+    bool              opened = false;
+    const uint64_t    id     = ++smalldds::detail::c_handle_count;
+};
+
+namespace smalldds
+{
+namespace detail
+{
+
+/// Messages of the most recent call of this thread, and the id of the handle it was made on
+struct CMessage
+{
+    uint64_t    id = 0;
+    std::string text;
+};
+
+inline CMessage &thread_c_message()
+{
+    static thread_local CMessage message;
+    return message;
+}
+
+/// Record the messages of a call; only calls with a mutable handle also store them in the handle
+inline void keep_c_message(smalldds_file *file, const Result &result) { file->message = result.message; }
+inline void keep_c_message(const smalldds_file *, const Result &) {}
+
+template <typename File> smalldds_result finish_c_call(File *file, const Result &result)
+{
+    auto &message = thread_c_message();
+    message.id    = file->id;
+    message.text  = result.message;
+    keep_c_message(file, result);
+    return smalldds_result(result.type);
+}
+
+/// Run `fn`, converting exceptions into errors so they never cross the C boundary
+template <typename File, typename Fn> smalldds_result guard_c_call(File *file, Fn &&fn)
+{
+    if (!file)
+        return SMALLDDS_ERROR;
+    try
+    {
+        return finish_c_call(file, fn());
+    }
+    catch (const std::bad_alloc &)
+    {
+        return finish_c_call(file, Result{Result::Error, "DDS: Out of memory."});
+    }
+    catch (const std::exception &e)
+    {
+        return finish_c_call(file, Result{Result::Error, std::string("DDS: ") + e.what()});
+    }
+}
+
+inline Result require_opened(const smalldds_file *file)
+{
+    if (!file->opened)
+        return Result{Result::Error, "DDS: No file has been opened."};
+    return Result{Result::Success};
+}
+
+} // namespace detail
+} // namespace smalldds
+
+extern "C"
+{
+
+uint32_t smalldds_api_version(void) { return SMALLDDS_C_API_VERSION; }
+
+smalldds_file *smalldds_create(void) { return new (std::nothrow) smalldds_file; }
+
+void smalldds_close(smalldds_file *file) { delete file; }
+
+smalldds_result smalldds_open(smalldds_file *file, const char *path)
+{
+    return smalldds::detail::guard_c_call(file,
+                                          [&]
+                                          {
+                                              file->dds    = smalldds::DDSFile{};
+                                              auto res     = file->dds.load(path);
+                                              file->opened = res.type != smalldds::Result::Error;
+                                              return res;
+                                          });
+}
+
+smalldds_result smalldds_open_memory(smalldds_file *file, const void *data, size_t size)
+{
+    return smalldds::detail::guard_c_call(file,
+                                          [&]
+                                          {
+                                              file->dds    = smalldds::DDSFile{};
+                                              auto res     = file->dds.load(static_cast<const uint8_t *>(data), size);
+                                              file->opened = res.type != smalldds::Result::Error;
+                                              return res;
+                                          });
+}
+
+smalldds_result smalldds_probe(const smalldds_file *file, smalldds_info *info)
+{
+    return smalldds::detail::guard_c_call(file,
+                                          [&]
+                                          {
+                                              if (!info)
+                                                  return smalldds::Result{smalldds::Result::Error,
+                                                                          "DDS: info must not be NULL."};
+                                              auto res = smalldds::detail::require_opened(file);
+                                              if (res.type == smalldds::Result::Error)
+                                                  return res;
+
+                                              const auto &dds      = file->dds;
+                                              info->width          = dds.width();
+                                              info->height         = dds.height();
+                                              info->depth          = dds.depth();
+                                              info->mip_count      = dds.mip_count();
+                                              info->array_size     = dds.array_size();
+                                              info->format         = uint32_t(dds.format());
+                                              info->dimension      = uint32_t(dds.texture_dimension());
+                                              info->block_width    = dds.block_width();
+                                              info->block_height   = dds.block_height();
+                                              info->bits_per_pixel = uint32_t(std::max(dds.bpp, 0));
+                                              info->is_cubemap     = dds.is_cubemap;
+                                              info->is_compressed  = smalldds::DDSFile::is_compressed(dds.format());
+                                              info->is_srgb        = dds.is_sRGB();
+                                              return res;
+                                          });
+}
+
+smalldds_result smalldds_load(smalldds_file *file)
+{
+    return smalldds::detail::guard_c_call(file,
+                                          [&]
+                                          {
+                                              auto res = smalldds::detail::require_opened(file);
+                                              if (res.type == smalldds::Result::Error)
+                                                  return res;
+                                              return file->dds.populate_image_data();
+                                          });
+}
+
+const char *smalldds_message(const smalldds_file *file)
+{
+    if (!file)
+        return "";
+    const auto &message = smalldds::detail::thread_c_message();
+    return message.id == file->id ? message.text.c_str() : file->message.c_str();
+}
+
+const char *smalldds_format_name(uint32_t format)
+{
+    return smalldds::format_name(smalldds::DDSFile::DXGIFormat(format));
+}
+
+smalldds_result smalldds_get_image(const smalldds_file *file, uint32_t mip, uint32_t array, smalldds_image *image)
+{
+    return smalldds::detail::guard_c_call(
+        file,
+        [&]
+        {
+            if (!image)
+                return smalldds::Result{smalldds::Result::Error, "DDS: image must not be NULL."};
+            const auto *img = file->dds.get_image_data(mip, array);
+            if (!img)
+                return smalldds::Result{smalldds::Result::Error,
+                                        "DDS: Requested image does not exist. Did you call smalldds_load()?"};
+
+            // rows of blocks for block-compressed formats, rows of pixels otherwise
+            const uint32_t bh    = std::max(1u, file->dds.block_height());
+            const size_t   rows  = std::max<size_t>(1, (img->height + bh - 1) / bh);
+            image->data          = img->bytes();
+            image->size          = img->chars.size();
+            image->slice_pitch   = img->chars.size() / std::max(1u, img->depth);
+            image->row_pitch     = image->slice_pitch / rows;
+            image->width         = img->width;
+            image->height        = img->height;
+            image->depth         = img->depth;
+            return smalldds::Result{smalldds::Result::Success};
+        });
+}
+
+size_t smalldds_decoded_size(const smalldds_file *file, uint32_t mip, uint32_t array)
+{
+    const auto *img = file ? file->dds.get_image_data(mip, array) : nullptr;
+    return img ? 4 * size_t(img->width) * img->height * img->depth : 0;
+}
+
+smalldds_result smalldds_decode(const smalldds_file *file, uint32_t mip, uint32_t array, float *dst, size_t capacity)
+{
+    return smalldds::detail::guard_c_call(file,
+                                          [&]
+                                          {
+                                              size_t needed = smalldds_decoded_size(file, mip, array);
+                                              if (needed == 0)
+                                                  return smalldds::Result{smalldds::Result::Error,
+                                                                          "DDS: Requested image does not exist."};
+                                              if (!dst || capacity < needed)
+                                                  return smalldds::Result{smalldds::Result::Error,
+                                                                          "DDS: Destination buffer is too small."};
+                                              return file->dds.decode(dst, mip, array);
+                                          });
+}
+
+float *smalldds_decode_alloc(smalldds_file *file, uint32_t mip, uint32_t array, size_t *count)
+{
+    size_t needed = smalldds_decoded_size(file, mip, array);
+    float *buffer = needed ? new (std::nothrow) float[needed] : nullptr;
+    if (needed && !buffer)
+    {
+        smalldds::detail::finish_c_call(file, smalldds::Result{smalldds::Result::Error, "DDS: Out of memory."});
+        return nullptr;
+    }
+    if (smalldds_decode(file, mip, array, buffer, needed) == SMALLDDS_ERROR)
+    {
+        delete[] buffer;
+        return nullptr;
+    }
+    if (count)
+        *count = needed;
+    return buffer;
+}
+
+void smalldds_free_buffer(float *buffer) { delete[] buffer; }
+
+} // extern "C"
+
+#endif // defined(__cplusplus) && defined(SMALLDDS_IMPLEMENTATION)
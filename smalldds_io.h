@@ -0,0 +1,1560 @@
+//
+// smalldds_io - File and archive access for smalldds.
+//
+// Copyright (c) 2025 Wojciech Jarosz. Distributed under the
+// Apache 2.0 License (https://opensource.org/license/apache-2-0)
+//
+
+/** @file smalldds_io.h
+
+    Like smalldds.h, the implementation is compiled into exactly one translation unit:
+    @code
+    #define SMALLDDS_IMPLEMENTATION
+    #include "smalldds_io.h"
+    @endcode
+*/
+
+#pragma once
+
+#include "smalldds.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace smalldds
+{
+
+/// A read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile &)            = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    Result open(const char *path);
+    void   close();
+
+    const uint8_t *data() const { return m_data; }
+    size_t         size() const { return m_size; }
+
+private:
+    const uint8_t *m_data = nullptr;
+    size_t         m_size = 0;
+#ifdef _WIN32
+    void *m_file    = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
+
+/** Zero-copy access to the DDS files inside an uncompressed tar or zip archive.
+
+    The archive is memory mapped and its directory is indexed once by open(). Each entry can then be loaded as a
+    DDSFile view (see DDSFile::load_view()) pointing straight into the mapping, so nothing is extracted or copied. The
+    views keep the mapping alive, so they stay valid after the Archive is closed or destroyed.
+
+    Supported are POSIX ustar, GNU (long names, base-256 sizes) and pax (path records) tar files, and zip files
+    (including zip64) whose entries are stored without compression. Compressed or encrypted zip entries are listed,
+    but cannot be loaded.
+
+    Usage example:
+    @code
+    Archive archive;
+    if (archive.open("textures.tar").type == Result::Error)
+        return;
+
+    for (const auto &entry : archive.entries())
+    {
+        DDSFile dds;
+        if (archive.load(entry, dds).type != Result::Error && dds.populate_image_data().type != Result::Error)
+            upload(entry.name, dds);
+    }
+    @endcode
+*/
+class Archive
+{
+public:
+    struct Entry
+    {
+        std::string name;          ///< Path of the file within the archive
+        uint64_t    offset = 0;    ///< Offset of the file contents from the start of the archive
+        uint64_t    size   = 0;    ///< Size of the file contents in bytes
+        bool        stored = true; ///< Whether the contents are stored uncompressed (and so can be loaded)
+    };
+
+    /// Map the archive at `path` and index its entries
+    Result open(const char *path);
+    /// Index an archive in memory; `backing` keeps `data` alive for the archive and the views loaded from it
+    Result open(const uint8_t *data, size_t size, std::shared_ptr<const void> backing = {});
+    void   close();
+
+    /// The regular files in the archive, in archive order
+    const std::vector<Entry> &entries() const { return m_entries; }
+    /// The entry with the given path, or nullptr
+    const Entry *find(std::string_view name) const;
+
+    /// Make `dds` a view of the DDS file stored in `entry`
+    Result load(const Entry &entry, DDSFile &dds) const;
+    /// Make `dds` a view of the DDS file at path `name` within the archive
+    Result load(std::string_view name, DDSFile &dds) const;
+
+private:
+    Result index_tar();
+    Result index_zip(size_t end_of_central_dir);
+    void   add_entry(Entry &&entry);
+
+    const uint8_t                          *m_data = nullptr;
+    size_t                                  m_size = 0;
+    std::shared_ptr<const void>             m_backing;
+    std::vector<Entry>                      m_entries;
+    std::unordered_map<std::string, size_t> m_index;
+};
+
+/// A byte range to read into `dst`, see RandomAccessFile::read()
+struct ReadRange
+{
+    uint64_t offset = 0;
+    uint64_t size   = 0;
+    uint8_t *dst    = nullptr;
+};
+
+/// Controls how RandomAccessFile::read() merges ranges into larger reads
+struct CoalesceOptions
+{
+    uint64_t max_gap  = 64 << 10; ///< Ranges separated by at most this many bytes are merged, reading the gap too
+    uint64_t max_read = 16 << 20; ///< Merged reads don't grow beyond this many bytes
+};
+
+/// Controls RandomAccessFile::read_parallel() and load_parallel()
+struct ParallelReadOptions
+{
+    uint64_t chunk_size  = 16 << 20; ///< Bytes per read; smaller ranges are read by the calling thread alone
+    uint32_t num_threads = 0;        ///< Number of reads in flight at once; 0 uses the number of hardware threads
+};
+
+/** A file read with positional reads (pread on POSIX), so it can be used from any number of threads at once.
+
+    It can be shared by several SubresourceReader that read DDS files stored in one uncompressed archive, which lets
+    the reads of adjacent files be merged.
+*/
+class RandomAccessFile
+{
+public:
+    RandomAccessFile() = default;
+    ~RandomAccessFile() { close(); }
+    RandomAccessFile(const RandomAccessFile &)            = delete;
+    RandomAccessFile &operator=(const RandomAccessFile &) = delete;
+
+    Result open(const char *path);
+    void   close();
+
+    uint64_t size() const { return m_size; }
+
+    /// Read `size` bytes at `offset`
+    Result read(uint64_t offset, uint64_t size, uint8_t *dst) const;
+    /** Read a batch of ranges, in any order, with as few reads as possible.
+
+        Ranges that are adjacent, overlap, or are separated by small gaps are merged into a single read into a
+        temporary buffer, and scattered to their destinations from there. Isolated ranges are read directly into their
+        destinations. On HDDs and network storage, a few large reads are much faster than many small ones.
+    */
+    Result read(const ReadRange *ranges, size_t count, const CoalesceOptions &options = CoalesceOptions{}) const;
+    /** Read `size` bytes at `offset` as chunks read concurrently by several threads.
+
+        A single sequential read keeps only one request in flight, which leaves most of the bandwidth of an NVMe drive
+        unused. Each thread reads its chunks straight into `dst`.
+    */
+    Result read_parallel(uint64_t offset, uint64_t size, uint8_t *dst,
+                         const ParallelReadOptions &options = ParallelReadOptions{}) const;
+
+private:
+    uint64_t m_size = 0;
+#ifdef _WIN32
+    void *m_handle = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
+
+/** Reads subresources of a DDS file on demand, without loading the whole file.
+
+    open() reads and verifies only the headers, and computes the location of every subresource with
+    DDSFile::compute_layout(). Subresources are then read with RandomAccessFile, so a single reader can be used from any
+    number of threads at once.
+
+    The DDS file can also be an entry of an uncompressed archive (see Archive::entries()), in which case all the
+    readers of the archive should share one RandomAccessFile:
+    @code
+    auto pack = std::make_shared<RandomAccessFile>();
+    pack->open("textures.tar");
+    for (const auto &entry : archive.entries())
+    {
+        auto reader = std::make_shared<SubresourceReader>();
+        if (reader->open(pack, entry.offset, entry.size).type != Result::Error)
+            readers.push_back(reader);
+    }
+    @endcode
+*/
+class SubresourceReader
+{
+public:
+    /// Open the DDS file at `path`
+    Result open(const char *path);
+    /// Open the DDS file stored in the `size` bytes at `offset` of `source`
+    Result open(std::shared_ptr<const RandomAccessFile> source, uint64_t offset, uint64_t size);
+    void   close();
+
+    /// The file with its parsed header; its `dds` and `image_data` members hold no pixel data
+    const DDSFile &file() const { return m_file; }
+    /// All subresources, ordered like DDSFile::image_data
+    const std::vector<DDSFile::Subresource> &subresources() const { return m_subresources; }
+    /// Location of a subresource (`array` counts cube faces for cubemaps), or nullptr if it doesn't exist
+    const DDSFile::Subresource *subresource(uint32_t mip, uint32_t array) const;
+    uint64_t                    file_size() const { return m_file_size; }
+
+    /// The file that holds the DDS file
+    const std::shared_ptr<const RandomAccessFile> &source() const { return m_source; }
+    /// Offset of the DDS file within source()
+    uint64_t source_offset() const { return m_source_offset; }
+
+    /// Read a subresource into `dst`, which needs room for subresource(mip, array)->size bytes
+    Result read(uint32_t mip, uint32_t array, uint8_t *dst) const;
+    /// Read `size` bytes at `offset` from the start of the DDS file
+    Result read(uint64_t offset, uint64_t size, uint8_t *dst) const;
+    /// Read a batch of ranges (with offsets from the start of the DDS file), merging nearby reads
+    Result read(const ReadRange *ranges, size_t count, const CoalesceOptions &options = CoalesceOptions{}) const;
+
+private:
+    DDSFile                                 m_file;
+    std::vector<DDSFile::Subresource>       m_subresources;
+    std::shared_ptr<const RandomAccessFile> m_source;
+    uint64_t                                m_source_offset = 0;
+    uint64_t                                m_file_size     = 0;
+};
+
+/** Load a DDS file with RandomAccessFile::read_parallel(), for files of many gigabytes.
+
+    The file is read into a buffer that is not zero-filled first, and that `dds` holds as a view (see
+    DDSFile::load_view()), so the `dds` member stays empty. Call populate_image_data() as usual afterwards.
+*/
+Result load_parallel(const char *path, DDSFile &dds, const ParallelReadOptions &options = ParallelReadOptions{});
+
+/// A request for a range of subresources of one file, see StreamingScheduler
+struct StreamRequest
+{
+    /// A subresource that has been read
+    struct Subresource
+    {
+        uint64_t             request = 0; ///< The id that StreamingScheduler::submit() returned
+        uint32_t             mip     = 0;
+        uint32_t             array   = 0;
+        uint32_t             width   = 0;
+        uint32_t             height  = 0;
+        uint32_t             depth   = 0;
+        std::vector<uint8_t> data; ///< The pixel data, ready to be moved into the client's resource
+    };
+
+    /// The file to read from
+    std::shared_ptr<const SubresourceReader> file;
+
+    uint32_t first_mip   = 0;
+    uint32_t num_mips    = 0; ///< 0 for all mips from first_mip on
+    uint32_t first_array = 0;
+    uint32_t num_arrays  = 0; ///< 0 for all array slices from first_array on
+    int      priority    = 0; ///< Higher priorities are read first
+    /// Among requests of equal priority, earlier deadlines are read first
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    /// Called once for every subresource of the request, from a worker thread. The reads are issued in file order, but
+    /// with more than one thread, deliveries may overlap and arrive out of order.
+    std::function<void(Subresource &&)> on_subresource;
+    /// Optional; called from a worker thread once all subresources were delivered, or with the error that ended the
+    /// request early. Not called for cancelled requests.
+    std::function<void(uint64_t request, const Result &)> on_complete;
+};
+
+struct StreamingOptions
+{
+    uint32_t        num_threads           = 2;        ///< Number of I/O threads; 0 uses the number of hardware threads
+    uint64_t        max_outstanding_bytes = 64 << 20; ///< Bytes being read or delivered at any time (see below)
+    CoalesceOptions coalesce;                         ///< Merging of nearby reads, also across requests
+};
+
+/** Schedules the reads of streaming requests by priority, deadline and file locality.
+
+    Requests are served in order of decreasing priority, then increasing deadline. Requests that tie are served in
+    order of the file and offset of their next subresource, so that reads from one file proceed sequentially. The
+    subresources of a request are read in file order. Requests can be re-prioritized or cancelled at any time;
+    subresources that are already being read when a request is cancelled are dropped.
+
+    When a worker thread starts a read, it also takes the pending subresources of any request that continue it within
+    the StreamingOptions::coalesce limits, and reads them all at once with RandomAccessFile::read(). This merges the
+    mips of a texture, and adjacent textures of a pack whose readers share a RandomAccessFile. Reads only start while
+    the bytes being read or delivered stay within StreamingOptions::max_outstanding_bytes (a single subresource may
+    exceed it), which bounds the memory held by the scheduler. Callbacks are invoked without holding any locks, so
+    they may submit, re-prioritize or cancel requests.
+
+    Usage example:
+    @code
+    auto file = std::make_shared<SubresourceReader>();
+    if (file->open("terrain.dds").type == Result::Error)
+        return;
+
+    StreamingScheduler scheduler;
+    StreamRequest      request;
+    request.file           = file;
+    request.first_mip      = 2; // the low resolution mips first ...
+    request.priority       = 10;
+    request.on_subresource = [&](StreamRequest::Subresource &&s) { upload(s.mip, s.array, std::move(s.data)); };
+    scheduler.submit(request);
+
+    request.first_mip = 0; // ... then the rest
+    request.num_mips  = 2;
+    request.priority  = 0;
+    scheduler.submit(request);
+    @endcode
+*/
+class StreamingScheduler
+{
+public:
+    explicit StreamingScheduler(const StreamingOptions &options = StreamingOptions{});
+    /// Cancels all requests and waits for the reads in flight
+    ~StreamingScheduler();
+    StreamingScheduler(const StreamingScheduler &)            = delete;
+    StreamingScheduler &operator=(const StreamingScheduler &) = delete;
+
+    /// Queue a request and return its id, or 0 if it has no file or selects no subresources
+    uint64_t submit(StreamRequest request);
+    /// Change the priority and deadline of a queued request; returns false if it has already finished
+    bool reprioritize(uint64_t request, int priority,
+                      std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+    /// Drop the rest of a request; returns false if it has already finished
+    bool cancel(uint64_t request);
+    /// Block until all requests have finished or have been cancelled
+    void wait_idle();
+    /// Number of requests that have not finished yet
+    size_t pending() const;
+
+private:
+    struct Job
+    {
+        uint64_t              id;
+        StreamRequest         request;
+        std::vector<uint32_t> subresources; ///< Indices into the reader's subresources, in file order
+        size_t                next      = 0;
+        uint32_t              in_flight = 0;
+        bool                  cancelled = false;
+        Result                result{Result::Success};
+    };
+
+    void                 worker();
+    std::shared_ptr<Job> next_job() const;
+
+    StreamingOptions                  m_options;
+    mutable std::mutex                m_mutex;
+    std::condition_variable           m_work;
+    std::condition_variable           m_idle;
+    std::vector<std::shared_ptr<Job>> m_jobs; ///< Requests with subresources left to read or deliver
+    uint64_t                          m_next_id     = 1;
+    uint64_t                          m_outstanding = 0;
+    uint32_t                          m_reading     = 0; ///< Reads that are in flight, or whose callbacks are running
+    const RandomAccessFile           *m_last_source = nullptr;
+    bool                              m_stop        = false;
+    std::vector<std::thread>          m_threads;
+};
+
+/// What HotReloader::poll() did to a watched file
+struct ReloadEvent
+{
+    struct Subresource
+    {
+        uint32_t mip   = 0;
+        uint32_t array = 0;
+    };
+
+    std::string path;
+    DDSFile    *dds = nullptr; ///< The watched DDSFile, already updated (unless `result` is an error)
+    /// The file kept its size and headers, so only the `changed` subresources were copied into the existing buffer, and
+    /// pointers into it stay valid. Otherwise the file was reloaded, and every subresource is listed as changed.
+    bool                     in_place = false;
+    std::vector<Subresource> changed; ///< The subresources whose pixel data changed, possibly none
+    Result                   result{Result::Success};
+};
+
+struct HotReloadOptions
+{
+    /// Reload a file once poll() has seen no writes to it for this long, so a save is reloaded once, and only when
+    /// complete. The interval starts when poll() notices a write, so it adds to the time between calls of poll().
+    std::chrono::milliseconds debounce{100};
+};
+
+/** Watches DDS files for changes on disk and reloads them into the DDSFile objects that hold them.
+
+    Changes are detected with inotify, on the directories of the watched files, so files saved by writing a temporary
+    file and renaming it over the original are picked up too. Nothing happens in the background: call poll()
+    regularly (e.g. once per frame) from the thread that owns the DDSFile objects. It reloads the files whose
+    debounce interval has passed and notifies their subscribers, from the calling thread.
+
+    A file that keeps its size and headers (the common case when an artist re-saves a texture) is reloaded in place:
+    the subresources whose bytes changed are copied into the existing buffer, and only those are reported, so an
+    engine can re-upload just them. A metadata chunk (see DDSFile::read_metadata()) that changed with the pixels is
+    updated along with them. Other files are parsed anew, which replaces the buffer; a file that fails to
+    parse (e.g. one that is still being written) leaves the DDSFile as it was.
+
+    Usage example:
+    @code
+    HotReloader reloader;
+    reloader.watch("textures/rock.dds", rock, [&](const ReloadEvent &e)
+    {
+        for (const auto &s : e.changed) upload(texture, s.mip, s.array, e.dds->get_image_data(s.mip, s.array));
+    });
+    while (running)
+    {
+        reloader.poll();
+        render();
+    }
+    @endcode
+
+    Only Linux is supported; elsewhere, watch() returns an error.
+*/
+class HotReloader
+{
+public:
+    explicit HotReloader(const HotReloadOptions &options = HotReloadOptions{});
+    ~HotReloader();
+    HotReloader(const HotReloader &)            = delete;
+    HotReloader &operator=(const HotReloader &) = delete;
+
+    /// Reload `dds` whenever the file at `path` changes, and then call `on_reload`. Several subscribers may watch the
+    /// same file, with the same or different DDSFile objects.
+    Result watch(const char *path, DDSFile &dds, std::function<void(const ReloadEvent &)> on_reload = {});
+    /// Stop watching on behalf of `dds`
+    void   unwatch(const DDSFile &dds);
+    /// Reload the files whose changes have settled, and return how many were reloaded. Never blocks.
+    size_t poll();
+
+private:
+    struct Watch
+    {
+        std::string                              path;
+        int                                      directory = -1; ///< The inotify watch of its directory
+        std::string                              name;           ///< The file name within the directory
+        DDSFile                                 *dds = nullptr;
+        std::function<void(const ReloadEvent &)> on_reload;
+        bool                                     pending = false;
+        std::chrono::steady_clock::time_point    last_write;
+    };
+
+    /// Mark the watches of the files that inotify reported as written to
+    void read_events(std::chrono::steady_clock::time_point now);
+    void reload(Watch &watch, ReloadEvent &event);
+
+    HotReloadOptions     m_options;
+    int                  m_inotify = -1;
+    std::vector<Watch>   m_watches;
+    std::vector<uint8_t> m_scratch; ///< The new file contents, kept to avoid reallocating on every reload
+};
+
+} // namespace smalldds
+
+#ifdef SMALLDDS_IMPLEMENTATION
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace smalldds
+{
+
+Result MappedFile::open(const char *path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return Result{Result::Error, std::string("MappedFile: Cannot open ") + path};
+    m_file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        close();
+        return Result{Result::Error, std::string("MappedFile: Cannot query the size of ") + path};
+    }
+    m_size = size_t(size.QuadPart);
+    if (m_size == 0)
+        return Result{Result::Success};
+
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping)
+        m_data = static_cast<const uint8_t *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return Result{Result::Error, std::string("MappedFile: Cannot open ") + path};
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return Result{Result::Error, std::string("MappedFile: Cannot query the size of ") + path};
+    }
+    m_size = size_t(st.st_size);
+    if (m_size == 0)
+    {
+        ::close(fd);
+        return Result{Result::Success};
+    }
+
+    void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps its own reference to the file
+    if (mapping != MAP_FAILED)
+        m_data = static_cast<const uint8_t *>(mapping);
+#endif
+    if (!m_data)
+    {
+        close();
+        return Result{Result::Error, std::string("MappedFile: Cannot map ") + path};
+    }
+    return Result{Result::Success};
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+    m_mapping = m_file = nullptr;
+#else
+    if (m_data)
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+namespace detail
+{
+
+template <typename T> T read_le(const uint8_t *p)
+{
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) value |= T(p[i]) << (8 * i);
+    return value;
+}
+
+/// Parse a numeric tar header field: NUL/space-terminated octal, or GNU base-256 if the high bit is set
+inline bool parse_tar_number(const uint8_t *field, size_t length, uint64_t &value)
+{
+    value = 0;
+    if (field[0] & 0x80)
+    {
+        if (field[0] & 0x40)
+            return false; // negative
+        value = field[0] & 0x3f;
+        for (size_t i = 1; i < length; ++i)
+        {
+            if (value >> 56)
+                return false;
+            value = (value << 8) | field[i];
+        }
+        return true;
+    }
+
+    size_t i = 0;
+    while (i < length && field[i] == ' ') ++i;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i) value = (value << 3) | uint64_t(field[i] - '0');
+    return i == length || field[i] == ' ' || field[i] == '\0';
+}
+
+inline std::string tar_string(const uint8_t *field, size_t length)
+{
+    const char *chars = reinterpret_cast<const char *>(field);
+    return std::string(chars, std::find(chars, chars + length, '\0'));
+}
+
+/// Whether `block` is a tar header with a valid checksum
+inline bool is_tar_header(const uint8_t *block)
+{
+    uint64_t expected;
+    if (!parse_tar_number(block + 148, 8, expected))
+        return false;
+    // the checksum is computed with the checksum field itself set to spaces
+    uint64_t sum = 8 * uint64_t(' ');
+    for (size_t i = 0; i < 512; ++i)
+        if (i < 148 || i >= 156)
+            sum += block[i];
+    return sum == expected;
+}
+
+/// Extract the "path" record from the contents of a pax extended header
+inline std::string pax_path(const uint8_t *data, size_t size)
+{
+    size_t pos = 0;
+    while (pos < size)
+    {
+        // each record is "<length> <key>=<value>\n", with <length> counting the whole record
+        size_t length = 0, i = pos;
+        for (; i < size && data[i] >= '0' && data[i] <= '9'; ++i)
+        {
+            if (length > (std::numeric_limits<size_t>::max() - 9) / 10)
+                return {};
+            length = length * 10 + (data[i] - '0');
+        }
+        // the length must cover at least the digits, the space and the newline
+        if (i >= size || data[i] != ' ' || length < i - pos + 2 || length > size - pos)
+            break;
+        std::string_view record{reinterpret_cast<const char *>(data) + i + 1, pos + length - i - 2};
+        if (record.substr(0, 5) == "path=")
+            return std::string(record.substr(5));
+        pos += length;
+    }
+    return {};
+}
+
+} // namespace detail
+
+Result Archive::open(const char *path)
+{
+    close();
+    auto file = std::make_shared<MappedFile>();
+    auto res  = file->open(path);
+    if (res.type == Result::Error)
+        return res;
+    return open(file->data(), file->size(), file);
+}
+
+Result Archive::open(const uint8_t *data, size_t size, std::shared_ptr<const void> backing)
+{
+    close();
+    m_data    = data;
+    m_size    = size;
+    m_backing = std::move(backing);
+
+    if (m_size >= 512 && detail::is_tar_header(m_data))
+        return index_tar();
+
+    // zip files are identified by their end of central directory record, which is followed by at most a 64 KiB comment
+    constexpr size_t eocd_size = 22;
+    if (m_size >= eocd_size)
+    {
+        size_t first = m_size > eocd_size + 0xFFFF ? m_size - eocd_size - 0xFFFF : 0;
+        for (size_t pos = m_size - eocd_size + 1; pos-- > first;)
+            if (detail::read_le<uint32_t>(m_data + pos) == 0x06054b50)
+                return index_zip(pos);
+    }
+
+    close();
+    return Result{Result::Error, "Archive: Not a tar or zip file."};
+}
+
+void Archive::close()
+{
+    m_data = nullptr;
+    m_size = 0;
+    m_backing.reset();
+    m_entries.clear();
+    m_index.clear();
+}
+
+void Archive::add_entry(Entry &&entry)
+{
+    if (entry.name.compare(0, 2, "./") == 0)
+        entry.name.erase(0, 2);
+    // later entries replace earlier ones with the same name, as when extracting
+    auto it = m_index.find(entry.name);
+    if (it != m_index.end())
+        m_entries[it->second] = std::move(entry);
+    else
+    {
+        m_index.emplace(entry.name, m_entries.size());
+        m_entries.push_back(std::move(entry));
+    }
+}
+
+Result Archive::index_tar()
+{
+    std::string long_name;
+    for (size_t pos = 0; pos + 512 <= m_size;)
+    {
+        const uint8_t *block = m_data + pos;
+        if (std::all_of(block, block + 512, [](uint8_t b) { return b == 0; }))
+            break; // end of archive marker
+
+        uint64_t size;
+        if (!detail::is_tar_header(block) || !detail::parse_tar_number(block + 124, 12, size))
+            return Result{Result::Error, "Archive: Corrupt tar header at offset " + std::to_string(pos) + "."};
+
+        const size_t data = pos + 512;
+        if (size > m_size - data)
+            return Result{Result::Error, "Archive: Tar entry at offset " + std::to_string(pos) + " is truncated."};
+
+        switch (char type = char(block[156]))
+        {
+        case 'L': // GNU long name of the next entry
+            long_name = detail::tar_string(m_data + data, size_t(size));
+            break;
+        case 'x': // pax extended header of the next entry
+            long_name = detail::pax_path(m_data + data, size_t(size));
+            break;
+        case '0':
+        case '\0':
+        case '7': // regular and contiguous files
+        {
+            Entry entry;
+            if (!long_name.empty())
+                entry.name = std::move(long_name);
+            else
+            {
+                entry.name = detail::tar_string(block, 100);
+                // ustar splits long paths into a prefix and a name
+                if (std::memcmp(block + 257, "ustar", 5) == 0 && block[345] != 0)
+                    entry.name = detail::tar_string(block + 345, 155) + "/" + entry.name;
+            }
+            entry.offset = data;
+            entry.size   = size;
+            add_entry(std::move(entry));
+            long_name.clear();
+            break;
+        }
+        default: // directories, links, devices, global pax headers
+            if (type != 'g')
+                long_name.clear();
+            break;
+        }
+
+        pos = data + size_t((size + 511) / 512 * 512);
+    }
+    return Result{Result::Success};
+}
+
+Result Archive::index_zip(size_t eocd)
+{
+    using detail::read_le;
+
+    uint64_t num_entries = read_le<uint16_t>(m_data + eocd + 10);
+    uint64_t cd_size     = read_le<uint32_t>(m_data + eocd + 12);
+    uint64_t cd_offset   = read_le<uint32_t>(m_data + eocd + 16);
+
+    // zip64: the real values are in the zip64 end of central directory record, found through a locator right before
+    if (eocd >= 20 && read_le<uint32_t>(m_data + eocd - 20) == 0x07064b50)
+    {
+        uint64_t zip64_eocd = read_le<uint64_t>(m_data + eocd - 20 + 8);
+        if (zip64_eocd > m_size || m_size - zip64_eocd < 56 ||
+            read_le<uint32_t>(m_data + zip64_eocd) != 0x06064b50)
+            return Result{Result::Error, "Archive: Corrupt zip64 end of central directory record."};
+        num_entries = read_le<uint64_t>(m_data + zip64_eocd + 32);
+        cd_size     = read_le<uint64_t>(m_data + zip64_eocd + 40);
+        cd_offset   = read_le<uint64_t>(m_data + zip64_eocd + 48);
+    }
+
+    if (cd_offset > m_size || cd_size > m_size - cd_offset)
+        return Result{Result::Error, "Archive: Zip central directory lies outside the file."};
+
+    const uint8_t *cd     = m_data + cd_offset;
+    const uint8_t *cd_end = cd + cd_size;
+    m_entries.reserve(size_t(std::min<uint64_t>(num_entries, cd_size / 46)));
+    for (uint64_t i = 0; i < num_entries; ++i)
+    {
+        if (cd_end - cd < 46 || read_le<uint32_t>(cd) != 0x02014b50)
+            return Result{Result::Error, "Archive: Corrupt zip central directory entry " + std::to_string(i) + "."};
+
+        uint16_t flags        = read_le<uint16_t>(cd + 8);
+        uint16_t method       = read_le<uint16_t>(cd + 10);
+        uint64_t compressed   = read_le<uint32_t>(cd + 20);
+        uint64_t uncompressed = read_le<uint32_t>(cd + 24);
+        uint16_t name_length  = read_le<uint16_t>(cd + 28);
+        uint16_t extra_length = read_le<uint16_t>(cd + 30);
+        size_t   record_size  = 46 + name_length + extra_length + read_le<uint16_t>(cd + 32);
+        uint64_t local_offset = read_le<uint32_t>(cd + 42);
+        if (size_t(cd_end - cd) < record_size)
+            return Result{Result::Error, "Archive: Corrupt zip central directory entry " + std::to_string(i) + "."};
+
+        // the zip64 extra field holds (in this order) those of the three values that overflowed 32 bits
+        for (const uint8_t *extra = cd + 46 + name_length, *extra_end = extra + extra_length; extra_end - extra >= 4;)
+        {
+            uint16_t id = read_le<uint16_t>(extra), size = read_le<uint16_t>(extra + 2);
+            if (extra_end - extra - 4 < size)
+                break;
+            if (id == 0x0001)
+            {
+                const uint8_t *field = extra + 4, *field_end = field + size;
+                for (uint64_t *value : {&uncompressed, &compressed, &local_offset})
+                    if (*value == 0xFFFFFFFF && field_end - field >= 8)
+                    {
+                        *value = read_le<uint64_t>(field);
+                        field += 8;
+                    }
+            }
+            extra += 4 + size;
+        }
+
+        Entry entry;
+        entry.name.assign(reinterpret_cast<const char *>(cd + 46), name_length);
+        cd += record_size;
+        if (!entry.name.empty() && entry.name.back() == '/')
+            continue; // directory
+
+        // the data follows the local header, whose name and extra field lengths may differ from the central ones
+        if (local_offset > m_size || m_size - local_offset < 30 ||
+            read_le<uint32_t>(m_data + local_offset) != 0x04034b50)
+            return Result{Result::Error, "Archive: Corrupt zip local header for " + entry.name + "."};
+        entry.offset = local_offset + 30 + read_le<uint16_t>(m_data + local_offset + 26) +
+                       read_le<uint16_t>(m_data + local_offset + 28);
+        entry.size   = compressed;
+        entry.stored = method == 0 && (flags & 1) == 0 && compressed == uncompressed;
+        if (entry.offset > m_size || entry.size > m_size - entry.offset)
+            return Result{Result::Error, "Archive: Zip entry " + entry.name + " is truncated."};
+        add_entry(std::move(entry));
+    }
+    return Result{Result::Success};
+}
+
+const Archive::Entry *Archive::find(std::string_view name) const
+{
+    auto it = m_index.find(std::string(name));
+    return it == m_index.end() ? nullptr : &m_entries[it->second];
+}
+
+Result Archive::load(const Entry &entry, DDSFile &dds) const
+{
+    if (!entry.stored)
+        return Result{Result::Error, "Archive: " + entry.name + " is compressed or encrypted and cannot be viewed."};
+    if (entry.offset > m_size || entry.size > m_size - entry.offset)
+        return Result{Result::Error, "Archive: " + entry.name + " is not an entry of this archive."};
+    return dds.load_view(m_data + entry.offset, size_t(entry.size), m_backing);
+}
+
+Result Archive::load(std::string_view name, DDSFile &dds) const
+{
+    if (const Entry *entry = find(name))
+        return load(*entry, dds);
+    return Result{Result::Error, "Archive: No entry named " + std::string(name) + "."};
+}
+
+Result RandomAccessFile::open(const char *path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                                nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        return Result{Result::Error, std::string("RandomAccessFile: Cannot open ") + path};
+    m_handle = handle;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size))
+    {
+        close();
+        return Result{Result::Error, std::string("RandomAccessFile: Cannot query the size of ") + path};
+    }
+    m_size = uint64_t(size.QuadPart);
+#else
+    m_fd = ::open(path, O_RDONLY);
+    if (m_fd < 0)
+        return Result{Result::Error, std::string("RandomAccessFile: Cannot open ") + path};
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0)
+    {
+        close();
+        return Result{Result::Error, std::string("RandomAccessFile: Cannot query the size of ") + path};
+    }
+    m_size = uint64_t(st.st_size);
+#endif
+    return Result{Result::Success};
+}
+
+void RandomAccessFile::close()
+{
+#ifdef _WIN32
+    if (m_handle)
+        CloseHandle(m_handle);
+    m_handle = nullptr;
+#else
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+#endif
+    m_size = 0;
+}
+
+Result RandomAccessFile::read(uint64_t offset, uint64_t size, uint8_t *dst) const
+{
+    if (offset > m_size || size > m_size - offset)
+        return Result{Result::Error, "RandomAccessFile: Read past the end of the file."};
+
+    // positional reads don't move a shared file pointer, so they are safe to issue from several threads
+    while (size > 0)
+    {
+        const uint64_t chunk = std::min<uint64_t>(size, 1u << 30);
+#ifdef _WIN32
+        OVERLAPPED position = {};
+        position.Offset     = DWORD(offset);
+        position.OffsetHigh = DWORD(offset >> 32);
+        DWORD count         = 0;
+        if (!ReadFile(m_handle, dst, DWORD(chunk), &count, &position) || count == 0)
+            return Result{Result::Error, "RandomAccessFile: I/O error."};
+#else
+        ssize_t count = pread(m_fd, dst, size_t(chunk), off_t(offset));
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return Result{Result::Error, "RandomAccessFile: I/O error."};
+#endif
+        dst += count;
+        offset += uint64_t(count);
+        size -= uint64_t(count);
+    }
+    return Result{Result::Success};
+}
+
+Result RandomAccessFile::read(const ReadRange *ranges, size_t count, const CoalesceOptions &options) const
+{
+    std::vector<const ReadRange *> sorted(count);
+    for (size_t i = 0; i < count; ++i) sorted[i] = ranges + i;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const ReadRange *a, const ReadRange *b) { return a->offset < b->offset; });
+
+    std::vector<uint8_t> buffer;
+    for (size_t i = 0, j; i < count; i = j)
+    {
+        // grow the run [begin, end) while the next range starts close enough and the read stays small enough
+        const uint64_t begin = sorted[i]->offset;
+        uint64_t       end   = begin + sorted[i]->size;
+        for (j = i + 1; j < count && sorted[j]->offset <= end + options.max_gap; ++j)
+        {
+            uint64_t range_end = std::max(end, sorted[j]->offset + sorted[j]->size);
+            if (range_end - begin > options.max_read)
+                break;
+            end = range_end;
+        }
+
+        if (j == i + 1)
+        {
+            auto res = read(begin, sorted[i]->size, sorted[i]->dst);
+            if (res.type == Result::Error)
+                return res;
+            continue;
+        }
+
+        buffer.resize(size_t(end - begin));
+        auto res = read(begin, end - begin, buffer.data());
+        if (res.type == Result::Error)
+            return res;
+        for (size_t k = i; k < j; ++k)
+            std::memcpy(sorted[k]->dst, buffer.data() + (sorted[k]->offset - begin), size_t(sorted[k]->size));
+    }
+    return Result{Result::Success};
+}
+
+Result RandomAccessFile::read_parallel(uint64_t offset, uint64_t size, uint8_t *dst,
+                                       const ParallelReadOptions &options) const
+{
+    const uint64_t chunk_size = std::max<uint64_t>(options.chunk_size, 1);
+    if (size <= chunk_size)
+        return read(offset, size, dst);
+    if (offset > m_size || size > m_size - offset)
+        return Result{Result::Error, "RandomAccessFile: Read past the end of the file."};
+
+    std::mutex error_mutex;
+    Result     res{Result::Success};
+    parallel_for(
+        0, size_t((size + chunk_size - 1) / chunk_size),
+        [&](size_t i)
+        {
+            uint64_t begin     = i * chunk_size;
+            auto     chunk_res = read(offset + begin, std::min(chunk_size, size - begin), dst + begin);
+            if (chunk_res.type == Result::Error)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                res = chunk_res;
+            }
+        },
+        options.num_threads);
+    return res;
+}
+
+Result load_parallel(const char *path, DDSFile &dds, const ParallelReadOptions &options)
+{
+    RandomAccessFile file;
+    auto             res = file.open(path);
+    if (res.type == Result::Error)
+        return res;
+    if (file.size() == 0)
+        return Result{Result::Error, "Cannot read file: file is empty"};
+
+    std::shared_ptr<uint8_t> buffer;
+    try
+    {
+        buffer.reset(new uint8_t[size_t(file.size())], std::default_delete<uint8_t[]>());
+    }
+    catch (const std::bad_alloc &)
+    {
+        return Result{Result::Error, "DDS: Out of memory."};
+    }
+
+    res = file.read_parallel(0, file.size(), buffer.get(), options);
+    if (res.type == Result::Error)
+        return res;
+    return dds.load_view(buffer.get(), size_t(file.size()), buffer);
+}
+
+Result SubresourceReader::open(const char *path)
+{
+    auto source = std::make_shared<RandomAccessFile>();
+    auto res    = source->open(path);
+    if (res.type == Result::Error)
+    {
+        close();
+        return res;
+    }
+    return open(source, 0, source->size());
+}
+
+Result SubresourceReader::open(std::shared_ptr<const RandomAccessFile> source, uint64_t offset, uint64_t size)
+{
+    close();
+    if (!source || offset > source->size() || size > source->size() - offset)
+        return Result{Result::Error, "SubresourceReader: The DDS file lies outside of its source file."};
+    m_source        = std::move(source);
+    m_source_offset = offset;
+    m_file_size     = size;
+
+    // read just the headers; DDSFile::load() checks that they are complete
+    constexpr uint64_t   header_size = sizeof(uint32_t) + sizeof(DDSFile::Header) + sizeof(DDSFile::HeaderDXT10);
+    std::vector<uint8_t> header(size_t(std::min(m_file_size, header_size)));
+    auto                 res = read(0, header.size(), header.data());
+    if (res.type != Result::Error)
+        res = m_file.load(std::move(header));
+    if (res.type != Result::Error)
+    {
+        auto layout = m_file.compute_layout(m_file_size, m_subresources);
+        if (!layout.message.empty())
+            res.add_message(layout.type, layout.message);
+    }
+    if (res.type == Result::Error)
+        close();
+    return res;
+}
+
+void SubresourceReader::close()
+{
+    m_file = DDSFile{};
+    m_subresources.clear();
+    m_source.reset();
+    m_source_offset = 0;
+    m_file_size     = 0;
+}
+
+const DDSFile::Subresource *SubresourceReader::subresource(uint32_t mip, uint32_t array) const
+{
+    if (mip >= m_file.mip_count() || array >= m_file.array_size())
+        return nullptr;
+    size_t index = size_t(array) * m_file.mip_count() + mip;
+    return index < m_subresources.size() ? &m_subresources[index] : nullptr;
+}
+
+Result SubresourceReader::read(uint32_t mip, uint32_t array, uint8_t *dst) const
+{
+    const auto *s = subresource(mip, array);
+    if (!s)
+        return Result{Result::Error, "SubresourceReader: Requested image does not exist."};
+    return read(s->offset, s->size, dst);
+}
+
+Result SubresourceReader::read(uint64_t offset, uint64_t size, uint8_t *dst) const
+{
+    if (!m_source)
+        return Result{Result::Error, "SubresourceReader: No file has been opened."};
+    if (offset > m_file_size || size > m_file_size - offset)
+        return Result{Result::Error, "SubresourceReader: Read past the end of the file."};
+    return m_source->read(m_source_offset + offset, size, dst);
+}
+
+Result SubresourceReader::read(const ReadRange *ranges, size_t count, const CoalesceOptions &options) const
+{
+    if (!m_source)
+        return Result{Result::Error, "SubresourceReader: No file has been opened."};
+    std::vector<ReadRange> absolute(ranges, ranges + count);
+    for (auto &range : absolute)
+    {
+        if (range.offset > m_file_size || range.size > m_file_size - range.offset)
+            return Result{Result::Error, "SubresourceReader: Read past the end of the file."};
+        range.offset += m_source_offset;
+    }
+    return m_source->read(absolute.data(), absolute.size(), options);
+}
+
+StreamingScheduler::StreamingScheduler(const StreamingOptions &options) : m_options(options)
+{
+    uint32_t num_threads = options.num_threads ? options.num_threads : std::thread::hardware_concurrency();
+    for (uint32_t i = 0; i < std::max(1u, num_threads); ++i) m_threads.emplace_back([this] { worker(); });
+}
+
+StreamingScheduler::~StreamingScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &job : m_jobs) job->cancelled = true;
+        m_jobs.clear();
+        m_stop = true;
+    }
+    m_work.notify_all();
+    for (auto &thread : m_threads) thread.join();
+}
+
+uint64_t StreamingScheduler::submit(StreamRequest request)
+{
+    if (!request.file)
+        return 0;
+
+    auto        job    = std::make_shared<Job>();
+    const auto &file   = request.file->file();
+    uint64_t    mips   = request.num_mips ? uint64_t(request.first_mip) + request.num_mips : file.mip_count();
+    uint64_t    arrays = request.num_arrays ? uint64_t(request.first_array) + request.num_arrays : file.array_size();
+    // subresources are stored by array slice, then by mip, so this is file order
+    for (uint32_t a = request.first_array; a < std::min<uint64_t>(arrays, file.array_size()); ++a)
+        for (uint32_t m = request.first_mip; m < std::min<uint64_t>(mips, file.mip_count()); ++m)
+            if (request.file->subresource(m, a))
+                job->subresources.push_back(a * file.mip_count() + m);
+    if (job->subresources.empty())
+        return 0;
+    job->request = std::move(request);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    job->id = m_next_id++;
+    m_jobs.push_back(job);
+    m_work.notify_all();
+    return job->id;
+}
+
+bool StreamingScheduler::reprioritize(uint64_t request, int priority, std::chrono::steady_clock::time_point deadline)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &job : m_jobs)
+        if (job->id == request)
+        {
+            job->request.priority = priority;
+            job->request.deadline = deadline;
+            return true;
+        }
+    return false;
+}
+
+bool StreamingScheduler::cancel(uint64_t request)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = std::find_if(m_jobs.begin(), m_jobs.end(), [&](const auto &job) { return job->id == request; });
+    if (it == m_jobs.end())
+        return false;
+    (*it)->cancelled = true;
+    m_jobs.erase(it);
+    if (m_jobs.empty() && m_reading == 0)
+        m_idle.notify_all();
+    // in case this was the request blocking the outstanding bytes limit
+    m_work.notify_all();
+    return true;
+}
+
+void StreamingScheduler::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_jobs.empty() && m_reading == 0; });
+}
+
+size_t StreamingScheduler::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs.size();
+}
+
+std::shared_ptr<StreamingScheduler::Job> StreamingScheduler::next_job() const
+{
+    std::shared_ptr<Job> best;
+    uint64_t             best_offset = 0;
+    for (const auto &job : m_jobs)
+    {
+        if (job->next >= job->subresources.size())
+            continue;
+        const auto *reader = job->request.file.get();
+        const auto *source = reader->source().get();
+        uint64_t    offset = reader->source_offset() + reader->subresources()[job->subresources[job->next]].offset;
+        if (best)
+        {
+            const auto &a = job->request, &b = best->request;
+            const auto *best_source = b.file->source().get();
+            if (a.priority != b.priority)
+            {
+                if (a.priority < b.priority)
+                    continue;
+            }
+            else if (a.deadline != b.deadline)
+            {
+                if (a.deadline > b.deadline)
+                    continue;
+            }
+            // ties: stay in the file that was read last, then go by file and offset
+            else if ((source == m_last_source) != (best_source == m_last_source))
+            {
+                if (source != m_last_source)
+                    continue;
+            }
+            else if (std::make_pair(source, offset) >= std::make_pair(best_source, best_offset))
+                continue;
+        }
+        best        = job;
+        best_offset = offset;
+    }
+    return best;
+}
+
+void StreamingScheduler::worker()
+{
+    struct Item
+    {
+        std::shared_ptr<Job>       job;
+        uint64_t                   offset; ///< Offset in the source file
+        uint64_t                   size;
+        StreamRequest::Subresource out;
+    };
+    std::vector<Item>      batch;
+    std::vector<ReadRange> ranges;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        std::shared_ptr<Job> job;
+        m_work.wait(lock,
+                    [&]
+                    {
+                        if (m_stop)
+                            return true;
+                        job = next_job();
+                        if (!job)
+                            return false;
+                        const auto &s = job->request.file->subresources()[job->subresources[job->next]];
+                        return m_outstanding == 0 || m_outstanding + s.size <= m_options.max_outstanding_bytes;
+                    });
+        if (m_stop)
+            return;
+
+        // take the next subresource of `job`, and then those of any request that continue the read [begin, end)
+        const auto source = job->request.file->source();
+        uint64_t   begin = 0, end = 0;
+        auto       take  = [&](const std::shared_ptr<Job> &j)
+        {
+            const auto *reader = j->request.file.get();
+            uint32_t    index  = j->subresources[j->next];
+            const auto &s      = reader->subresources()[index];
+            uint64_t    offset = reader->source_offset() + s.offset;
+            if (!batch.empty() && (offset < begin || offset > end + m_options.coalesce.max_gap ||
+                                   std::max(end, offset + s.size) - begin > m_options.coalesce.max_read ||
+                                   m_outstanding + s.size > m_options.max_outstanding_bytes))
+                return false;
+
+            StreamRequest::Subresource out;
+            out.request = j->id;
+            out.mip     = index % reader->file().mip_count();
+            out.array   = index / reader->file().mip_count();
+            out.width   = s.width;
+            out.height  = s.height;
+            out.depth   = s.depth;
+            batch.push_back(Item{j, offset, s.size, std::move(out)});
+
+            begin = batch.size() == 1 ? offset : begin;
+            end   = std::max(end, offset + s.size);
+            j->next++;
+            j->in_flight++;
+            m_reading++;
+            m_outstanding += s.size;
+            return true;
+        };
+        batch.clear();
+        take(job);
+        for (bool grown = true; grown;)
+        {
+            grown = false;
+            for (const auto &j : m_jobs)
+                if (j->next < j->subresources.size() && j->request.file->source() == source)
+                    grown |= take(j);
+        }
+        m_last_source = source.get();
+        lock.unlock();
+
+        Result res{Result::Success};
+        try
+        {
+            ranges.clear();
+            for (auto &item : batch)
+            {
+                item.out.data.resize(size_t(item.size));
+                ranges.push_back(ReadRange{item.offset, item.size, item.out.data.data()});
+            }
+            res = source->read(ranges.data(), ranges.size(), m_options.coalesce);
+        }
+        catch (const std::bad_alloc &)
+        {
+            res = Result{Result::Error, "StreamingScheduler: Out of memory."};
+        }
+
+        lock.lock();
+        for (auto &item : batch)
+        {
+            auto &j = item.job;
+            if (res.type == Result::Error && !j->cancelled && j->result.type != Result::Error)
+            {
+                j->result = res;
+                j->next   = j->subresources.size(); // stop reading this request
+            }
+            if (!j->cancelled && j->result.type != Result::Error && j->request.on_subresource)
+            {
+                lock.unlock();
+                j->request.on_subresource(std::move(item.out));
+                lock.lock();
+            }
+
+            j->in_flight--;
+            if (!j->cancelled && j->in_flight == 0 && j->next == j->subresources.size())
+            {
+                m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), j));
+                if (j->request.on_complete)
+                {
+                    lock.unlock();
+                    j->request.on_complete(j->id, j->result);
+                    lock.lock();
+                }
+            }
+
+            m_reading--;
+            m_outstanding -= item.size;
+            if (m_jobs.empty() && m_reading == 0)
+                m_idle.notify_all();
+            m_work.notify_all();
+        }
+        batch.clear();
+    }
+}
+
+HotReloader::HotReloader(const HotReloadOptions &options) : m_options(options)
+{
+#ifdef __linux__
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+HotReloader::~HotReloader()
+{
+#ifdef __linux__
+    if (m_inotify >= 0)
+        ::close(m_inotify);
+#endif
+}
+
+Result HotReloader::watch(const char *path, DDSFile &dds, std::function<void(const ReloadEvent &)> on_reload)
+{
+#ifdef __linux__
+    if (m_inotify < 0)
+        return Result{Result::Error, "HotReloader: Cannot initialize inotify"};
+
+    Watch watch;
+    watch.path            = path;
+    auto        slash     = watch.path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : watch.path.substr(0, std::max<size_t>(slash, 1));
+    watch.name            = watch.path.substr(slash == std::string::npos ? 0 : slash + 1);
+
+    // Watching the directory (which yields the same watch for all its files) also catches files replaced by a rename
+    const uint32_t events = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO;
+    watch.directory       = inotify_add_watch(m_inotify, directory.c_str(), events);
+    if (watch.directory < 0)
+        return Result{Result::Error, "HotReloader: Cannot watch " + directory};
+    watch.dds       = &dds;
+    watch.on_reload = std::move(on_reload);
+    read_events(std::chrono::steady_clock::now()); // those that happened so far don't concern the new watch
+    m_watches.push_back(std::move(watch));
+    return Result{Result::Success};
+#else
+    (void)path;
+    (void)dds;
+    (void)on_reload;
+    return Result{Result::Error, "HotReloader: Watching files is only supported on Linux"};
+#endif
+}
+
+void HotReloader::unwatch(const DDSFile &dds)
+{
+    for (auto it = m_watches.begin(); it != m_watches.end();)
+    {
+        if (it->dds != &dds)
+        {
+            ++it;
+            continue;
+        }
+        const int directory = it->directory;
+        it                  = m_watches.erase(it);
+        if (std::none_of(m_watches.begin(), m_watches.end(), [&](const Watch &w) { return w.directory == directory; }))
+        {
+#ifdef __linux__
+            inotify_rm_watch(m_inotify, directory);
+#endif
+        }
+    }
+}
+
+size_t HotReloader::poll()
+{
+    const auto now = std::chrono::steady_clock::now();
+    read_events(now);
+
+    // copied, since the callbacks may watch or unwatch files
+    std::vector<Watch> due;
+    for (auto &watch : m_watches)
+        if (watch.pending && now - watch.last_write >= m_options.debounce)
+        {
+            watch.pending = false;
+            due.push_back(watch);
+        }
+
+    // Reload each file once per DDSFile and hand the same event to all of its subscribers: after an in-place reload,
+    // a second one would find nothing changed. Skip subscribers that an earlier callback unwatched.
+    auto same    = [](const Watch &a, const Watch &b) { return a.dds == b.dds && a.path == b.path; };
+    auto watched = [&](const Watch &w)
+    { return std::any_of(m_watches.begin(), m_watches.end(), [&](const Watch &o) { return same(o, w); }); };
+
+    size_t reloaded = 0;
+    for (size_t i = 0; i < due.size(); ++i)
+    {
+        if (std::any_of(due.begin(), due.begin() + ptrdiff_t(i), [&](const Watch &w) { return same(w, due[i]); }) ||
+            !watched(due[i]))
+            continue;
+
+        ReloadEvent event;
+        reload(due[i], event);
+        ++reloaded;
+        for (size_t j = i; j < due.size(); ++j)
+            if (same(due[j], due[i]) && due[j].on_reload && watched(due[j]))
+                due[j].on_reload(event);
+    }
+    return reloaded;
+}
+
+void HotReloader::read_events(std::chrono::steady_clock::time_point now)
+{
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    ssize_t                     length;
+    while (m_inotify >= 0 && (length = ::read(m_inotify, buffer, sizeof(buffer))) > 0)
+        for (const char *p = buffer; p < buffer + length;)
+        {
+            const auto *event = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + event->len;
+            // after an overflow, events were lost, so assume that every file changed
+            const bool overflow = event->mask & IN_Q_OVERFLOW;
+            for (auto &watch : m_watches)
+                if (overflow || (watch.directory == event->wd && event->len && watch.name == event->name))
+                {
+                    watch.pending    = true;
+                    watch.last_write = now;
+                }
+        }
+#else
+    (void)now;
+#endif
+}
+
+void HotReloader::reload(Watch &watch, ReloadEvent &event)
+{
+    event.path = watch.path;
+    event.dds  = watch.dds;
+
+    RandomAccessFile file;
+    event.result = file.open(watch.path.c_str());
+    if (event.result.type == Result::Error)
+        return;
+    m_scratch.resize(size_t(file.size()));
+    event.result = file.read(0, file.size(), m_scratch.data());
+    if (event.result.type == Result::Error)
+        return;
+
+    // In place if the size and everything around the subresources (the headers, and any data after them) are
+    // unchanged. The data after them may differ if it is a valid metadata chunk, whose hashes and statistics follow the
+    // pixels: swap it in (which leaves the old one in the scratch buffer) and have read_metadata() check it.
+    DDSFile &dds = *watch.dds;
+    if (!dds.is_view() && !dds.image_data.empty() && m_scratch.size() == dds.dds.size())
+    {
+        const uint8_t *old   = dds.dds.data();
+        const uint8_t *fresh = m_scratch.data();
+        const auto    &last  = dds.image_data.back();
+        const size_t   begin = size_t(dds.image_data.front().bytes() - old);
+        const size_t   end   = size_t(last.bytes() - old) + last.chars.size();
+        bool           same  = std::memcmp(fresh, old, begin) == 0;
+        if (same && std::memcmp(fresh + end, old + end, m_scratch.size() - end) != 0)
+        {
+            std::swap_ranges(dds.dds.begin() + ptrdiff_t(end), dds.dds.end(), m_scratch.begin() + ptrdiff_t(end));
+            DDSFile::Metadata metadata;
+            same = dds.read_metadata(metadata).type != Result::Error;
+            if (!same)
+                std::swap_ranges(dds.dds.begin() + ptrdiff_t(end), dds.dds.end(), m_scratch.begin() + ptrdiff_t(end));
+        }
+        if (same)
+        {
+            event.in_place = true;
+            for (uint32_t a = 0; a < dds.array_size(); ++a)
+                for (uint32_t m = 0; m < dds.mip_count(); ++m)
+                {
+                    const auto  *image  = dds.get_image_data(m, a);
+                    const size_t offset = size_t(image->bytes() - old);
+                    if (std::memcmp(fresh + offset, old + offset, image->chars.size()) != 0)
+                    {
+                        std::memcpy(dds.dds.data() + offset, fresh + offset, image->chars.size());
+                        event.changed.push_back({m, a});
+                    }
+                }
+            return;
+        }
+    }
+
+    // Parse the new contents on the side, so that a broken file leaves `dds` as it was
+    DDSFile fresh;
+    event.result = fresh.load(m_scratch.data(), m_scratch.size());
+    if (event.result.type == Result::Error)
+        return;
+    auto populated = fresh.populate_image_data();
+    if (populated.type != Result::Success || !populated.message.empty())
+        event.result.add_message(populated.type, populated.message);
+    if (event.result.type == Result::Error)
+        return;
+
+    dds = std::move(fresh);
+    for (uint32_t a = 0; a < dds.array_size(); ++a)
+        for (uint32_t m = 0; m < dds.mip_count(); ++m) event.changed.push_back({m, a});
+}
+
+} // namespace smalldds
+
+#endif // SMALLDDS_IMPLEMENTATION
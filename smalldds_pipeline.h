@@ -0,0 +1,1124 @@
+//
+// smalldds_pipeline - Multi-stage batch conversion of DDS files.
+//
+// Copyright (c) 2025 Wojciech Jarosz. Distributed under the
+// Apache 2.0 License (https://opensource.org/license/apache-2-0)
+//
+
+/** @file smalldds_pipeline.h
+
+    Like smalldds.h, the implementation is compiled into exactly one translation unit, together with that of
+    smalldds_sampler.h, which this header includes:
+    @code
+    #define SMALLDDS_IMPLEMENTATION
+    #include "smalldds_pipeline.h"
+    @endcode
+*/
+
+#pragma once
+
+#include "smalldds_sampler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Bumped whenever the pipeline may produce different output for the same source and settings, which invalidates the
+/// entries of a ConversionCache
+#define SMALLDDS_PIPELINE_VERSION 2
+
+namespace smalldds
+{
+
+/** A bounded multi-producer, multi-consumer FIFO queue.
+
+    try_push() and try_pop() are lock-free: the queue is a ring of slots whose sequence numbers tell producers and
+    consumers whose turn it is. push() and pop() block while the queue is full or empty, which gives backpressure: a
+    fast producer stalls instead of buffering without bound. Blocked threads sleep on a condition variable, which the
+    lock-free operations only touch while a thread is waiting.
+*/
+template <typename T>
+class BoundedQueue
+{
+public:
+    /// The capacity is rounded up to a power of two, and to at least 2
+    explicit BoundedQueue(size_t capacity);
+    BoundedQueue(const BoundedQueue &)            = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /// Move `value` into the queue, or return false if it is full
+    bool try_push(T &value);
+    /// Move the oldest value into `value`, or return false if the queue is empty
+    bool try_pop(T &value);
+    /// Wait for room and push `value`; returns false (dropping `value`) if the queue is closed
+    bool push(T value);
+    /// Wait for a value; returns false once the queue is closed and empty
+    bool pop(T &value);
+    /// From now on pushes fail, and pops fail once the queue is empty; wakes all waiting threads
+    void close();
+
+    bool   is_closed() const { return m_closed.load(); }
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T                   value;
+    };
+
+    bool can_push() const;
+    bool can_pop() const;
+    template <typename Ready>
+    void wait(Ready ready);
+    void notify();
+
+    std::unique_ptr<Slot[]>         m_slots;
+    size_t                          m_mask;
+    alignas(64) std::atomic<size_t> m_tail{0}; ///< Position of the next push
+    alignas(64) std::atomic<size_t> m_head{0}; ///< Position of the next pop
+    std::atomic<bool>               m_closed{false};
+    std::atomic<uint32_t>           m_waiting{0};
+    std::mutex                      m_mutex;
+    std::condition_variable         m_changed;
+};
+
+/// A texture decoded to RGBA floats, as it travels from the decode to the encode stage of a ConversionPipeline
+struct FloatTexture
+{
+    struct Image
+    {
+        uint32_t           width = 0, height = 0, depth = 0;
+        std::vector<float> rgba; ///< width * height * depth RGBA texels in row-major order
+    };
+
+    DDSFile::DXGIFormat format     = DDSFile::Format_Unknown; ///< Format of the source file
+    bool                srgb       = false;                   ///< Whether the texels are sRGB-encoded
+    bool                cubemap    = false;
+    uint32_t            mip_count  = 0;
+    uint32_t            array_size = 0; ///< Number of array slices, counting each cube face
+    std::vector<Image>  images;         ///< The mips of slice 0, then those of slice 1, and so on
+
+    Image       &image(uint32_t mip, uint32_t array) { return images[size_t(array) * mip_count + mip]; }
+    const Image &image(uint32_t mip, uint32_t array) const { return images[size_t(array) * mip_count + mip]; }
+};
+
+/// How generate_mips() adjusts each box-filtered mip
+struct MipOptions
+{
+    /// Renormalize the normals in RGB, which are stored as n * 0.5 + 0.5, or as is if `signed_normals`
+    bool normal_map     = false;
+    bool signed_normals = false;
+    bool reconstruct_z  = false; ///< With normal_map, first compute z from x and y (for two-channel normal maps)
+    /// With normal_map, alpha holds perceptual roughness, which each mip widens by the spread of the normals it
+    /// averages (Toksvig). Swizzle alpha to 0 to store just that widening.
+    bool toksvig = false;
+    /// If positive, scale the alpha of each mip so that the same fraction of its texels passes an alpha test against
+    /// alpha_cutoff as in the base mip, which keeps alpha-tested foliage from thinning out. Ignored with toksvig.
+    float alpha_cutoff = 0.f;
+    /// RGB is sRGB-encoded: average it in linear light, like resample_rgba() (alpha is linear). Ignored with
+    /// normal_map.
+    bool     srgb        = false;
+    uint32_t num_threads = 0; ///< 0 uses all hardware threads
+};
+
+/// What a ConversionPipeline does to a texture
+struct ConversionSettings
+{
+    /// Output format: one supported by quantize_rgba() or encode_bc_block(), or Format_Unknown for that of the source
+    DDSFile::DXGIFormat format    = DDSFile::Format_Unknown;
+    bool                select_bc = false; ///< Instead of `format`, use select_bc_format() on the base mips
+    BCSelectOptions     bc;                ///< Used with select_bc; the encode stage ignores bc.num_threads
+
+    /// Resample the base mips to this size with `resize_filter` (in linear light for sRGB), dropping the other mips. If
+    /// only one of them is set, the other follows the aspect ratio; if neither is, the size is kept.
+    uint32_t       resize_width  = 0;
+    uint32_t       resize_height = 0;
+    ResampleFilter resize_filter = ResampleFilter::Mitchell;
+
+    uint32_t max_size      = 0;     ///< Halve textures until width and height are at most this; 0 for no limit
+    bool     generate_mips = false; ///< Replace the mips of the source by a full chain of box-filtered mips
+    /// Adjustments of the generated mips. signed_normals is taken from the source format, and num_threads is ignored.
+    MipOptions mips;
+    /// The source channel of each output channel: 0-3 for R, G, B and A, 4 for a constant 0 and 5 for a constant 1
+    uint8_t swizzle[4] = {0, 1, 2, 3};
+    /// Append a metadata chunk with the hashes and statistics of the output and these settings (see
+    /// DDSWriter::add_metadata())
+    bool metadata = false;
+
+    /// Optional; runs at the end of the transform stage, from one of its threads
+    std::function<Result(FloatTexture &)> transform;
+    /// Identifies `transform` (including its version) in the keys of a ConversionCache; jobs with a transform but no
+    /// transform_id are not cached
+    std::string transform_id;
+};
+
+/// A file to convert
+struct ConversionJob
+{
+    std::string        input;  ///< Path of the source DDS file
+    std::string        output; ///< Path of the converted DDS file
+    ConversionSettings settings;
+};
+
+/** A directory of converted files, keyed by the contents of their source file, the conversion settings and
+    SMALLDDS_PIPELINE_VERSION, so that unchanged sources need no conversion.
+
+    Files are placed in and taken from the cache by reflink (a copy-on-write clone) where the file system supports
+    it, otherwise by copy, or by hard link if enabled. A hard link shares the file with the cache, so any tool that
+    modifies a file taken from it in place corrupts the cache entry; ConversionPipeline itself removes an existing
+    output file before writing it.
+    Entries are added atomically, so several processes may share a cache. Nothing is ever evicted: delete the
+    directory to clear the cache.
+*/
+class ConversionCache
+{
+public:
+    /// Use (and create if needed) the cache in `directory`; with `hard_links`, files that can't be reflinked are hard
+    /// linked instead of copied
+    explicit ConversionCache(std::string directory, bool hard_links = false);
+
+    /// The key of converting the source file contents `data` with `settings`, or an empty string if they can't be
+    /// keyed (a transform without a transform_id)
+    static std::string key(const uint8_t *data, size_t size, const ConversionSettings &settings);
+
+    /// Put the cached file for `key` at `path`, replacing any file there. Returns false if there is none.
+    bool   fetch(const std::string &key, const std::string &path) const;
+    /// Add the file at `path` to the cache under `key`
+    Result store(const std::string &key, const std::string &path) const;
+
+    const std::string &directory() const { return m_directory; }
+
+private:
+    std::string entry(const std::string &key) const;
+    bool        place(const std::string &from, const std::string &to) const;
+
+    std::string m_directory;
+    bool        m_hard_links;
+};
+
+struct PipelineOptions
+{
+    // Threads of each stage; 0 uses the number of hardware threads
+    uint32_t read_threads      = 2; ///< Reads and parses the source files
+    uint32_t decode_threads    = 0; ///< Decodes them with DDSFile::decode()
+    uint32_t transform_threads = 0; ///< Resizes, swizzles, generates mips and runs ConversionSettings::transform
+    uint32_t encode_threads    = 0; ///< Quantizes or block-compresses the result
+    uint32_t write_threads     = 2; ///< Writes the output files
+
+    size_t queue_capacity = 4; ///< Textures that may wait between two stages
+
+    /// If not empty, take the outputs of unchanged sources from a ConversionCache in this directory, and add new ones
+    std::string cache_directory;
+    bool        cache_hard_links = false; ///< See ConversionCache::ConversionCache()
+
+    /// Optional; called from a pipeline thread as each job finishes, with its index and result
+    std::function<void(size_t job, const Result &)> on_complete;
+};
+
+/** Converts DDS files in five stages: read, decode, transform, encode and write.
+
+    Each stage has its own threads, and passes textures to the next stage through a BoundedQueue. Reading and writing
+    thus overlap with decoding and encoding, and backpressure from a full queue stalls the stages before it, so memory
+    stays bounded by the textures in the queues and those being worked on. A job that fails skips the remaining
+    stages.
+
+    Usage example:
+    @code
+    PipelineOptions options;
+    options.on_complete = [](size_t job, const Result &r) { if (r.type == Result::Error) report(job, r.message); };
+
+    ConversionPipeline pipeline(options);
+    for (const auto &path : paths)
+    {
+        ConversionJob job{path, output_path(path)};
+        job.settings.select_bc     = true;
+        job.settings.generate_mips = true;
+        pipeline.submit(std::move(job)); // blocks while the pipeline is backed up
+    }
+    auto results = pipeline.finish();
+    @endcode
+*/
+class ConversionPipeline
+{
+public:
+    explicit ConversionPipeline(const PipelineOptions &options = PipelineOptions{});
+    /// Finishes the submitted jobs
+    ~ConversionPipeline();
+    ConversionPipeline(const ConversionPipeline &)            = delete;
+    ConversionPipeline &operator=(const ConversionPipeline &) = delete;
+
+    /// Queue a job, waiting while the read stage is backed up, and return its index (the order of submission)
+    size_t submit(ConversionJob job);
+    /// Wait for all submitted jobs and return their results by index. Jobs submitted afterwards fail.
+    std::vector<Result> finish();
+
+private:
+    enum Stage : uint32_t
+    {
+        Read,
+        Decode,
+        Transform,
+        Encode,
+        Write,
+        NumStages
+    };
+
+    struct Item
+    {
+        size_t        index = 0;
+        ConversionJob job;
+        DDSFile       source;
+        FloatTexture  texture;
+        DDSWriter     output;
+        std::string   cache_key;               ///< Empty if the job isn't cached
+        bool          cached = false;          ///< The output came from the cache, so the other stages are skipped
+        Result        result{Result::Success}; ///< Info and warnings of the stages so far
+    };
+    using Queue = BoundedQueue<std::unique_ptr<Item>>;
+
+    void run_stage(Stage stage);
+    void complete(Item &item);
+
+    PipelineOptions                  m_options;
+    std::unique_ptr<ConversionCache> m_cache;              ///< Null without PipelineOptions::cache_directory
+    std::unique_ptr<Queue>           m_queues[NumStages];  ///< m_queues[s] feeds stage s
+    std::atomic<uint32_t>            m_running[NumStages]; ///< Threads of each stage that haven't exited yet
+    std::vector<std::thread>         m_threads;
+    std::mutex                       m_mutex;
+    std::vector<Result>              m_results;
+};
+
+/// Average 2x2 (or 2x2x2 for volumes) blocks of texels, halving each dimension larger than 1. With `srgb`, RGB is
+/// sRGB-encoded and averaged in linear light.
+FloatTexture::Image downsample_box(const FloatTexture::Image &image, bool srgb = false);
+
+/// Build a chain of `count` mips, starting with `base`, with downsample_box() and the adjustments in `options`. Each
+/// mip is filtered from the plain box-filtered mip above it, so adjustments don't compound, and the filtering and
+/// adjustment of a mip share one parallel pass over its rows.
+std::vector<FloatTexture::Image> generate_mips(FloatTexture::Image base, uint32_t count,
+                                               const MipOptions &options = MipOptions{});
+
+/// Resize each depth slice of an image with resample_rgba()
+FloatTexture::Image resample_image(const FloatTexture::Image &image, uint32_t width, uint32_t height,
+                                   const ResampleOptions &options = ResampleOptions{});
+
+//
+// Template implementations
+//
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity)
+{
+    // a single slot would look free again to the next push before it has been popped
+    size_t size = 2;
+    while (size < capacity) size *= 2;
+    m_slots.reset(new Slot[size]);
+    m_mask = size - 1;
+    for (size_t i = 0; i < size; ++i) m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+bool BoundedQueue<T>::try_push(T &value)
+{
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Slot     &slot = m_slots[pos & m_mask];
+        ptrdiff_t diff = ptrdiff_t(slot.sequence.load(std::memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                slot.value = std::move(value);
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                notify();
+                return true;
+            }
+        }
+        else if (diff < 0)
+            return false; // the slot still holds the value from one lap ago
+        else
+            pos = m_tail.load(std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+bool BoundedQueue<T>::try_pop(T &value)
+{
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Slot     &slot = m_slots[pos & m_mask];
+        ptrdiff_t diff = ptrdiff_t(slot.sequence.load(std::memory_order_acquire) - (pos + 1));
+        if (diff == 0)
+        {
+            if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                value      = std::move(slot.value);
+                slot.value = T(); // release what the moved-from value may still hold
+                slot.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                notify();
+                return true;
+            }
+        }
+        else if (diff < 0)
+            return false; // the slot hasn't been filled yet
+        else
+            pos = m_head.load(std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+bool BoundedQueue<T>::push(T value)
+{
+    for (;;)
+    {
+        if (m_closed.load())
+            return false;
+        if (try_push(value))
+            return true;
+        wait([this] { return m_closed.load() || can_push(); });
+    }
+}
+
+template <typename T>
+bool BoundedQueue<T>::pop(T &value)
+{
+    for (;;)
+    {
+        if (try_pop(value))
+            return true;
+        if (m_closed.load() && !can_pop())
+            return false;
+        wait([this] { return m_closed.load() || can_pop(); });
+    }
+}
+
+template <typename T>
+void BoundedQueue<T>::close()
+{
+    m_closed.store(true);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_changed.notify_all();
+}
+
+template <typename T>
+bool BoundedQueue<T>::can_push() const
+{
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    return ptrdiff_t(m_slots[pos & m_mask].sequence.load(std::memory_order_acquire) - pos) >= 0;
+}
+
+template <typename T>
+bool BoundedQueue<T>::can_pop() const
+{
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    return ptrdiff_t(m_slots[pos & m_mask].sequence.load(std::memory_order_acquire) - (pos + 1)) >= 0;
+}
+
+template <typename T>
+template <typename Ready>
+void BoundedQueue<T>::wait(Ready ready)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_waiting.fetch_add(1);
+    // Pairs with the fence in notify(): either the waker sees m_waiting > 0, or `ready` sees its change
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    m_changed.wait(lock, ready);
+    m_waiting.fetch_sub(1);
+}
+
+template <typename T>
+void BoundedQueue<T>::notify()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiting.load(std::memory_order_relaxed) == 0)
+        return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_changed.notify_all();
+}
+
+} // namespace smalldds
+
+#ifdef SMALLDDS_IMPLEMENTATION
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <random>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
+
+namespace smalldds
+{
+
+namespace detail
+{
+
+inline FloatTexture::Image half_size(const FloatTexture::Image &image)
+{
+    FloatTexture::Image out;
+    out.width  = std::max(1u, image.width / 2);
+    out.height = std::max(1u, image.height / 2);
+    out.depth  = std::max(1u, image.depth / 2);
+    out.rgba.resize(4 * size_t(out.width) * out.height * out.depth);
+    return out;
+}
+
+/// Box-filter rows [begin, end) of `out` (counting the rows of all its depth slices) from `image`. With an
+/// srgb_to_linear_table() as `srgb_table`, RGB is sRGB-encoded and averaged in linear light.
+inline void downsample_box_rows(const FloatTexture::Image &image, FloatTexture::Image &out, size_t begin, size_t end,
+                                const float *srgb_table = nullptr)
+{
+    // Odd dimensions drop their last texel; dimensions of 1 average the texel with itself
+    const uint32_t sx = image.width > 1 ? 2 : 1, sy = image.height > 1 ? 2 : 1, sz = image.depth > 1 ? 2 : 1;
+
+    const float weight = 1.f / float(sx * sy * sz);
+    float      *dst    = out.rgba.data() + 4 * begin * out.width;
+    for (size_t row = begin; row < end; ++row)
+    {
+        const uint32_t z = uint32_t(row / out.height), y = uint32_t(row % out.height);
+        for (uint32_t x = 0; x < out.width; ++x, dst += 4)
+        {
+            float sum[4] = {0.f, 0.f, 0.f, 0.f};
+            for (uint32_t dz = 0; dz < sz; ++dz)
+                for (uint32_t dy = 0; dy < sy; ++dy)
+                {
+                    const float *src =
+                        image.rgba.data() +
+                        4 * ((size_t(z * sz + dz) * image.height + (y * sy + dy)) * image.width + x * sx);
+                    for (uint32_t dx = 0; dx < sx; ++dx, src += 4)
+                        for (int c = 0; c < 4; ++c)
+                            sum[c] += c < 3 && srgb_table ? srgb_to_linear_lookup(src[c], srgb_table) : src[c];
+                }
+            for (int c = 0; c < 4; ++c) dst[c] = sum[c] * weight;
+            if (srgb_table)
+                for (int c = 0; c < 3; ++c) dst[c] = linear_to_srgb(dst[c]);
+        }
+    }
+}
+
+/// Number of texels of `image` whose alpha, multiplied by `scale`, is at least `cutoff`
+inline size_t alpha_coverage(const FloatTexture::Image &image, float cutoff, float scale, uint32_t num_threads)
+{
+    constexpr size_t    band = 16;
+    const size_t        rows = size_t(image.height) * image.depth;
+    std::vector<size_t> counts((rows + band - 1) / band, 0);
+    parallel_for(
+        0, counts.size(),
+        [&](size_t b)
+        {
+            const float *a   = image.rgba.data() + 4 * b * band * image.width + 3;
+            const float *end = image.rgba.data() + 4 * std::min(rows, (b + 1) * band) * image.width;
+            size_t       n   = 0;
+            for (; a < end; a += 4) n += *a * scale >= cutoff;
+            counts[b] = n;
+        },
+        num_threads);
+    return std::accumulate(counts.begin(), counts.end(), size_t(0));
+}
+
+/// The scale of the alphas of `image` that lets `target` texels pass the alpha test, by bisection
+inline float alpha_scale(const FloatTexture::Image &image, float cutoff, size_t target, uint32_t num_threads)
+{
+    // coverage grows with the scale: bracket the target between lo (too few texels pass) and hi (enough do)
+    float  lo = 0.f, hi = 1.f;
+    size_t below = 0, above = alpha_coverage(image, cutoff, hi, num_threads);
+    while (above < target && hi < 1024.f)
+    {
+        lo = hi, below = above, hi *= 2.f;
+        above = alpha_coverage(image, cutoff, hi, num_threads);
+    }
+    if (above < target)
+        return hi;
+    for (int i = 0; i < 12; ++i)
+    {
+        const float  mid    = 0.5f * (lo + hi);
+        const size_t passed = alpha_coverage(image, cutoff, mid, num_threads);
+        if (passed < target)
+            lo = mid, below = passed;
+        else
+            hi = mid, above = passed;
+    }
+    return target - below < above - target ? lo : hi;
+}
+
+/// Renormalize the normals of `count` texels, and widen the roughness in alpha by their shortening if `toksvig`
+inline void adjust_normals(float *rgba, size_t count, const MipOptions &options)
+{
+    const float scale = options.signed_normals ? 1.f : 2.f, bias = options.signed_normals ? 0.f : -1.f;
+    for (float *t = rgba; t < rgba + 4 * count; t += 4)
+    {
+        float       n[3]   = {t[0] * scale + bias, t[1] * scale + bias, t[2] * scale + bias};
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 1e-6f)
+            for (auto &c : n) c /= length;
+        else
+            n[0] = n[1] = 0.f, n[2] = 1.f;
+        for (int c = 0; c < 3; ++c) t[c] = (n[c] - bias) / scale;
+
+        if (options.toksvig)
+        {
+            // Toksvig's factor shrinks the Blinn-Phong exponent of the GGX lobe (alpha = roughness^2) as averaging
+            // shortens the normal
+            const float len      = std::min(std::max(length, 1e-4f), 1.f);
+            const float alpha    = std::max(t[3] * t[3], 1e-4f);
+            const float exponent = 2.f / (alpha * alpha) - 2.f;
+            const float factor   = len / (len + exponent * (1.f - len));
+            t[3]                 = std::sqrt(std::sqrt(2.f / (factor * exponent + 2.f)));
+        }
+    }
+}
+
+} // namespace detail
+
+FloatTexture::Image downsample_box(const FloatTexture::Image &image, bool srgb)
+{
+    auto out = detail::half_size(image);
+    detail::downsample_box_rows(image, out, 0, size_t(out.height) * out.depth,
+                                srgb ? detail::srgb_to_linear_table() : nullptr);
+    return out;
+}
+
+std::vector<FloatTexture::Image> generate_mips(FloatTexture::Image base, uint32_t count, const MipOptions &options)
+{
+    std::vector<FloatTexture::Image> mips;
+    if (!count)
+        return mips;
+
+    const bool   coverage   = options.alpha_cutoff > 0.f && !(options.normal_map && options.toksvig);
+    const bool   adjust     = options.normal_map || coverage;
+    const float *srgb_table = options.srgb && !options.normal_map ? detail::srgb_to_linear_table() : nullptr;
+
+    constexpr size_t band = 16;
+    if (options.normal_map && options.reconstruct_z)
+    {
+        const float  scale = options.signed_normals ? 1.f : 2.f, bias = options.signed_normals ? 0.f : -1.f;
+        const size_t rows  = size_t(base.height) * base.depth;
+        parallel_for(
+            0, (rows + band - 1) / band,
+            [&](size_t b)
+            {
+                float *t   = base.rgba.data() + 4 * b * band * base.width;
+                float *end = base.rgba.data() + 4 * std::min(rows, (b + 1) * band) * base.width;
+                for (; t < end; t += 4)
+                {
+                    const float x = t[0] * scale + bias, y = t[1] * scale + bias;
+                    t[2]          = (std::sqrt(std::max(0.f, 1.f - x * x - y * y)) - bias) / scale;
+                }
+            },
+            options.num_threads);
+    }
+    const size_t target = coverage ? detail::alpha_coverage(base, options.alpha_cutoff, 1.f, options.num_threads) : 0;
+    const size_t base_texels = size_t(base.width) * base.height * base.depth;
+
+    mips.push_back(std::move(base));
+    FloatTexture::Image average; // the plain box-filtered previous mip, when mips holds adjusted ones
+    for (uint32_t m = 1; m < count; ++m)
+    {
+        const auto &above = adjust && m > 1 ? average : mips.back();
+        auto        next  = detail::half_size(above);
+        auto        out   = adjust ? detail::half_size(above) : FloatTexture::Image{};
+
+        const size_t rows = size_t(next.height) * next.depth;
+        parallel_for(
+            0, (rows + band - 1) / band,
+            [&](size_t b)
+            {
+                const size_t begin = b * band, end = std::min(rows, begin + band);
+                detail::downsample_box_rows(above, next, begin, end, srgb_table);
+                if (!adjust)
+                    return;
+                const size_t first = 4 * begin * next.width, last = 4 * end * next.width;
+                std::copy(next.rgba.begin() + first, next.rgba.begin() + last, out.rgba.begin() + first);
+                if (options.normal_map)
+                    detail::adjust_normals(out.rgba.data() + first, (last - first) / 4, options);
+            },
+            options.num_threads);
+
+        if (coverage)
+        {
+            // as many texels pass the alpha test as in the base mip, in proportion
+            const size_t texels = size_t(next.width) * next.height * next.depth;
+            const size_t wanted = size_t(std::llround(double(target) * texels / base_texels));
+            const float  scale  = detail::alpha_scale(next, options.alpha_cutoff, wanted, options.num_threads);
+            for (size_t i = 3; i < out.rgba.size(); i += 4) out.rgba[i] = std::min(next.rgba[i] * scale, 1.f);
+        }
+
+        if (adjust)
+        {
+            average = std::move(next);
+            mips.push_back(std::move(out));
+        }
+        else
+            mips.push_back(std::move(next));
+    }
+    return mips;
+}
+
+FloatTexture::Image resample_image(const FloatTexture::Image &image, uint32_t width, uint32_t height,
+                                   const ResampleOptions &options)
+{
+    FloatTexture::Image out;
+    out.width  = std::max(1u, width);
+    out.height = std::max(1u, height);
+    out.depth  = image.depth;
+    out.rgba.resize(4 * size_t(out.width) * out.height * out.depth);
+
+    const size_t src_slice = 4 * size_t(image.width) * image.height, dst_slice = 4 * size_t(out.width) * out.height;
+    for (uint32_t z = 0; z < image.depth; ++z)
+        resample_rgba(image.rgba.data() + src_slice * z, image.width, image.height, out.rgba.data() + dst_slice * z,
+                      out.width, out.height, options);
+    return out;
+}
+
+namespace detail
+{
+
+/// Clone `from` to the new file `to` if the file system supports copy-on-write
+inline bool reflink(const char *from, const char *to)
+{
+#if defined(__linux__) && defined(FICLONE)
+    int src = ::open(from, O_RDONLY);
+    if (src < 0)
+        return false;
+    int dst = ::open(to, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (dst < 0)
+    {
+        ::close(src);
+        return false;
+    }
+    bool cloned = ioctl(dst, FICLONE, src) == 0;
+    ::close(src);
+    ::close(dst);
+    if (!cloned)
+        ::unlink(to);
+    return cloned;
+#elif defined(__APPLE__)
+    return clonefile(from, to, 0) == 0;
+#else
+    (void)from;
+    (void)to;
+    return false;
+#endif
+}
+
+inline Result read_stage(ConversionJob &job, const ConversionCache *cache, DDSFile &source, std::string &cache_key,
+                         bool &cached)
+{
+    std::ifstream input(job.input, std::ios_base::binary | std::ios_base::ate);
+    if (!input.is_open())
+        return Result{Result::Error, "Cannot open file"};
+    std::vector<uint8_t> bytes(size_t(input.tellg()));
+    input.seekg(0, std::ios_base::beg);
+    input.read(reinterpret_cast<char *>(bytes.data()), std::streamsize(bytes.size()));
+    if (input.bad())
+        return Result{Result::Error, "Cannot read file: I/O error"};
+
+    if (cache)
+    {
+        cache_key = ConversionCache::key(bytes.data(), bytes.size(), job.settings);
+        if (!cache_key.empty() && cache->fetch(cache_key, job.output))
+        {
+            cached = true;
+            return Result{Result::Info, "ConversionPipeline: Output taken from the cache."};
+        }
+    }
+
+    auto res = source.load(std::move(bytes));
+    if (res.type == Result::Error)
+        return res;
+    auto populated = source.populate_image_data();
+    if (populated.type != Result::Success || !populated.message.empty())
+        res.add_message(populated.type, populated.message);
+    return res;
+}
+
+inline Result decode_stage(const DDSFile &source, FloatTexture &texture)
+{
+    texture.format     = source.format();
+    texture.srgb       = source.is_sRGB();
+    texture.cubemap    = source.is_cubemap;
+    texture.mip_count  = std::max(1u, source.mip_count());
+    texture.array_size = std::max(1u, source.array_size());
+    texture.images.resize(size_t(texture.mip_count) * texture.array_size);
+    for (uint32_t a = 0; a < texture.array_size; ++a)
+        for (uint32_t m = 0; m < texture.mip_count; ++m)
+        {
+            const auto *img = source.get_image_data(m, a);
+            if (!img)
+                return Result{Result::Error, "ConversionPipeline: Missing subresource in the source."};
+            auto &image  = texture.image(m, a);
+            image.width  = img->width;
+            image.height = img->height;
+            image.depth  = std::max(1u, img->depth);
+            image.rgba.resize(4 * size_t(image.width) * image.height * image.depth);
+            auto res = source.decode(image.rgba.data(), m, a);
+            if (res.type == Result::Error)
+                return res;
+        }
+    return Result{Result::Success};
+}
+
+inline Result transform_stage(const ConversionSettings &settings, FloatTexture &texture)
+{
+    auto keep_mips = [&](uint32_t first, uint32_t count)
+    {
+        std::vector<FloatTexture::Image> images;
+        for (uint32_t a = 0; a < texture.array_size; ++a)
+            for (uint32_t m = first; m < first + count; ++m) images.push_back(std::move(texture.image(m, a)));
+        texture.images    = std::move(images);
+        texture.mip_count = count;
+    };
+
+    if ((settings.resize_width || settings.resize_height) && !texture.images.empty())
+    {
+        const auto &base   = texture.images[0];
+        uint32_t    width  = settings.resize_width, height = settings.resize_height;
+        if (!width)
+            width = uint32_t(std::lround(double(base.width) * height / base.height));
+        if (!height)
+            height = uint32_t(std::lround(double(base.height) * width / base.width));
+
+        ResampleOptions options;
+        options.filter      = settings.resize_filter;
+        options.srgb        = texture.srgb;
+        options.num_threads = 1; // the transform stage has threads of its own
+        keep_mips(0, 1);
+        for (auto &image : texture.images) image = resample_image(image, width, height, options);
+    }
+
+    // Use the largest source mip that fits, or halve the smallest one
+    auto too_large = [&](const FloatTexture::Image &image)
+    { return settings.max_size && std::max(image.width, image.height) > settings.max_size; };
+    while (!texture.images.empty() && too_large(texture.images[0]))
+    {
+        if (texture.mip_count > 1)
+            keep_mips(1, texture.mip_count - 1);
+        else
+            for (auto &image : texture.images) image = downsample_box(image, texture.srgb);
+    }
+
+    static const uint8_t identity[4] = {0, 1, 2, 3};
+    if (!std::equal(settings.swizzle, settings.swizzle + 4, identity))
+        for (auto &image : texture.images)
+            for (size_t i = 0; i < image.rgba.size(); i += 4)
+            {
+                const float src[6] = {image.rgba[i], image.rgba[i + 1], image.rgba[i + 2], image.rgba[i + 3], 0.f, 1.f};
+                for (int c = 0; c < 4; ++c) image.rgba[i + c] = src[std::min<uint8_t>(settings.swizzle[c], 5)];
+            }
+
+    if (settings.generate_mips && !texture.images.empty())
+    {
+        const auto &base  = texture.images[0];
+        uint32_t    count = 1;
+        for (uint32_t size = std::max({base.width, base.height, base.depth}); size > 1; size /= 2) ++count;
+        keep_mips(0, 1);
+
+        MipOptions options     = settings.mips;
+        options.signed_normals = std::strstr(format_name(texture.format), "SNorm") != nullptr;
+        options.srgb           = texture.srgb;
+        options.num_threads    = 1; // the transform stage has threads of its own
+        std::vector<FloatTexture::Image> images;
+        for (auto &image : texture.images)
+            for (auto &mip : generate_mips(std::move(image), count, options)) images.push_back(std::move(mip));
+        texture.images    = std::move(images);
+        texture.mip_count = count;
+    }
+
+    if (settings.transform)
+        return settings.transform(texture);
+    return Result{Result::Success};
+}
+
+/// Every setting that affects the output, with exact (hexadecimal) floats
+inline std::string settings_text(const ConversionSettings &settings)
+{
+    char text[512];
+    std::snprintf(text, sizeof(text), "%d %u %d %a %a %d %d %u %u %u %u %d %d %d %d %a %u %u %u %u %d ",
+                  SMALLDDS_PIPELINE_VERSION, uint32_t(settings.format), int(settings.select_bc),
+                  double(settings.bc.max_rmse), double(settings.bc.sample_fraction), int(settings.bc.srgb),
+                  int(settings.bc.allow_bc7), settings.resize_width, settings.resize_height,
+                  uint32_t(settings.resize_filter), settings.max_size, int(settings.generate_mips),
+                  int(settings.mips.normal_map), int(settings.mips.reconstruct_z), int(settings.mips.toksvig),
+                  double(settings.mips.alpha_cutoff), uint32_t(settings.swizzle[0]), uint32_t(settings.swizzle[1]),
+                  uint32_t(settings.swizzle[2]), uint32_t(settings.swizzle[3]), int(settings.metadata));
+    return text + settings.transform_id;
+}
+
+inline Result encode_stage(const ConversionSettings &settings, const FloatTexture &texture, DDSWriter &out)
+{
+    if (texture.images.empty())
+        return Result{Result::Error, "ConversionPipeline: The texture has no images."};
+    const auto &base = texture.images[0];
+
+    auto fmt = settings.format == DDSFile::Format_Unknown ? texture.format : settings.format;
+    if (settings.select_bc)
+    {
+        // the base mips of all slices, stacked vertically
+        std::vector<float> stacked;
+        for (uint32_t a = 0; a < texture.array_size; ++a)
+        {
+            const auto &rgba = texture.image(0, a).rgba;
+            stacked.insert(stacked.end(), rgba.begin(), rgba.end());
+        }
+        BCSelectOptions select = settings.bc;
+        select.srgb |= texture.srgb;
+        select.num_threads = 1;
+
+        const uint32_t rows = uint32_t(size_t(base.height) * base.depth * texture.array_size);
+        fmt                 = select_bc_format(stacked.data(), base.width, rows, select);
+    }
+
+    const bool compressed = DDSFile::is_compressed(fmt);
+    float      probe[64]  = {};
+    uint8_t    block[16];
+    if (compressed && !encode_bc_block(fmt, probe, block))
+        return Result{Result::Error,
+                      std::string("ConversionPipeline: Cannot encode format ") + format_name(fmt) + "."};
+
+    auto res = out.init(fmt, base.width, base.height, base.depth, texture.mip_count,
+                        texture.cubemap ? texture.array_size / 6 : texture.array_size, texture.cubemap);
+    if (res.type == Result::Error)
+        return res;
+
+    for (uint32_t a = 0; a < texture.array_size; ++a)
+        for (uint32_t m = 0; m < texture.mip_count; ++m)
+        {
+            const auto  &image  = texture.image(m, a);
+            const size_t texels = size_t(image.width) * image.height;
+            uint8_t     *dst    = out.image_data(m, a);
+            if (!dst)
+                return Result{Result::Error, "ConversionPipeline: Mismatched mip dimensions."};
+            if (!compressed)
+            {
+                if (!quantize_rgba(image.rgba.data(), texels * image.depth, fmt, dst))
+                    return Result{Result::Error,
+                                  std::string("ConversionPipeline: Cannot encode format ") + format_name(fmt) + "."};
+                continue;
+            }
+            const size_t slice_bytes = DDSFile::surface_size(fmt, image.width, image.height);
+            for (uint32_t z = 0; z < image.depth; ++z)
+                encode_bc_image(image.rgba.data() + 4 * texels * z, image.width, image.height, fmt,
+                                dst + slice_bytes * z, 1);
+        }
+    if (settings.metadata)
+        return out.add_metadata(settings_text(settings), true, 1);
+    return Result{Result::Success};
+}
+
+inline Result write_stage(const ConversionCache *cache, const std::string &cache_key, const std::string &path,
+                          const DDSWriter &output)
+{
+    // replace rather than overwrite the file, which may be a hard link into a cache
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    auto res = output.save(path.c_str());
+    if (res.type != Result::Error && cache && !cache_key.empty())
+    {
+        auto stored = cache->store(cache_key, path);
+        if (stored.type != Result::Success)
+            res.add_message(stored.type, stored.message);
+    }
+    return res;
+}
+
+} // namespace detail
+
+ConversionCache::ConversionCache(std::string directory, bool hard_links) :
+    m_directory(std::move(directory)), m_hard_links(hard_links)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory, ec); // store() reports if this failed
+}
+
+std::string ConversionCache::key(const uint8_t *data, size_t size, const ConversionSettings &settings)
+{
+    if (settings.transform && settings.transform_id.empty())
+        return std::string();
+
+    const std::string id = detail::settings_text(settings);
+
+    const uint64_t settings_hash = detail::xxh64(reinterpret_cast<const uint8_t *>(id.data()), id.size(), 0);
+    const uint64_t source_hash   = detail::xxh64(data, size, settings_hash);
+    char           key[33];
+    std::snprintf(key, sizeof(key), "%016llx%016llx", (unsigned long long)source_hash,
+                  (unsigned long long)settings_hash);
+    return key;
+}
+
+bool ConversionCache::fetch(const std::string &key, const std::string &path) const
+{
+    std::error_code ec;
+    const auto      cached = entry(key);
+    if (!std::filesystem::is_regular_file(cached, ec))
+        return false;
+    std::filesystem::remove(path, ec);
+    return place(cached, path);
+}
+
+Result ConversionCache::store(const std::string &key, const std::string &path) const
+{
+    // readers never see a partial entry: place the file under a unique name first, then rename it
+    static std::atomic<uint32_t> counter{0};
+    const auto                   cached = entry(key);
+    const auto temp = cached + "." + std::to_string(std::random_device{}()) + "-" + std::to_string(counter++) + ".tmp";
+
+    std::error_code ec;
+    bool            stored = place(path, temp);
+    if (stored)
+    {
+        std::filesystem::rename(temp, cached, ec);
+        stored = !ec;
+    }
+    // left over if the rename failed, or if it was a no-op because both names already linked to the same file
+    std::filesystem::remove(temp, ec);
+    if (!stored)
+        return Result{Result::Warning, "ConversionCache: Cannot add " + path + " to " + m_directory};
+    return Result{Result::Success};
+}
+
+std::string ConversionCache::entry(const std::string &key) const
+{
+    return (std::filesystem::path(m_directory) / (key + ".dds")).string();
+}
+
+bool ConversionCache::place(const std::string &from, const std::string &to) const
+{
+    if (detail::reflink(from.c_str(), to.c_str()))
+        return true;
+    std::error_code ec;
+    if (m_hard_links)
+    {
+        std::filesystem::create_hard_link(from, to, ec);
+        if (!ec)
+            return true;
+    }
+    return std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing, ec);
+}
+
+ConversionPipeline::ConversionPipeline(const PipelineOptions &options) : m_options(options)
+{
+    const uint32_t hw       = std::max(1u, std::thread::hardware_concurrency());
+    const uint32_t counts[] = {options.read_threads, options.decode_threads, options.transform_threads,
+                               options.encode_threads, options.write_threads};
+    if (!options.cache_directory.empty())
+        m_cache = std::make_unique<ConversionCache>(options.cache_directory, options.cache_hard_links);
+    for (uint32_t s = 0; s < NumStages; ++s)
+    {
+        m_queues[s] = std::make_unique<Queue>(std::max<size_t>(1, options.queue_capacity));
+        m_running[s].store(counts[s] ? counts[s] : hw);
+    }
+    for (uint32_t s = 0; s < NumStages; ++s)
+        for (uint32_t t = 0, n = m_running[s].load(); t < n; ++t)
+            m_threads.emplace_back([this, s] { run_stage(Stage(s)); });
+}
+
+ConversionPipeline::~ConversionPipeline() { finish(); }
+
+size_t ConversionPipeline::submit(ConversionJob job)
+{
+    auto item = std::make_unique<Item>();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        item->index = m_results.size();
+        m_results.push_back(Result{Result::Success});
+    }
+    item->job          = std::move(job);
+    const size_t index = item->index;
+    if (!m_queues[Read]->push(std::move(item)))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_results[index] = Result{Result::Error, "ConversionPipeline: Job submitted after finish()."};
+    }
+    return index;
+}
+
+std::vector<Result> ConversionPipeline::finish()
+{
+    m_queues[Read]->close();
+    for (auto &thread : m_threads)
+        if (thread.joinable())
+            thread.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_results;
+}
+
+void ConversionPipeline::run_stage(Stage stage)
+{
+    std::unique_ptr<Item> item;
+    while (m_queues[stage]->pop(item))
+    {
+        Result res{Result::Success};
+        try
+        {
+            switch (stage)
+            {
+            case Read:
+                res = detail::read_stage(item->job, m_cache.get(), item->source, item->cache_key, item->cached);
+                break;
+            case Decode:
+                res          = detail::decode_stage(item->source, item->texture);
+                item->source = DDSFile{}; // no longer needed
+                break;
+            case Transform: res = detail::transform_stage(item->job.settings, item->texture); break;
+            case Encode:
+                res           = detail::encode_stage(item->job.settings, item->texture, item->output);
+                item->texture = FloatTexture{};
+                break;
+            default: res = detail::write_stage(m_cache.get(), item->cache_key, item->job.output, item->output); break;
+            }
+        }
+        catch (const std::bad_alloc &)
+        {
+            res = Result{Result::Error, "ConversionPipeline: Out of memory."};
+        }
+        catch (const std::exception &e)
+        {
+            res = Result{Result::Error, std::string("ConversionPipeline: ") + e.what()};
+        }
+
+        if (res.type != Result::Success || !res.message.empty())
+            item->result.add_message(res.type, res.message);
+        if (res.type == Result::Error || stage == Write || item->cached)
+            complete(*item);
+        else
+            m_queues[stage + 1]->push(std::move(item));
+        item.reset();
+    }
+
+    // the last thread of a stage closes the queue to the next one
+    if (m_running[stage].fetch_sub(1) == 1 && stage + 1 < NumStages)
+        m_queues[stage + 1]->close();
+}
+
+void ConversionPipeline::complete(Item &item)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_results[item.index] = item.result;
+    }
+    if (m_options.on_complete)
+        m_options.on_complete(item.index, item.result);
+}
+
+} // namespace smalldds
+
+#endif // SMALLDDS_IMPLEMENTATION
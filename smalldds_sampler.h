@@ -0,0 +1,1920 @@
+//
+// smalldds_sampler - CPU texture sampling and image processing on top of smalldds.
+//
+// Copyright (c) 2025 Wojciech Jarosz. Distributed under the
+// Apache 2.0 License (https://opensource.org/license/apache-2-0)
+//
+
+#pragma once
+
+#include "smalldds.h"
+
+#include <memory>
+#include <mutex>
+
+namespace smalldds
+{
+
+enum class AddressMode : uint32_t
+{
+    Wrap,   ///< Repeat the texture
+    Clamp,  ///< Clamp to the edge texels
+    Mirror,     ///< Repeat the texture, flipping every other copy
+    Octahedral, ///< Mirror, and also flip the other axis across an edge when both axes use it (octahedral maps)
+};
+
+enum class FilterMode : uint32_t
+{
+    Point,     ///< Nearest texel of the nearest mip
+    Bilinear,  ///< Linear interpolation within the nearest mip (trilinear within the level for 3D textures)
+    Trilinear, ///< Bilinear filtering of the two nearest mips, linearly blended
+};
+
+struct SamplerOptions
+{
+    FilterMode  filter     = FilterMode::Trilinear;
+    AddressMode address[3] = {AddressMode::Wrap, AddressMode::Wrap, AddressMode::Wrap}; ///< For u, v, and w
+    Layout      layout     = {LayoutType::Tiled, 8}; ///< Layout of the decoded images (1D textures use Linear)
+};
+
+/** Point, bilinear and trilinear texture sampling of a DDSFile on the CPU.
+
+    The sampler works on 1D, 2D and 3D textures and texture arrays. Subresources are decoded to float RGBA with
+    DDSFile::decode() the first time they are accessed (or all at once with prefetch()), using the layout given in the
+    options to improve cache locality. Lookups are evaluated in batches of N coordinates in structure-of-arrays form;
+    the per-lane arithmetic is written as fixed-width loops so the compiler can vectorize it for the target ISA. NaN
+    coordinates and levels of detail act as 0, and infinite ones as very distant coordinates.
+
+    Usage example:
+    @code
+    Sampler sampler;
+    if (sampler.init(dds).type == Result::Error)
+        return;
+
+    Sampler::Coords<8> coords;
+    // ... fill in coords.u, coords.v, coords.lod
+    Sampler::Texels<8> texels;
+    sampler.sample(coords, texels);
+    @endcode
+
+    @note Sampling is thread-safe: concurrent lookups may trigger on-demand decoding, which happens exactly once per
+          subresource. The DDSFile must outlive the sampler, and populate_image_data() must have been called.
+ */
+class Sampler
+{
+public:
+    using Options = SamplerOptions;
+
+    /// A batch of N texture coordinates in structure-of-arrays form
+    template <int N>
+    struct Coords
+    {
+        float    u[N]     = {}; ///< Normalized texture coordinate along the width
+        float    v[N]     = {}; ///< Normalized texture coordinate along the height (ignored for 1D)
+        float    w[N]     = {}; ///< Normalized texture coordinate along the depth (only used for 3D)
+        float    lod[N]   = {}; ///< Mip level of detail, 0 is the base mip
+        uint32_t layer[N] = {}; ///< Array slice, clamped to the array size
+    };
+
+    /// A batch of N cubemap lookup directions in structure-of-arrays form
+    template <int N>
+    struct Directions
+    {
+        float    x[N]    = {}; ///< Lookup direction, need not be normalized
+        float    y[N]    = {};
+        float    z[N]    = {};
+        float    lod[N]  = {}; ///< Mip level of detail, 0 is the base mip
+        uint32_t cube[N] = {}; ///< Cube index within a cube array, clamped to the number of cubes
+    };
+
+    /// N filtered RGBA results in structure-of-arrays form
+    template <int N>
+    struct Texels
+    {
+        float r[N], g[N], b[N], a[N];
+    };
+
+    Result init(const DDSFile &dds, const Options &options = Options{});
+
+    /// Decode all subresources now instead of on first access.
+    Result prefetch() const;
+
+    template <int N>
+    void sample(const Coords<N> &coords, Texels<N> &out) const;
+
+    /// Sample a single location.
+    std::array<float, 4> sample(float u, float v = 0.f, float w = 0.f, float lod = 0.f, uint32_t layer = 0) const
+    {
+        Coords<1> c;
+        c.u[0]     = u;
+        c.v[0]     = v;
+        c.w[0]     = w;
+        c.lod[0]   = lod;
+        c.layer[0] = layer;
+        Texels<1> t;
+        sample(c, t);
+        return {t.r[0], t.g[0], t.b[0], t.a[0]};
+    }
+
+    /** Sample a cubemap (or cube array) by direction.
+
+        Selects the cube face for each direction using the D3D face order (+X, -X, +Y, -Y, +Z, -Z) and conventions.
+        Bilinear and trilinear filtering are seamless: taps that fall off the edge of a face are fetched from the
+        adjacent face. The address modes are ignored.
+    */
+    template <int N>
+    void sample_cube(const Directions<N> &dirs, Texels<N> &out) const;
+
+    /// Sample a cubemap in a single direction.
+    std::array<float, 4> sample_cube(float x, float y, float z, float lod = 0.f, uint32_t cube = 0) const
+    {
+        Directions<1> d;
+        d.x[0]    = x;
+        d.y[0]    = y;
+        d.z[0]    = z;
+        d.lod[0]  = lod;
+        d.cube[0] = cube;
+        Texels<1> t;
+        sample_cube(d, t);
+        return {t.r[0], t.g[0], t.b[0], t.a[0]};
+    }
+
+    /// Select the cube face for direction (x, y, z) and compute the [0,1] texture coordinates on that face.
+    static void cube_face_uv(float x, float y, float z, uint32_t &face, float &u, float &v)
+    {
+        float ax = std::abs(x), ay = std::abs(y), az = std::abs(z);
+        float ma, sc, tc;
+        if (ax >= ay && ax >= az)
+        {
+            face = x >= 0.f ? 0 : 1;
+            ma   = ax;
+            sc   = x >= 0.f ? -z : z;
+            tc   = -y;
+        }
+        else if (ay >= az)
+        {
+            face = y >= 0.f ? 2 : 3;
+            ma   = ay;
+            sc   = x;
+            tc   = y >= 0.f ? z : -z;
+        }
+        else
+        {
+            face = z >= 0.f ? 4 : 5;
+            ma   = az;
+            sc   = z >= 0.f ? x : -x;
+            tc   = -y;
+        }
+        float inv = ma > 0.f ? 0.5f / ma : 0.f;
+        u         = sc * inv + 0.5f;
+        v         = tc * inv + 0.5f;
+    }
+
+    /// The (unnormalized) direction through texture coordinates (u, v) of cube face `face`; inverse of cube_face_uv().
+    static void cube_direction(uint32_t face, float u, float v, float &x, float &y, float &z)
+    {
+        float s = 2.f * u - 1.f, t = 2.f * v - 1.f;
+        switch (face)
+        {
+        case 0: x = 1.f, y = -t, z = -s; break;
+        case 1: x = -1.f, y = -t, z = s; break;
+        case 2: x = s, y = 1.f, z = t; break;
+        case 3: x = s, y = -1.f, z = -t; break;
+        case 4: x = s, y = -t, z = 1.f; break;
+        default: x = -s, y = -t, z = -1.f; break;
+        }
+    }
+
+    const DDSFile *dds() const { return m_dds; }
+    const Options &options() const { return m_options; }
+
+    /// Decoded float RGBA texels of a subresource, laid out according to layout(mip); decodes on first access.
+    const float *image(uint32_t mip, uint32_t layer) const;
+
+    /// Layout of the decoded subresources of mip level `mip`
+    Layout layout(uint32_t mip) const { return m_mip_dims[mip][1] == 1 ? Layout{} : m_options.layout; }
+
+    /// Dimensions (width, height, depth) of mip level `mip`
+    const std::array<uint32_t, 3> &mip_dims(uint32_t mip) const { return m_mip_dims[mip]; }
+
+    /// Wrap, clamp or mirror integer texel coordinate `i` into [0, n); Octahedral mirrors along the single axis
+    static int address(int i, int n, AddressMode mode)
+    {
+        switch (mode)
+        {
+        case AddressMode::Clamp: return std::min(std::max(i, 0), n - 1);
+        case AddressMode::Mirror:
+        case AddressMode::Octahedral:
+        {
+            int p = i % (2 * n);
+            p     = p < 0 ? p + 2 * n : p;
+            return p < n ? p : 2 * n - 1 - p;
+        }
+        default:
+        {
+            int p = i % n;
+            return p < 0 ? p + n : p;
+        }
+        }
+    }
+
+private:
+    /// Unnormalized texel coordinate `x` limited to a range that converts to int safely; NaN becomes 0
+    static float finite_coord(float x) { return x == x ? std::min(std::max(x, -1e9f), 1e9f) : 0.f; }
+    /// address() of i[k] + d for each lane k, with the address mode resolved outside the lane loop
+    template <int N>
+    static void address_lanes(const int i[N], int d, const uint32_t n[N], AddressMode mode, int out[N]);
+    template <int N>
+    void sample_level(const Coords<N> &coords, const uint32_t mip[N], const float weight[N], float acc[4][N]) const;
+    template <int N>
+    void sample_cube_level(const uint32_t face[N], const float u[N], const float v[N], const uint32_t cube[N],
+                           const uint32_t mip[N], const float weight[N], float acc[4][N]) const;
+    template <int N>
+    void select_mips(const float lod[N], uint32_t mip0[N], uint32_t mip1[N], float w0[N], float w1[N]) const;
+    template <int N>
+    static void store(const float acc[4][N], Texels<N> &out);
+
+    const DDSFile                        *m_dds = nullptr;
+    Options                               m_options;
+    uint32_t                              m_mip_count  = 0;
+    uint32_t                              m_layers     = 0;
+    uint32_t                              m_dimensions = 2;
+    bool                                  m_is_cubemap = false;
+    std::vector<std::array<uint32_t, 3>>  m_mip_dims;
+    mutable std::vector<std::vector<float>> m_images;
+    mutable std::vector<Result>           m_decode_results;
+    std::unique_ptr<std::once_flag[]>     m_decoded;
+};
+
+template <int N>
+void Sampler::store(const float acc[4][N], Texels<N> &out)
+{
+    std::copy(acc[0], acc[0] + N, out.r);
+    std::copy(acc[1], acc[1] + N, out.g);
+    std::copy(acc[2], acc[2] + N, out.b);
+    std::copy(acc[3], acc[3] + N, out.a);
+}
+
+template <int N>
+void Sampler::select_mips(const float lod_in[N], uint32_t mip0[N], uint32_t mip1[N], float w0[N], float w1[N]) const
+{
+    const float max_lod = float(m_mip_count - 1);
+    for (int i = 0; i < N; ++i)
+    {
+        float lod = lod_in[i] >= 0.f ? std::min(lod_in[i], max_lod) : 0.f; // NaN selects the base mip
+        if (m_options.filter == FilterMode::Trilinear)
+        {
+            float f = std::floor(lod);
+            mip0[i] = uint32_t(f);
+            mip1[i] = std::min(mip0[i] + 1, m_mip_count - 1);
+            w1[i]   = lod - f;
+            w0[i]   = 1.f - w1[i];
+        }
+        else
+        {
+            mip0[i] = mip1[i] = uint32_t(lod + 0.5f);
+            w0[i]             = 1.f;
+            w1[i]             = 0.f;
+        }
+    }
+}
+
+template <int N>
+void Sampler::sample(const Coords<N> &coords, Texels<N> &out) const
+{
+    float acc[4][N] = {};
+    if (m_dds)
+    {
+        uint32_t mip0[N], mip1[N];
+        float    w0[N], w1[N];
+        select_mips<N>(coords.lod, mip0, mip1, w0, w1);
+
+        sample_level(coords, mip0, w0, acc);
+        if (m_options.filter == FilterMode::Trilinear)
+            sample_level(coords, mip1, w1, acc);
+    }
+    store<N>(acc, out);
+}
+
+template <int N>
+void Sampler::sample_cube(const Directions<N> &dirs, Texels<N> &out) const
+{
+    float acc[4][N] = {};
+    if (m_dds && m_is_cubemap)
+    {
+        uint32_t face[N], cube[N];
+        float    u[N], v[N];
+        for (int i = 0; i < N; ++i)
+        {
+            cube_face_uv(dirs.x[i], dirs.y[i], dirs.z[i], face[i], u[i], v[i]);
+            cube[i] = std::min(dirs.cube[i], m_layers / 6 - 1);
+        }
+
+        uint32_t mip0[N], mip1[N];
+        float    w0[N], w1[N];
+        select_mips<N>(dirs.lod, mip0, mip1, w0, w1);
+
+        sample_cube_level(face, u, v, cube, mip0, w0, acc);
+        if (m_options.filter == FilterMode::Trilinear)
+            sample_cube_level(face, u, v, cube, mip1, w1, acc);
+    }
+    store<N>(acc, out);
+}
+
+template <int N>
+void Sampler::address_lanes(const int i[N], int d, const uint32_t n[N], AddressMode mode, int out[N])
+{
+    switch (mode)
+    {
+    case AddressMode::Clamp:
+        for (int k = 0; k < N; ++k) out[k] = std::min(std::max(i[k] + d, 0), int(n[k]) - 1);
+        break;
+    case AddressMode::Mirror:
+    case AddressMode::Octahedral:
+        for (int k = 0; k < N; ++k)
+        {
+            const int period = 2 * int(n[k]);
+            int       p      = (i[k] + d) % period;
+            p                = p < 0 ? p + period : p;
+            out[k]           = p < int(n[k]) ? p : period - 1 - p;
+        }
+        break;
+    default:
+        for (int k = 0; k < N; ++k)
+        {
+            const int p = (i[k] + d) % int(n[k]);
+            out[k]      = p < 0 ? p + int(n[k]) : p;
+        }
+    }
+}
+
+template <int N>
+void Sampler::sample_level(const Coords<N> &coords, const uint32_t mip[N], const float weight[N],
+                           float acc[4][N]) const
+{
+    const bool linear = m_options.filter != FilterMode::Point;
+    const int  taps   = linear ? 2 : 1;
+
+    // Look up the image of each lane once per run of lanes with the same mip and layer (usually the whole batch), so
+    // the loops below are free of calls and per-lane branches. Lanes without weight don't read anything, which keeps
+    // them from decoding a subresource they don't need.
+    const float *img[N];
+    const float *shared = nullptr; // the image of all lanes with weight, if they have the same one
+    bool         live[N];
+    uint32_t     dims[3][N];
+    size_t       slice[N];
+    {
+        uint32_t     last_mip = ~0u, last_layer = ~0u;
+        const float *last     = nullptr;
+        bool         same     = true;
+        for (int i = 0; i < N; ++i)
+        {
+            const uint32_t layer = std::min(coords.layer[i], m_layers - 1);
+            live[i]              = weight[i] != 0.f;
+            if (live[i] && (mip[i] != last_mip || layer != last_layer))
+            {
+                same &= !last;
+                last       = image(mip[i], layer);
+                last_mip   = mip[i];
+                last_layer = layer;
+            }
+            img[i] = last;
+            for (int axis = 0; axis < 3; ++axis) dims[axis][i] = m_mip_dims[mip[i]][axis];
+            slice[i] = layout(mip[i]).size(dims[0][i], dims[1][i]);
+        }
+        if (!last)
+            return;
+        shared = same ? last : nullptr;
+    }
+
+    // Per-lane texel coordinates, their addresses for each tap, and the weights of the taps along each axis. With
+    // octahedral addressing, flip[axis][d] marks taps that land in an odd mirrored copy along `axis`, which also
+    // reverses the other axis: the edges of an octahedral map fold around their midpoints.
+    int   at[3][2][N];
+    float w[3][2][N];
+    bool  flip[2][2][N] = {};
+    const bool octahedral =
+        m_options.address[0] == AddressMode::Octahedral && m_options.address[1] == AddressMode::Octahedral;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float *t = axis == 0 ? coords.u : (axis == 1 ? coords.v : coords.w);
+        int          i0[N];
+        for (int i = 0; i < N; ++i)
+        {
+            float x = axis < int(m_dimensions) ? finite_coord(t[i] * float(dims[axis][i]) - (linear ? 0.5f : 0.f))
+                                               : 0.f;
+            float b       = std::floor(x);
+            i0[i]         = int(b);
+            w[axis][1][i] = linear ? x - b : 0.f;
+            w[axis][0][i] = 1.f - w[axis][1][i];
+        }
+        for (int d = 0; d < taps; ++d) address_lanes<N>(i0, d, dims[axis], m_options.address[axis], at[axis][d]);
+        if (octahedral && axis < 2)
+            for (int d = 0; d < taps; ++d)
+                for (int i = 0; i < N; ++i)
+                {
+                    const int n = int(dims[axis][i]);
+                    const int q = i0[i] + d >= 0 ? (i0[i] + d) / n : (i0[i] + d + 1) / n - 1; // floor division
+                    flip[axis][d][i] = (q & 1) != 0;
+                }
+    }
+
+    const LayoutType type  = m_options.layout.type;
+    uint32_t         shift = 0; // log2 of the tile size
+    while ((1u << shift) < m_options.layout.tile_size) ++shift;
+    const uint32_t mask = (1u << shift) - 1;
+
+    const int tz = m_dimensions > 2 ? taps : 1;
+    const int ty = m_dimensions > 1 ? taps : 1;
+    for (int dz = 0; dz < tz; ++dz)
+        for (int dy = 0; dy < ty; ++dy)
+            for (int dx = 0; dx < taps; ++dx)
+            {
+                const int *x = at[0][dx], *y = at[1][dy], *z = at[2][dz];
+                int        fx[N], fy[N];
+                if (octahedral)
+                {
+                    for (int i = 0; i < N; ++i)
+                    {
+                        fx[i] = flip[1][dy][i] ? int(dims[0][i]) - 1 - x[i] : x[i];
+                        fy[i] = flip[0][dx][i] ? int(dims[1][i]) - 1 - y[i] : y[i];
+                    }
+                    x = fx;
+                    y = fy;
+                }
+                size_t offset[N];
+                if (type == LayoutType::Morton)
+                    for (int i = 0; i < N; ++i)
+                        offset[i] = layout(mip[i]).offset(uint32_t(x[i]), uint32_t(y[i]), dims[0][i], dims[1][i]);
+                else
+                    for (int i = 0; i < N; ++i)
+                    {
+                        // rows of mips with a height of 1 are always stored linearly
+                        const size_t row     = size_t(y[i]) * dims[0][i] + uint32_t(x[i]);
+                        const size_t tiles_x = (dims[0][i] + mask) >> shift;
+                        const size_t tiled   = ((size_t(uint32_t(y[i]) >> shift) * tiles_x + (uint32_t(x[i]) >> shift))
+                                                << (2 * shift)) +
+                                             ((uint32_t(y[i]) & mask) << shift) + (uint32_t(x[i]) & mask);
+                        offset[i] = type == LayoutType::Tiled && dims[1][i] > 1 ? tiled : row;
+                    }
+
+                float  wt[N];
+                size_t index[N];
+                for (int i = 0; i < N; ++i)
+                {
+                    wt[i]    = weight[i] * (w[2][dz][i] * w[1][dy][i]) * w[0][dx][i];
+                    index[i] = live[i] ? 4 * (slice[i] * size_t(z[i]) + offset[i]) : 0;
+                }
+                if (shared) // a gather from one image
+                    for (int c = 0; c < 4; ++c)
+                        for (int i = 0; i < N; ++i) acc[c][i] += wt[i] * shared[index[i] + c];
+                else
+                    for (int i = 0; i < N; ++i)
+                        if (live[i])
+                            for (int c = 0; c < 4; ++c) acc[c][i] += wt[i] * img[i][index[i] + c];
+            }
+}
+
+template <int N>
+void Sampler::sample_cube_level(const uint32_t face[N], const float u[N], const float v[N], const uint32_t cube[N],
+                                const uint32_t mip[N], const float weight[N], float acc[4][N]) const
+{
+    const bool linear = m_options.filter != FilterMode::Point;
+    const int  taps   = linear ? 2 : 1;
+
+    int   x0[N], y0[N];
+    float fx[N], fy[N];
+    for (int i = 0; i < N; ++i)
+    {
+        float n = float(m_mip_dims[mip[i]][0]);
+        float x = finite_coord(u[i] * n - (linear ? 0.5f : 0.f));
+        float y = finite_coord(v[i] * n - (linear ? 0.5f : 0.f));
+        float bx = std::floor(x), by = std::floor(y);
+        x0[i] = int(bx);
+        y0[i] = int(by);
+        fx[i] = linear ? x - bx : 0.f;
+        fy[i] = linear ? y - by : 0.f;
+    }
+
+    for (int i = 0; i < N; ++i)
+    {
+        if (weight[i] == 0.f)
+            continue;
+
+        const int    n      = int(m_mip_dims[mip[i]][0]);
+        const Layout layout = this->layout(mip[i]);
+        for (int dy = 0; dy < taps; ++dy)
+            for (int dx = 0; dx < taps; ++dx)
+            {
+                int      x = x0[i] + dx, y = y0[i] + dy;
+                uint32_t f = face[i];
+                if (x < 0 || y < 0 || x >= n || y >= n)
+                {
+                    // The tap is off the edge of the face: follow its direction onto the neighboring face
+                    float dir[3], tu, tv;
+                    cube_direction(f, (x + 0.5f) / n, (y + 0.5f) / n, dir[0], dir[1], dir[2]);
+                    cube_face_uv(dir[0], dir[1], dir[2], f, tu, tv);
+                    x = std::min(std::max(int(tu * n), 0), n - 1);
+                    y = std::min(std::max(int(tv * n), 0), n - 1);
+                }
+                float wt = weight[i] * (taps == 1 ? 1.f : (dx ? fx[i] : 1.f - fx[i]) * (dy ? fy[i] : 1.f - fy[i]));
+                const float *p = image(mip[i], 6 * cube[i] + f) + 4 * layout.offset(x, y, n, n);
+                for (int c = 0; c < 4; ++c) acc[c][i] += wt * p[c];
+            }
+    }
+}
+
+/// Spherical parameterizations of environment maps
+enum class Projection : uint32_t
+{
+    Cubemap,         ///< Six cube faces in D3D order (+X, -X, +Y, -Y, +Z, -Z)
+    Equirectangular, ///< Latitude-longitude map with a 2:1 aspect ratio; +Y is up and the image center looks down -Z
+    Octahedral,      ///< Square octahedral map; the upper (+Y) hemisphere fills the inner diamond
+};
+
+/// Direction (need not be normalized) to [0,1]^2 texture coordinates of an equirectangular map
+inline void direction_to_equirect(float x, float y, float z, float &u, float &v)
+{
+    const float pi = 3.14159265358979f;
+    float       r  = std::sqrt(x * x + y * y + z * z);
+    u              = std::atan2(x, -z) / (2.f * pi) + 0.5f;
+    v              = r > 0.f ? std::acos(std::min(std::max(y / r, -1.f), 1.f)) / pi : 0.5f;
+}
+
+/// Inverse of direction_to_equirect(); returns a unit direction
+inline void equirect_to_direction(float u, float v, float &x, float &y, float &z)
+{
+    const float pi    = 3.14159265358979f;
+    float       phi   = (u - 0.5f) * 2.f * pi;
+    float       theta = v * pi;
+    x                 = std::sin(theta) * std::sin(phi);
+    y                 = std::cos(theta);
+    z                 = -std::sin(theta) * std::cos(phi);
+}
+
+/// Direction (need not be normalized) to [0,1]^2 texture coordinates of an octahedral map
+inline void direction_to_octahedral(float x, float y, float z, float &u, float &v)
+{
+    float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+    float px = l1 > 0.f ? x / l1 : 0.f;
+    float pz = l1 > 0.f ? z / l1 : 0.f;
+    if (y < 0.f)
+    {
+        float fx = (1.f - std::abs(pz)) * (px >= 0.f ? 1.f : -1.f);
+        float fz = (1.f - std::abs(px)) * (pz >= 0.f ? 1.f : -1.f);
+        px       = fx;
+        pz       = fz;
+    }
+    u = 0.5f * px + 0.5f;
+    v = 0.5f * pz + 0.5f;
+}
+
+/// Inverse of direction_to_octahedral(); returns a unit direction
+inline void octahedral_to_direction(float u, float v, float &x, float &y, float &z)
+{
+    x = 2.f * u - 1.f;
+    z = 2.f * v - 1.f;
+    y = 1.f - std::abs(x) - std::abs(z);
+    if (y < 0.f)
+    {
+        float fx = (1.f - std::abs(z)) * (x >= 0.f ? 1.f : -1.f);
+        float fz = (1.f - std::abs(x)) * (z >= 0.f ? 1.f : -1.f);
+        x        = fx;
+        z        = fz;
+    }
+    float r = std::sqrt(x * x + y * y + z * z);
+    x /= r;
+    y /= r;
+    z /= r;
+}
+
+struct ProjectionOptions
+{
+    /// Face size for cubemaps, height for equirectangular maps (the width is twice that), or edge length for
+    /// octahedral maps. 0 picks the size that matches the angular resolution of the source.
+    uint32_t            size        = 0;
+    uint32_t            mip_count   = 1; ///< Number of output mips, 0 for a full mip chain
+    uint32_t            samples     = 2; ///< Supersamples per axis for each output texel
+    DDSFile::DXGIFormat format      = DDSFile::R16G16B16A16_Float; ///< R16G16B16A16_Float or R32G32B32A32_Float
+    uint32_t            num_threads = 0; ///< 0 uses all hardware threads
+};
+
+/** Convert an environment map between cubemap, equirectangular and octahedral projections.
+
+    Each output texel averages a grid of samples x samples supersamples of the source, which is sampled trilinearly at
+    the mip level that matches the footprint of a sample, so both magnification and minification (including every
+    level of the output mip chain) are properly filtered. Cubemap sources are sampled seamlessly across faces, and
+    octahedral sources across their folded edges. The work is split over threads by output rows.
+
+    @param src     The source environment map, with populated image data. Only the first cube/array slice is used.
+    @param from    The projection of `src`; must be Cubemap if and only if `src` is a cubemap.
+    @param to      The projection to convert to.
+    @param out     Receives the result: a cubemap, or a 2D texture for the other projections.
+    @param options Output size, mips, format and threading.
+*/
+Result convert_projection(const DDSFile &src, Projection from, Projection to, DDSWriter &out,
+                          const ProjectionOptions &options = ProjectionOptions{});
+
+/// Arrangements of the six faces of a cubemap within a single 2D image
+enum class CubeLayout : uint32_t
+{
+    Auto,            ///< Detect the layout from the aspect ratio of the image
+    HorizontalCross, ///< 4x3 faces: +Y above +Z; -X, +Z, +X, -Z in the middle row; -Y below +Z
+    VerticalCross,   ///< 3x4 faces: like the horizontal cross, but with -Z below -Y, rotated by 180 degrees
+    HorizontalStrip, ///< 6x1 faces in the order +X, -X, +Y, -Y, +Z, -Z
+    VerticalStrip,   ///< 1x6 faces in the order +X, -X, +Y, -Y, +Z, -Z
+};
+
+/** Convert a cross or strip layout stored in a 2D DDS file into a proper cubemap.
+
+    If the face size is a multiple of the block size, the faces are copied block by block without decoding, so the
+    output keeps the format of the source (the 180 degree rotation of the vertical cross is done in the compressed
+    domain for BC1-BC5 and for uncompressed formats). Otherwise the faces are decoded and written as
+    R32G32B32A32_Float. Leading mips of the source that are exact layouts of the same kind become mips of the cubemap.
+
+    @param src    A 2D texture with populated image data.
+    @param out    Receives the cubemap.
+    @param layout The layout of `src`, or Auto to detect it.
+*/
+Result import_cube_layout(const DDSFile &src, DDSWriter &out, CubeLayout layout = CubeLayout::Auto);
+
+/// Store `count` RGBA float texels in `format` (R32G32B32A32_Float or R16G16B16A16_Float)
+bool store_rgba(const float *rgba, size_t count, DDSFile::DXGIFormat format, uint8_t *dst);
+
+/// Second-order (L2) real spherical harmonics of an RGB signal: 9 coefficients in the order
+/// (l, m) = (0, 0), (1, -1), (1, 0), (1, 1), (2, -2), (2, -1), (2, 0), (2, 1), (2, 2).
+struct SHL2
+{
+    float coeffs[9][3] = {};
+
+    /// Reconstruct the signal in the (not necessarily normalized) direction (x, y, z); a zero direction (or NaN)
+    /// returns the mean of the signal over the sphere
+    std::array<float, 3> evaluate(float x, float y, float z) const;
+};
+
+/// The 9 L2 real spherical harmonics basis functions at the unit direction (x, y, z)
+inline void sh_basis_l2(float x, float y, float z, float basis[9])
+{
+    basis[0] = 0.282095f;
+    basis[1] = 0.488603f * y;
+    basis[2] = 0.488603f * z;
+    basis[3] = 0.488603f * x;
+    basis[4] = 1.092548f * x * y;
+    basis[5] = 1.092548f * y * z;
+    basis[6] = 0.315392f * (3.f * z * z - 1.f);
+    basis[7] = 1.092548f * x * z;
+    basis[8] = 0.546274f * (x * x - y * y);
+}
+
+struct SHOptions
+{
+    uint32_t max_face_size = 32;    ///< Project the largest mip whose faces are at most this size
+    bool     irradiance    = false; ///< Convolve with the clamped cosine lobe, so SHL2::evaluate() returns irradiance
+    uint32_t cube          = 0;     ///< Which cube of a cubemap array to project
+    uint32_t num_threads   = 0;     ///< 0 uses all hardware threads
+};
+
+/** Project a cubemap onto L2 spherical harmonics.
+
+    Every texel of one (low) mip of the cubemap is weighted by its exact solid angle, and the six faces are projected in
+    parallel. The cubemap can be in any format supported by DDSFile::decode(), including BC6H.
+
+    @param cubemap A cubemap with populated image data.
+    @param sh      Receives the projection.
+    @param options Mip selection, optional cosine convolution and threading.
+*/
+Result project_sh(const DDSFile &cubemap, SHL2 &sh, const SHOptions &options = SHOptions{});
+
+/// Project `count` cubemaps (e.g. a set of light probes), distributing the cubemaps over threads.
+/// Returns the first error encountered; the coefficients of cubemaps that failed are zero.
+Result project_sh(const DDSFile *const *cubemaps, size_t count, SHL2 *sh, const SHOptions &options = SHOptions{});
+
+struct PrefilterOptions
+{
+    uint32_t            size        = 0;  ///< Face size of the base mip, 0 to use the size of the source
+    uint32_t            mip_count   = 0;  ///< Number of output mips, 0 for a full mip chain
+    uint32_t            samples     = 64; ///< GGX importance samples per texel
+    DDSFile::DXGIFormat format      = DDSFile::R16G16B16A16_Float; ///< RGBA16F, RGBA32F or BC6H_UF16
+    uint32_t            num_threads = 0; ///< 0 uses all hardware threads
+};
+
+/** Generate a GGX prefiltered specular cubemap, with roughness increasing along the mip chain.
+
+    Mip m of the output holds the radiance convolved with the GGX lobe of roughness m / (mip_count - 1) (with n = v = r,
+    as in the split-sum approximation), so mip 0 is a resampled copy of the source. Each texel importance-samples the
+    GGX distribution and reads the source at the mip whose texels match the solid angle of each sample, which keeps the
+    sample count low without fireflies. Faces and rows are processed in parallel.
+
+    @param cubemap The source cubemap, with populated image data. Only the first cube is used.
+    @param out     Receives the prefiltered cubemap.
+    @param options Output size, mips, sample count, format and threading.
+*/
+Result prefilter_ggx(const DDSFile &cubemap, DDSWriter &out, const PrefilterOptions &options = PrefilterOptions{});
+
+struct BCSelectOptions
+{
+    float    max_rmse        = 0.02f; ///< Quality target: largest RMS error of the stored channels (1/255 = 0.004)
+    float    sample_fraction = 0.25f; ///< Fraction of the 4x4 blocks to trial-encode (but at least 256 blocks)
+    bool     srgb            = false; ///< The texels are sRGB-encoded color: pick an _SRGB format, so not BC4 or BC5
+    bool     allow_bc7       = true;  ///< Otherwise BC3 is the only 8 bits per texel format for color
+    uint32_t num_threads     = 0;     ///< 0 uses all hardware threads
+};
+
+/// What select_bc_format() found out about an image
+struct BCAnalysis
+{
+    bool opaque       = true;  ///< Alpha is 1 everywhere
+    bool binary_alpha = true;  ///< Alpha is 0 or 1 everywhere, so BC1 punch-through alpha can represent it
+    bool grayscale    = true;  ///< R = G = B everywhere, so BC4 (read with an .rrr swizzle) can represent the colors
+    bool two_channel  = true;  ///< B = 0 everywhere, so BC5 can represent the colors (e.g. normal maps storing XY)
+    bool is_signed    = false; ///< R or G are negative somewhere, so BC4 and BC5 use their SNorm formats
+
+    uint32_t sampled_blocks = 0; ///< Number of blocks that were trial-encoded
+    /// Trial RMS error of BC4, BC1, BC5, BC3 and BC7 (in that order), or -1 for formats that weren't candidates
+    float               rmse[5] = {-1.f, -1.f, -1.f, -1.f, -1.f};
+    DDSFile::DXGIFormat format  = DDSFile::Format_Unknown; ///< The selected format
+};
+
+/** Pick the smallest block-compressed format that represents an image within a quality target.
+
+    The texels are analyzed for opacity and for the number of distinct channels, which rules out formats that can't
+    store the image: BC4 needs a grayscale, BC5 a two-channel and BC1 an opaque (or punch-through) image. The remaining
+    candidates are trial-encoded on an evenly spread sample of the blocks, which measures how well the format handles
+    the gradients and edges of the image. The result is the candidate with the lowest error among those with 4 bits per
+    texel (BC4, BC1) that meet `options.max_rmse`, otherwise among those with 8 bits per texel (BC5, BC3, BC7), and
+    otherwise the 8 bits per texel candidate with the lowest error.
+
+    Values are clamped to [0,1], or [-1,1] if R or G are negative somewhere (and then only BC4 and BC5 are stored
+    signed). The errors ignore the colors of fully transparent texels.
+
+    @param rgba     Width * height RGBA float texels in row-major order.
+    @param width    Width of the image.
+    @param height   Height of the image.
+    @param options  Quality target, sampling and threading.
+    @param analysis If not null, receives the properties of the image and the error of each candidate.
+*/
+DDSFile::DXGIFormat select_bc_format(const float *rgba, uint32_t width, uint32_t height,
+                                     const BCSelectOptions &options  = BCSelectOptions{},
+                                     BCAnalysis            *analysis = nullptr);
+
+/// Compress width * height RGBA float texels (row-major) into `format` with encode_bc_block(), padding partial blocks
+/// by replicating edge texels. `dst` receives the blocks in row-major order. Returns false if `format` isn't supported.
+bool encode_bc_image(const float *rgba, uint32_t width, uint32_t height, DDSFile::DXGIFormat format, uint8_t *dst,
+                     uint32_t num_threads = 0);
+
+/** Compress a texture into the format chosen by select_bc_format().
+
+    The format is selected from the base mips of all array slices (and depth slices), and every subresource is then
+    decoded and re-encoded in that format, in parallel by rows of blocks. sRGB sources always get an sRGB format.
+
+    @param src      The source texture, in any format supported by DDSFile::decode(), with populated image data.
+    @param out      Receives the compressed texture, with the same dimensions, mips and array slices.
+    @param options  Quality target, sampling and threading.
+    @param analysis If not null, receives the analysis that the format was selected with.
+*/
+Result compress_bc(const DDSFile &src, DDSWriter &out, const BCSelectOptions &options = BCSelectOptions{},
+                   BCAnalysis *analysis = nullptr);
+
+/// sRGB-encoded value to linear light
+inline float srgb_to_linear(float v) { return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f); }
+/// Linear light to an sRGB-encoded value
+inline float linear_to_srgb(float v)
+{
+    return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.f / 2.4f) - 0.055f;
+}
+
+enum class ResampleFilter : uint32_t
+{
+    Box,      ///< Average of the covered texels; nearest texel when enlarging
+    Mitchell, ///< Mitchell-Netravali cubic (B = C = 1/3): sharp, with little ringing
+    Lanczos3, ///< Windowed sinc with 3 lobes: sharpest, but rings near hard edges
+};
+
+struct ResampleOptions
+{
+    ResampleFilter filter      = ResampleFilter::Mitchell;
+    AddressMode    address[2]  = {AddressMode::Clamp, AddressMode::Clamp}; ///< For x and y, at the image edges
+    bool           srgb        = false; ///< RGB is sRGB-encoded: filter it in linear light (alpha is always linear)
+    uint32_t       num_threads = 0;     ///< 0 uses all hardware threads
+};
+
+/** Resize an RGBA float image to any size with a separable filter.
+
+    The filter is stretched by the reduction factor when shrinking, so every source texel contributes. The weights of
+    each axis are computed once per output column and row, normalized, and stored as a table of a fixed number of taps,
+    which also resolves the address mode. The image is then filtered horizontally by bands of source rows, and
+    vertically by bands of output rows, on up to `num_threads` threads. All arithmetic is in FP32, so HDR values are
+    preserved; Mitchell and Lanczos overshoot near edges, which can produce values outside the range of the source.
+
+    @param src        src_width * src_height RGBA texels in row-major order, e.g. from DDSFile::decode().
+    @param dst        Receives dst_width * dst_height RGBA texels in row-major order.
+    @returns false (without writing anything) if a dimension is 0.
+*/
+bool resample_rgba(const float *src, uint32_t src_width, uint32_t src_height, float *dst, uint32_t dst_width,
+                   uint32_t dst_height, const ResampleOptions &options = ResampleOptions{});
+
+} // namespace smalldds
+
+#ifdef SMALLDDS_IMPLEMENTATION
+
+namespace smalldds
+{
+
+Result Sampler::init(const DDSFile &dds, const Options &options)
+{
+    m_dds       = nullptr;
+    m_options   = options;
+    m_mip_count = dds.mip_count();
+    m_layers    = dds.array_size();
+    if (!dds.get_image_data(m_mip_count - 1, m_layers - 1))
+        return Result{Result::Error, "Sampler: DDS file has no image data. Did you call populate_image_data()?"};
+    if (!options.layout.is_valid())
+        return Result{Result::Error, "Sampler: Tile size of a tiled layout must be a power of two >= 4."};
+
+    m_is_cubemap = dds.is_cubemap && m_layers >= 6;
+    m_dimensions = dds.texture_dimension() == DDSFile::Texture3D ? 3 : (dds.height() > 1 ? 2 : 1);
+    if (dds.texture_dimension() == DDSFile::Texture1D)
+        m_dimensions = 1;
+
+    m_mip_dims.resize(m_mip_count);
+    for (uint32_t m = 0; m < m_mip_count; ++m)
+    {
+        auto img      = dds.get_image_data(m, 0);
+        m_mip_dims[m] = {img->width, m_dimensions > 1 ? img->height : 1, m_dimensions > 2 ? img->depth : 1};
+    }
+
+    m_images.assign(size_t(m_mip_count) * m_layers, {});
+    m_decode_results.assign(m_images.size(), Result{Result::Success});
+    m_decoded.reset(new std::once_flag[m_images.size()]);
+    m_dds = &dds;
+    return Result{Result::Success};
+}
+
+const float *Sampler::image(uint32_t mip, uint32_t layer) const
+{
+    size_t idx = size_t(layer) * m_mip_count + mip;
+    std::call_once(m_decoded[idx],
+                   [&]
+                   {
+                       const auto &dims = m_mip_dims[mip];
+                       auto        img  = m_dds->get_image_data(mip, layer);
+                       m_images[idx].assign(4 * layout(mip).size(dims[0], dims[1]) * img->depth, 0.f);
+                       m_decode_results[idx] = m_dds->decode(m_images[idx].data(), mip, layer, layout(mip));
+                   });
+    return m_images[idx].data();
+}
+
+Result Sampler::prefetch() const
+{
+    Result res{Result::Success};
+    if (!m_dds)
+        return Result{Result::Error, "Sampler: not initialized."};
+
+    for (uint32_t layer = 0; layer < m_layers; ++layer)
+        for (uint32_t mip = 0; mip < m_mip_count; ++mip)
+        {
+            image(mip, layer);
+            const auto &r = m_decode_results[size_t(layer) * m_mip_count + mip];
+            if (r.type != Result::Success)
+                res.add_message(r.type, r.message);
+        }
+    return res;
+}
+
+bool store_rgba(const float *rgba, size_t count, DDSFile::DXGIFormat format, uint8_t *dst)
+{
+    if (format != DDSFile::R32G32B32A32_Float && format != DDSFile::R16G16B16A16_Float)
+        return false;
+    return quantize_rgba(rgba, count, format, dst);
+}
+
+namespace detail
+{
+
+/// Average solid angle of a texel for a projection with the given size (as in ProjectionOptions::size)
+inline float texel_solid_angle(Projection p, float size)
+{
+    const float four_pi = 4.f * 3.14159265358979f;
+    switch (p)
+    {
+    case Projection::Cubemap: return four_pi / (6.f * size * size);
+    case Projection::Equirectangular: return four_pi / (2.f * size * size);
+    default: return four_pi / (size * size);
+    }
+}
+
+} // namespace detail
+
+Result convert_projection(const DDSFile &src, Projection from, Projection to, DDSWriter &out,
+                          const ProjectionOptions &options)
+{
+    if ((from == Projection::Cubemap) != src.is_cubemap)
+        return Result{Result::Error, "convert_projection: Source projection doesn't match whether the DDS is a cubemap."};
+    if (options.format != DDSFile::R32G32B32A32_Float && options.format != DDSFile::R16G16B16A16_Float)
+        return Result{Result::Error, "convert_projection: Output format must be R32G32B32A32_Float or R16G16B16A16_Float."};
+
+    SamplerOptions sopts;
+    sopts.filter     = FilterMode::Trilinear;
+    sopts.address[0] = from == Projection::Equirectangular ? AddressMode::Wrap : AddressMode::Clamp;
+    sopts.address[1] = AddressMode::Clamp;
+    if (from == Projection::Octahedral) // continue across the folded edges instead of clamping to them
+        sopts.address[0] = sopts.address[1] = AddressMode::Octahedral;
+    Sampler sampler;
+    auto    res = sampler.init(src, sopts);
+    if (res.type == Result::Error)
+        return res;
+    res = sampler.prefetch();
+    if (res.type == Result::Error)
+        return res;
+
+    const float src_size = float(from == Projection::Equirectangular ? src.height() : src.width());
+    const float src_sa   = detail::texel_solid_angle(from, src_size);
+
+    uint32_t size = options.size;
+    if (size == 0)
+    {
+        // match the angular resolution of the source
+        float unit = detail::texel_solid_angle(to, 1.f);
+        size       = std::max(1u, uint32_t(std::sqrt(unit / src_sa) + 0.5f));
+    }
+
+    const uint32_t width   = to == Projection::Equirectangular ? 2 * size : size;
+    const uint32_t height  = size;
+    uint32_t       mips    = options.mip_count;
+    uint32_t       max_mip = 1;
+    while ((std::max(width, height) >> max_mip) > 0) ++max_mip;
+    mips = mips == 0 ? max_mip : std::min(mips, max_mip);
+
+    const bool to_cube = to == Projection::Cubemap;
+    res                = out.init(options.format, width, height, 1, mips, 1, to_cube);
+    if (res.type == Result::Error)
+        return res;
+
+    const uint32_t faces   = to_cube ? 6 : 1;
+    const uint32_t samples = std::max(1u, options.samples);
+    const size_t   texel_bytes = options.format == DDSFile::R32G32B32A32_Float ? 16 : 8;
+    for (uint32_t m = 0; m < mips; ++m)
+    {
+        const uint32_t w = std::max(1u, width >> m), h = std::max(1u, height >> m);
+
+        // pick the source mip whose texels match the footprint of one supersample
+        const float dst_sa = detail::texel_solid_angle(to, float(h)) / float(samples * samples);
+        const float lod    = std::max(0.f, 0.5f * std::log2(dst_sa / src_sa));
+
+        parallel_for(
+            0, size_t(faces) * h,
+            [&](size_t row_idx)
+            {
+                const uint32_t     face = uint32_t(row_idx / h), y = uint32_t(row_idx % h);
+                std::vector<float> row(4 * size_t(w), 0.f);
+
+                constexpr int N = 8;
+                float         dirs[3][N];
+                int           texel[N];
+                int           n = 0;
+
+                auto flush = [&]
+                {
+                    Sampler::Texels<N> t;
+                    if (from == Projection::Cubemap)
+                    {
+                        Sampler::Directions<N> d;
+                        for (int i = 0; i < N; ++i)
+                        {
+                            d.x[i]   = dirs[0][i];
+                            d.y[i]   = dirs[1][i];
+                            d.z[i]   = dirs[2][i];
+                            d.lod[i] = lod;
+                        }
+                        sampler.sample_cube(d, t);
+                    }
+                    else
+                    {
+                        Sampler::Coords<N> c;
+                        for (int i = 0; i < N; ++i)
+                        {
+                            if (from == Projection::Equirectangular)
+                                direction_to_equirect(dirs[0][i], dirs[1][i], dirs[2][i], c.u[i], c.v[i]);
+                            else
+                                direction_to_octahedral(dirs[0][i], dirs[1][i], dirs[2][i], c.u[i], c.v[i]);
+                            c.lod[i] = lod;
+                        }
+                        sampler.sample(c, t);
+                    }
+                    for (int i = 0; i < n; ++i)
+                    {
+                        float *p = row.data() + 4 * texel[i];
+                        p[0] += t.r[i];
+                        p[1] += t.g[i];
+                        p[2] += t.b[i];
+                        p[3] += t.a[i];
+                    }
+                    n = 0;
+                };
+
+                for (uint32_t x = 0; x < w; ++x)
+                    for (uint32_t sy = 0; sy < samples; ++sy)
+                        for (uint32_t sx = 0; sx < samples; ++sx)
+                        {
+                            float u = (x + (sx + 0.5f) / samples) / w;
+                            float v = (y + (sy + 0.5f) / samples) / h;
+                            switch (to)
+                            {
+                            case Projection::Cubemap:
+                                Sampler::cube_direction(face, u, v, dirs[0][n], dirs[1][n], dirs[2][n]);
+                                break;
+                            case Projection::Equirectangular:
+                                equirect_to_direction(u, v, dirs[0][n], dirs[1][n], dirs[2][n]);
+                                break;
+                            default: octahedral_to_direction(u, v, dirs[0][n], dirs[1][n], dirs[2][n]); break;
+                            }
+                            texel[n++] = int(x);
+                            if (n == N)
+                                flush();
+                        }
+                if (n)
+                {
+                    for (int i = n; i < N; ++i) dirs[0][i] = dirs[1][i] = dirs[2][i] = 1.f;
+                    flush();
+                }
+
+                const float scale = 1.f / float(samples * samples);
+                for (auto &v : row) v *= scale;
+                store_rgba(row.data(), w, options.format, out.image_data(m, face) + texel_bytes * w * y);
+            },
+            options.num_threads);
+    }
+
+    return Result{Result::Success};
+}
+
+std::array<float, 3> SHL2::evaluate(float x, float y, float z) const
+{
+    float r        = std::sqrt(x * x + y * y + z * z);
+    float basis[9] = {};
+    if (r > 0.f)
+        sh_basis_l2(x / r, y / r, z / r, basis);
+    else // no direction: only the DC term, the mean of the signal over the sphere
+        basis[0] = 0.282095f;
+    std::array<float, 3> result{0.f, 0.f, 0.f};
+    for (int k = 0; k < 9; ++k)
+        for (int c = 0; c < 3; ++c) result[c] += coeffs[k][c] * basis[k];
+    return result;
+}
+
+namespace detail
+{
+
+/// Accumulate the solid-angle weighted SH projection of one decoded n x n RGBA cube face into `acc`.
+inline void project_sh_face(const float *rgba, uint32_t n, uint32_t face, float acc[9][3])
+{
+    // integral of the solid angle over [0,x]x[0,y] of a face at unit distance, used to get exact texel solid angles
+    auto area = [](float x, float y) { return std::atan2(x * y, std::sqrt(x * x + y * y + 1.f)); };
+
+    constexpr uint32_t N     = 8;
+    const float        inv_n = 1.f / float(n);
+    for (uint32_t y = 0; y < n; ++y)
+    {
+        const float y0 = 2.f * y * inv_n - 1.f, y1 = 2.f * (y + 1) * inv_n - 1.f;
+        for (uint32_t x0 = 0; x0 < n; x0 += N)
+        {
+            const uint32_t count = std::min(N, n - x0);
+            float          weight[N] = {}, basis[9][N];
+            for (uint32_t i = 0; i < N; ++i)
+            {
+                uint32_t x  = x0 + std::min(i, count - 1);
+                float    xa = 2.f * x * inv_n - 1.f, xb = 2.f * (x + 1) * inv_n - 1.f;
+                if (i < count)
+                    weight[i] = area(xa, y0) - area(xa, y1) - area(xb, y0) + area(xb, y1);
+
+                float dx, dy, dz;
+                Sampler::cube_direction(face, (x + 0.5f) * inv_n, (y + 0.5f) * inv_n, dx, dy, dz);
+                float r = 1.f / std::sqrt(dx * dx + dy * dy + dz * dz), b[9];
+                sh_basis_l2(dx * r, dy * r, dz * r, b);
+                for (int k = 0; k < 9; ++k) basis[k][i] = b[k];
+            }
+
+            const float *px = rgba + 4 * (size_t(y) * n + x0);
+            for (int c = 0; c < 3; ++c)
+            {
+                float v[N];
+                for (uint32_t i = 0; i < N; ++i) v[i] = i < count ? weight[i] * px[4 * i + c] : 0.f;
+                for (int k = 0; k < 9; ++k)
+                {
+                    float sum = 0.f;
+                    for (uint32_t i = 0; i < N; ++i) sum += v[i] * basis[k][i];
+                    acc[k][c] += sum;
+                }
+            }
+        }
+    }
+}
+
+inline Result project_sh_impl(const DDSFile &cubemap, SHL2 &sh, const SHOptions &options, uint32_t num_threads)
+{
+    sh = SHL2{};
+    if (!cubemap.is_cubemap)
+        return Result{Result::Error, "project_sh: The DDS file is not a cubemap."};
+
+    uint32_t mip = 0;
+    while (mip + 1 < cubemap.mip_count() && std::max(1u, cubemap.width() >> mip) > options.max_face_size) ++mip;
+
+    float  acc[6][9][3] = {};
+    Result results[6];
+    parallel_for(
+        0, 6,
+        [&](size_t face)
+        {
+            const auto *img = cubemap.get_image_data(mip, 6 * options.cube + uint32_t(face));
+            if (!img)
+            {
+                results[face] = Result{Result::Error, "project_sh: Cubemap face does not exist."};
+                return;
+            }
+            std::vector<float> rgba(4 * size_t(img->width) * img->height);
+            results[face] = cubemap.decode(rgba.data(), mip, 6 * options.cube + uint32_t(face));
+            if (results[face].type != Result::Error)
+                project_sh_face(rgba.data(), img->width, uint32_t(face), acc[face]);
+        },
+        num_threads);
+
+    for (uint32_t face = 0; face < 6; ++face)
+    {
+        if (results[face].type == Result::Error)
+            return results[face];
+        for (int k = 0; k < 9; ++k)
+            for (int c = 0; c < 3; ++c) sh.coeffs[k][c] += acc[face][k][c];
+    }
+
+    if (options.irradiance)
+    {
+        // Ramamoorthi and Hanrahan's convolution with the clamped cosine: pi, 2pi/3, pi/4 for bands 0, 1, 2
+        const float bands[9] = {3.14159265f, 2.09439510f, 2.09439510f, 2.09439510f, 0.78539816f,
+                                0.78539816f, 0.78539816f, 0.78539816f, 0.78539816f};
+        for (int k = 0; k < 9; ++k)
+            for (int c = 0; c < 3; ++c) sh.coeffs[k][c] *= bands[k];
+    }
+    return Result{Result::Success};
+}
+
+} // namespace detail
+
+Result project_sh(const DDSFile &cubemap, SHL2 &sh, const SHOptions &options)
+{
+    return detail::project_sh_impl(cubemap, sh, options, options.num_threads);
+}
+
+Result project_sh(const DDSFile *const *cubemaps, size_t count, SHL2 *sh, const SHOptions &options)
+{
+    std::vector<Result> results(count);
+    // parallelize over cubemaps, so each projection runs single-threaded
+    parallel_for(
+        0, count, [&](size_t i) { results[i] = detail::project_sh_impl(*cubemaps[i], sh[i], options, 1); },
+        options.num_threads);
+
+    for (const auto &r : results)
+        if (r.type == Result::Error)
+            return r;
+    return Result{Result::Success};
+}
+
+Result prefilter_ggx(const DDSFile &cubemap, DDSWriter &out, const PrefilterOptions &options)
+{
+    const auto fmt = options.format;
+    if (fmt != DDSFile::R32G32B32A32_Float && fmt != DDSFile::R16G16B16A16_Float && fmt != DDSFile::BC6H_UF16)
+        return Result{Result::Error, "prefilter_ggx: Output format must be RGBA16F, RGBA32F or BC6H_UF16."};
+    if (!cubemap.is_cubemap)
+        return Result{Result::Error, "prefilter_ggx: The DDS file is not a cubemap."};
+
+    Sampler sampler;
+    auto    res = sampler.init(cubemap);
+    if (res.type == Result::Error)
+        return res;
+    res = sampler.prefetch();
+    if (res.type == Result::Error)
+        return res;
+
+    const uint32_t size    = options.size ? options.size : cubemap.width();
+    uint32_t       max_mip = 1;
+    while ((size >> max_mip) > 0) ++max_mip;
+    const uint32_t mips = options.mip_count == 0 ? max_mip : std::min(options.mip_count, max_mip);
+
+    res = out.init(fmt, size, size, 1, mips, 1, true);
+    if (res.type == Result::Error)
+        return res;
+
+    const float    pi      = 3.14159265358979f;
+    const float    src_sa  = 4.f * pi / (6.f * float(cubemap.width()) * float(cubemap.width()));
+    const uint32_t samples = std::max(1u, options.samples);
+
+    for (uint32_t m = 0; m < mips; ++m)
+    {
+        const uint32_t n         = std::max(1u, size >> m);
+        const float    roughness = mips > 1 ? float(m) / float(mips - 1) : 0.f;
+        const float    a2        = roughness * roughness * roughness * roughness;
+        const float    texel_lod = std::max(0.f, 0.5f * std::log2(4.f * pi / (6.f * n * n) / src_sa));
+        // a perfect mirror needs a single sample
+        const uint32_t count = m == 0 ? 1 : samples;
+
+        std::vector<float> faces(size_t(6) * n * n * 4);
+        parallel_for(
+            0, size_t(6) * n,
+            [&](size_t row_idx)
+            {
+                const uint32_t face = uint32_t(row_idx / n), y = uint32_t(row_idx % n);
+                float         *row  = faces.data() + 4 * (size_t(face) * n * n + size_t(y) * n);
+
+                constexpr int          N = 8;
+                Sampler::Directions<N> dirs;
+                Sampler::Texels<N>     texels;
+                float                  weights[N];
+                for (uint32_t x = 0; x < n; ++x)
+                {
+                    // orthonormal frame around the normal
+                    float nx, ny, nz;
+                    Sampler::cube_direction(face, (x + 0.5f) / n, (y + 0.5f) / n, nx, ny, nz);
+                    float r = 1.f / std::sqrt(nx * nx + ny * ny + nz * nz);
+                    nx *= r;
+                    ny *= r;
+                    nz *= r;
+                    float up[3] = {0.f, 0.f, 1.f};
+                    if (std::abs(nz) > 0.999f)
+                    {
+                        up[0] = 1.f;
+                        up[2] = 0.f;
+                    }
+                    float tx = up[1] * nz - up[2] * ny, ty = up[2] * nx - up[0] * nz, tz = up[0] * ny - up[1] * nx;
+                    r = 1.f / std::sqrt(tx * tx + ty * ty + tz * tz);
+                    tx *= r;
+                    ty *= r;
+                    tz *= r;
+                    float bx = ny * tz - nz * ty, by = nz * tx - nx * tz, bz = nx * ty - ny * tx;
+
+                    float sum[4] = {0.f, 0.f, 0.f, 0.f}, total_weight = 0.f;
+                    for (uint32_t s0 = 0; s0 < count; s0 += N)
+                    {
+                        for (int i = 0; i < N; ++i)
+                        {
+                            uint32_t s = std::min(s0 + i, count - 1);
+                            // Hammersley point set
+                            uint32_t bits = s;
+                            bits          = (bits << 16) | (bits >> 16);
+                            bits          = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+                            bits          = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+                            bits          = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+                            bits          = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+                            float u1 = (s + 0.5f) / count, u2 = float(bits) * 2.3283064365386963e-10f;
+
+                            // GGX half vector, reflected about the view direction (= the normal)
+                            float phi   = 2.f * pi * u2;
+                            float cos_h = count == 1 ? 1.f : std::sqrt((1.f - u1) / (1.f + (a2 - 1.f) * u1));
+                            float sin_h = std::sqrt(std::max(0.f, 1.f - cos_h * cos_h));
+                            float hx = sin_h * std::cos(phi), hy = sin_h * std::sin(phi);
+                            float h[3]  = {hx * tx + hy * bx + cos_h * nx, hx * ty + hy * by + cos_h * ny,
+                                           hx * tz + hy * bz + cos_h * nz};
+
+                            float n_dot_l = 2.f * cos_h * cos_h - 1.f;
+                            dirs.x[i]     = 2.f * cos_h * h[0] - nx;
+                            dirs.y[i]     = 2.f * cos_h * h[1] - ny;
+                            dirs.z[i]     = 2.f * cos_h * h[2] - nz;
+                            weights[i]    = s0 + i < count ? std::max(n_dot_l, 0.f) : 0.f;
+
+                            // filtered importance sampling: read the mip matching the solid angle of the sample
+                            float lod = texel_lod;
+                            if (count > 1)
+                            {
+                                float d   = cos_h * cos_h * (a2 - 1.f) + 1.f;
+                                float pdf = a2 / (pi * d * d) / 4.f; // GGX D(h) * (n.h) / (4 v.h) with n = v
+                                float sa  = 1.f / (float(count) * pdf + 1e-6f);
+                                lod       = std::max(lod, 0.5f * std::log2(sa / src_sa) + 1.f);
+                            }
+                            dirs.lod[i] = lod;
+                        }
+                        sampler.sample_cube(dirs, texels);
+                        for (int i = 0; i < N; ++i)
+                        {
+                            sum[0] += weights[i] * texels.r[i];
+                            sum[1] += weights[i] * texels.g[i];
+                            sum[2] += weights[i] * texels.b[i];
+                            sum[3] += weights[i] * texels.a[i];
+                            total_weight += weights[i];
+                        }
+                    }
+                    for (int c = 0; c < 4; ++c) row[4 * x + c] = total_weight > 0.f ? sum[c] / total_weight : 0.f;
+                }
+            },
+            options.num_threads);
+
+        if (fmt != DDSFile::BC6H_UF16)
+        {
+            for (uint32_t face = 0; face < 6; ++face)
+                store_rgba(faces.data() + 4 * size_t(face) * n * n, size_t(n) * n, fmt, out.image_data(m, face));
+            continue;
+        }
+
+        // encode rows of blocks in parallel, padding partial blocks of the small mips by replicating edge texels
+        const uint32_t blocks = (n + 3) / 4;
+        parallel_for(
+            0, size_t(6) * blocks,
+            [&](size_t row_idx)
+            {
+                const uint32_t face = uint32_t(row_idx / blocks), by = uint32_t(row_idx % blocks);
+                const float   *src  = faces.data() + 4 * size_t(face) * n * n;
+                uint8_t       *dst  = out.image_data(m, face) + 16 * size_t(by) * blocks;
+                for (uint32_t bx = 0; bx < blocks; ++bx, dst += 16)
+                {
+                    float block[64];
+                    for (uint32_t y = 0; y < 4; ++y)
+                        for (uint32_t x = 0; x < 4; ++x)
+                        {
+                            size_t sy = std::min(4 * by + y, n - 1), sx = std::min(4 * bx + x, n - 1);
+                            std::memcpy(block + 4 * (4 * y + x), src + 4 * (sy * n + sx), 4 * sizeof(float));
+                        }
+                    encode_bc6h_block(block, dst);
+                }
+            },
+            options.num_threads);
+    }
+
+    return Result{Result::Success};
+}
+
+namespace detail
+{
+
+/// Reverse the order of 16 consecutive `bits`-wide little-endian fields starting at `p`.
+inline void reverse_fields(uint8_t *p, uint32_t bits)
+{
+    uint64_t v = 0, r = 0;
+    std::memcpy(&v, p, bits * 2); // 16 fields of `bits` bits
+    const uint64_t mask = (uint64_t(1) << bits) - 1;
+    for (uint32_t i = 0; i < 16; ++i) r |= ((v >> (bits * i)) & mask) << (bits * (15 - i));
+    std::memcpy(p, &r, bits * 2);
+}
+
+/// Rotate a BC1-BC5 block by 180 degrees in place by reversing its texel indices; returns false for other formats.
+inline bool rotate_bc_block_180(DDSFile::DXGIFormat fmt, uint8_t *block)
+{
+    switch (fmt)
+    {
+    case DDSFile::BC1_Typeless:
+    case DDSFile::BC1_UNorm:
+    case DDSFile::BC1_UNorm_SRGB: reverse_fields(block + 4, 2); return true;
+    case DDSFile::BC2_Typeless:
+    case DDSFile::BC2_UNorm:
+    case DDSFile::BC2_UNorm_SRGB:
+        reverse_fields(block, 4);
+        reverse_fields(block + 12, 2);
+        return true;
+    case DDSFile::BC3_Typeless:
+    case DDSFile::BC3_UNorm:
+    case DDSFile::BC3_UNorm_SRGB:
+        reverse_fields(block + 2, 3);
+        reverse_fields(block + 12, 2);
+        return true;
+    case DDSFile::BC4_Typeless:
+    case DDSFile::BC4_UNorm:
+    case DDSFile::BC4_SNorm: reverse_fields(block + 2, 3); return true;
+    case DDSFile::BC5_Typeless:
+    case DDSFile::BC5_UNorm:
+    case DDSFile::BC5_SNorm:
+        reverse_fields(block + 2, 3);
+        reverse_fields(block + 10, 3);
+        return true;
+    default: return false;
+    }
+}
+
+} // namespace detail
+
+Result import_cube_layout(const DDSFile &src, DDSWriter &out, CubeLayout layout)
+{
+    // Position (in faces) of each cube face within the layout, and whether it is rotated by 180 degrees
+    struct Placement
+    {
+        uint32_t cols, rows;
+        uint32_t x[6], y[6];
+        bool     rotated[6];
+    };
+    static const Placement placements[] = {
+        {4, 3, {2, 0, 1, 1, 1, 3}, {1, 1, 0, 2, 1, 1}, {false, false, false, false, false, false}},
+        {3, 4, {2, 0, 1, 1, 1, 1}, {1, 1, 0, 2, 1, 3}, {false, false, false, false, false, true}},
+        {6, 1, {0, 1, 2, 3, 4, 5}, {0, 0, 0, 0, 0, 0}, {false, false, false, false, false, false}},
+        {1, 6, {0, 0, 0, 0, 0, 0}, {0, 1, 2, 3, 4, 5}, {false, false, false, false, false, false}},
+    };
+
+    if (src.is_cubemap || src.depth() > 1)
+        return Result{Result::Error, "import_cube_layout: The source must be a 2D texture."};
+
+    const uint32_t w = src.width(), h = src.height();
+    if (layout == CubeLayout::Auto)
+    {
+        if (3 * w == 4 * h)
+            layout = CubeLayout::HorizontalCross;
+        else if (4 * w == 3 * h)
+            layout = CubeLayout::VerticalCross;
+        else if (w == 6 * h)
+            layout = CubeLayout::HorizontalStrip;
+        else if (h == 6 * w)
+            layout = CubeLayout::VerticalStrip;
+        else
+            return Result{Result::Error, "import_cube_layout: Could not detect a cross or strip layout from the size " +
+                                             std::to_string(w) + "x" + std::to_string(h) + "."};
+    }
+
+    const Placement &p = placements[uint32_t(layout) - 1];
+    const uint32_t   n = w / p.cols;
+    if (n == 0 || w != n * p.cols || h != n * p.rows)
+        return Result{Result::Error, "import_cube_layout: The image size doesn't match the requested layout."};
+
+    // Copy blocks when the faces are block-aligned and rotating (if needed) is possible in the source format
+    const auto     fmt         = src.format();
+    const uint32_t bw          = src.block_width(), bh = src.block_height();
+    const bool     compressed  = DDSFile::is_compressed(fmt);
+    const size_t   block_bytes = DDSFile::surface_size(fmt, bw, bh);
+    uint8_t        probe[16]   = {};
+    const bool     rotatable   = (bw == 1 && bh == 1) || detail::rotate_bc_block_180(fmt, probe);
+    const bool     copy_blocks = block_bytes > 0 && n % bw == 0 && n % bh == 0 &&
+                             (compressed || DDSFile::bits_per_pixel(fmt) >= 8) &&
+                             (rotatable || std::none_of(p.rotated, p.rotated + 6, [](bool r) { return r; }));
+
+    // leading mips that still form the layout (with block-aligned faces when copying blocks)
+    uint32_t mips = 0;
+    while (mips < std::max(1u, src.mip_count()))
+    {
+        uint32_t fn = n >> mips;
+        auto    *img = src.get_image_data(mips, 0);
+        if (fn == 0 || !img || img->width != fn * p.cols || img->height != fn * p.rows ||
+            (copy_blocks && (fn % bw != 0 || fn % bh != 0)))
+            break;
+        ++mips;
+    }
+    if (mips == 0)
+        return Result{Result::Error, "import_cube_layout: The source has no image data. Did you call populate_image_data()?"};
+
+    auto res = out.init(copy_blocks ? fmt : DDSFile::R32G32B32A32_Float, n, n, 1, mips, 1, true);
+    if (res.type == Result::Error)
+        return res;
+
+    std::vector<float> rgba;
+    for (uint32_t m = 0; m < mips; ++m)
+    {
+        const uint32_t fn  = n >> m;
+        const auto    *img = src.get_image_data(m, 0);
+        if (copy_blocks)
+        {
+            const size_t   src_pitch  = size_t((img->width + bw - 1) / bw) * block_bytes;
+            const uint32_t face_cols  = fn / bw, face_rows = fn / bh;
+            const size_t   face_pitch = face_cols * block_bytes;
+            if (img->chars.size() < src_pitch * ((img->height + bh - 1) / bh))
+                return Result{Result::Error, "import_cube_layout: Image data is too small for its dimensions."};
+
+            for (uint32_t f = 0; f < 6; ++f)
+            {
+                uint8_t *dst = out.image_data(m, f);
+                for (uint32_t row = 0; row < face_rows; ++row)
+                {
+                    const uint8_t *s = img->bytes() + (size_t(p.y[f] * face_rows + row) * src_pitch) +
+                                       size_t(p.x[f]) * face_pitch;
+                    if (!p.rotated[f])
+                    {
+                        std::memcpy(dst + row * face_pitch, s, face_pitch);
+                        continue;
+                    }
+                    // 180 degrees: reverse the order of rows and of blocks within a row, and rotate each block
+                    uint8_t *d = dst + (face_rows - 1 - row) * face_pitch;
+                    for (uint32_t col = 0; col < face_cols; ++col)
+                    {
+                        uint8_t *block = d + (face_cols - 1 - col) * block_bytes;
+                        std::memcpy(block, s + col * block_bytes, block_bytes);
+                        if (compressed)
+                            detail::rotate_bc_block_180(fmt, block);
+                    }
+                }
+            }
+            continue;
+        }
+
+        rgba.resize(4 * size_t(img->width) * img->height);
+        res = src.decode(rgba.data(), m, 0);
+        if (res.type == Result::Error)
+            return res;
+        for (uint32_t f = 0; f < 6; ++f)
+        {
+            float *dst = reinterpret_cast<float *>(out.image_data(m, f));
+            for (uint32_t y = 0; y < fn; ++y)
+                for (uint32_t x = 0; x < fn; ++x)
+                {
+                    uint32_t sx = p.x[f] * fn + (p.rotated[f] ? fn - 1 - x : x);
+                    uint32_t sy = p.y[f] * fn + (p.rotated[f] ? fn - 1 - y : y);
+                    std::memcpy(dst + 4 * (size_t(y) * fn + x), rgba.data() + 4 * (size_t(sy) * img->width + sx),
+                                4 * sizeof(float));
+                }
+        }
+    }
+
+    return Result{Result::Success};
+}
+
+namespace detail
+{
+
+/// Gather the 4x4 block at block coordinates (bx, by) of a row-major RGBA image, replicating the edge texels
+inline void load_block(const float *rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, float block[64])
+{
+    for (uint32_t y = 0; y < 4; ++y)
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            size_t sy = std::min(4 * by + y, height - 1), sx = std::min(4 * bx + x, width - 1);
+            std::memcpy(block + 4 * (4 * y + x), rgba + 4 * (sy * width + sx), 4 * sizeof(float));
+        }
+}
+
+} // namespace detail
+
+DDSFile::DXGIFormat select_bc_format(const float *rgba, uint32_t width, uint32_t height,
+                                     const BCSelectOptions &options, BCAnalysis *analysis)
+{
+    BCAnalysis result;
+    if (!rgba || width == 0 || height == 0)
+    {
+        if (analysis)
+            *analysis = result;
+        return DDSFile::Format_Unknown;
+    }
+
+    // properties of the whole image, with a tolerance of half an 8-bit step
+    const float tol = 0.5f / 255.f;
+    for (size_t i = 0, n = size_t(width) * height; i < n; ++i)
+    {
+        const float *p = rgba + 4 * i;
+        result.opaque &= p[3] >= 1.f - tol;
+        result.binary_alpha &= p[3] <= tol || p[3] >= 1.f - tol;
+        result.grayscale &= std::abs(p[0] - p[1]) <= tol && std::abs(p[0] - p[2]) <= tol;
+        result.two_channel &= std::abs(p[2]) <= tol;
+        result.is_signed |= p[0] < -tol || p[1] < -tol;
+    }
+
+    // Candidates in order of preference within each size class, and the channels their error is measured on
+    const bool                srgb       = options.srgb;
+    const DDSFile::DXGIFormat formats[5] = {result.is_signed ? DDSFile::BC4_SNorm : DDSFile::BC4_UNorm,
+                                            srgb ? DDSFile::BC1_UNorm_SRGB : DDSFile::BC1_UNorm,
+                                            result.is_signed ? DDSFile::BC5_SNorm : DDSFile::BC5_UNorm,
+                                            srgb ? DDSFile::BC3_UNorm_SRGB : DDSFile::BC3_UNorm,
+                                            srgb ? DDSFile::BC7_UNorm_SRGB : DDSFile::BC7_UNorm};
+
+    const uint32_t channels[5]  = {1, 4, 2, 4, 4};
+    const bool     candidate[5] = {result.grayscale && result.opaque && !srgb, result.opaque || result.binary_alpha,
+                                   result.two_channel && result.opaque && !srgb, true, options.allow_bc7};
+
+    // An evenly spread sample of the blocks, jittered within each stride so that it doesn't align with the columns
+    const uint32_t bw         = (width + 3) / 4, bh = (height + 3) / 4;
+    const size_t   num_blocks = size_t(bw) * bh;
+    const size_t   sampled    = size_t(std::ceil(double(num_blocks) * options.sample_fraction));
+    const size_t   count      = std::min(num_blocks, std::max<size_t>(256, sampled));
+    auto sample_block = [&](size_t k)
+    {
+        const size_t   begin = k * num_blocks / count, end = (k + 1) * num_blocks / count;
+        const uint32_t hash  = uint32_t(k) * 2654435761u;
+        return begin + (hash >> 8) % (end - begin);
+    };
+
+    // trial-encode chunks of the sampled blocks in parallel, then sum up the squared errors (against the source clamped
+    // to the range of the SNorm formats if there are negative values, so that clamping in the others counts as error)
+    const float lowest = result.is_signed ? -1.f : 0.f;
+    const size_t                       chunk_size = 64;
+    const size_t                       num_chunks = (count + chunk_size - 1) / chunk_size;
+    std::vector<std::array<double, 5>> chunk_error(num_chunks);
+    parallel_for(
+        0, num_chunks,
+        [&](size_t chunk)
+        {
+            auto &error = chunk_error[chunk];
+            error.fill(0.0);
+            for (size_t k = chunk * chunk_size; k < std::min(count, (chunk + 1) * chunk_size); ++k)
+            {
+                const size_t b = sample_block(k);
+                float        block[64], decoded[64];
+                uint8_t      encoded[16];
+                detail::load_block(rgba, width, height, uint32_t(b % bw), uint32_t(b / bw), block);
+                for (uint32_t f = 0; f < 5; ++f)
+                {
+                    if (!candidate[f])
+                        continue;
+                    encode_bc_block(formats[f], block, encoded);
+                    detail::decode_bc_block_rgba(formats[f], encoded, decoded);
+                    for (uint32_t i = 0; i < 16; ++i)
+                        for (uint32_t c = 0; c < channels[f]; ++c)
+                        {
+                            // the color of fully transparent texels doesn't matter
+                            if (c < 3 && block[4 * i + 3] <= 0.f)
+                                continue;
+                            float d = decoded[4 * i + c] - std::min(std::max(block[4 * i + c], lowest), 1.f);
+                            error[f] += double(d) * d;
+                        }
+                }
+            }
+        },
+        options.num_threads);
+
+    for (uint32_t f = 0; f < 5; ++f)
+    {
+        if (!candidate[f])
+            continue;
+        double total = 0.0;
+        for (const auto &error : chunk_error) total += error[f];
+        result.rmse[f] = float(std::sqrt(total / (double(count) * 16 * channels[f])));
+    }
+    result.sampled_blocks = uint32_t(count);
+
+    // the best candidate that meets the target among the 4 bpp formats, then the 8 bpp formats; else the best 8 bpp one
+    auto best_of = [&](uint32_t first, uint32_t last, bool meet_target)
+    {
+        int best = -1;
+        for (uint32_t f = first; f < last; ++f)
+            if (candidate[f] && (!meet_target || result.rmse[f] <= options.max_rmse) &&
+                (best < 0 || result.rmse[f] < result.rmse[best]))
+                best = int(f);
+        return best;
+    };
+    int best = best_of(0, 2, true);
+    if (best < 0)
+        best = best_of(2, 5, true);
+    if (best < 0)
+        best = best_of(2, 5, false);
+    result.format = formats[best];
+
+    if (analysis)
+        *analysis = result;
+    return result.format;
+}
+
+bool encode_bc_image(const float *rgba, uint32_t width, uint32_t height, DDSFile::DXGIFormat format, uint8_t *dst,
+                     uint32_t num_threads)
+{
+    float   probe[64] = {};
+    uint8_t block[16];
+    if (!encode_bc_block(format, probe, block))
+        return false;
+
+    const size_t   block_bytes = DDSFile::surface_size(format, 4, 4);
+    const uint32_t bw          = (width + 3) / 4, bh = (height + 3) / 4;
+    parallel_for(
+        0, bh,
+        [&](size_t by)
+        {
+            uint8_t *row = dst + by * bw * block_bytes;
+            for (uint32_t bx = 0; bx < bw; ++bx)
+            {
+                float texels[64];
+                detail::load_block(rgba, width, height, bx, uint32_t(by), texels);
+                encode_bc_block(format, texels, row + bx * block_bytes);
+            }
+        },
+        num_threads);
+    return true;
+}
+
+Result compress_bc(const DDSFile &src, DDSWriter &out, const BCSelectOptions &options, BCAnalysis *analysis)
+{
+    const uint32_t w    = src.width(), h = std::max(1u, src.height()), d = std::max(1u, src.depth());
+    const uint32_t mips = std::max(1u, src.mip_count()), slices = std::max(1u, src.array_size());
+    if (!src.get_image_data(0, 0))
+        return Result{Result::Error, "compress_bc: Source has no image data. Did you call populate_image_data()?"};
+
+    // the base mips of all slices, stacked vertically
+    const size_t       slice_texels = size_t(w) * h * d;
+    std::vector<float> base(4 * slice_texels * slices);
+    for (uint32_t a = 0; a < slices; ++a)
+    {
+        auto res = src.decode(base.data() + 4 * slice_texels * a, 0, a);
+        if (res.type == Result::Error)
+            return res;
+    }
+
+    BCSelectOptions select = options;
+    select.srgb |= src.is_sRGB();
+    const auto fmt = select_bc_format(base.data(), w, uint32_t(size_t(h) * d * slices), select, analysis);
+
+    auto res = out.init(fmt, w, h, d, mips, src.is_cubemap ? slices / 6 : slices, src.is_cubemap);
+    if (res.type == Result::Error)
+        return res;
+
+    std::vector<float> rgba;
+    for (uint32_t m = 0; m < mips; ++m)
+        for (uint32_t a = 0; a < slices; ++a)
+        {
+            const auto *img = src.get_image_data(m, a);
+            if (!img)
+                return Result{Result::Error, "compress_bc: Missing subresource in the source."};
+
+            const size_t texels = size_t(img->width) * img->height;
+            const float *pixels = base.data() + 4 * slice_texels * a;
+            if (m > 0)
+            {
+                rgba.resize(4 * texels * img->depth);
+                res = src.decode(rgba.data(), m, a);
+                if (res.type == Result::Error)
+                    return res;
+                pixels = rgba.data();
+            }
+
+            const size_t slice_bytes = DDSFile::surface_size(fmt, img->width, img->height);
+            for (uint32_t z = 0; z < img->depth; ++z)
+                encode_bc_image(pixels + 4 * texels * z, img->width, img->height, fmt,
+                                out.image_data(m, a) + slice_bytes * z, options.num_threads);
+        }
+
+    return Result{Result::Success};
+}
+
+namespace detail
+{
+
+/// Half-width of the nonzero part of a filter, in texels
+inline float resample_support(ResampleFilter filter)
+{
+    switch (filter)
+    {
+    case ResampleFilter::Box: return 0.5f;
+    case ResampleFilter::Mitchell: return 2.f;
+    default: return 3.f;
+    }
+}
+
+inline float resample_kernel(ResampleFilter filter, float x)
+{
+    // half-open, so that a center halfway between two texels picks exactly one of them
+    if (filter == ResampleFilter::Box)
+        return -0.5f <= x && x < 0.5f ? 1.f : 0.f;
+    x = std::abs(x);
+    switch (filter)
+    {
+    case ResampleFilter::Mitchell:
+    {
+        constexpr float B = 1.f / 3.f, C = 1.f / 3.f;
+        if (x < 1.f)
+            return ((12.f - 9.f * B - 6.f * C) * x * x * x + (-18.f + 12.f * B + 6.f * C) * x * x + (6.f - 2.f * B)) /
+                   6.f;
+        if (x < 2.f)
+            return ((-B - 6.f * C) * x * x * x + (6.f * B + 30.f * C) * x * x + (-12.f * B - 48.f * C) * x +
+                    (8.f * B + 24.f * C)) /
+                   6.f;
+        return 0.f;
+    }
+    default:
+    {
+        constexpr float pi = 3.14159265358979f;
+        if (x < 1e-6f)
+            return 1.f;
+        return x < 3.f ? 3.f * std::sin(pi * x) * std::sin(pi * x / 3.f) / (pi * pi * x * x) : 0.f;
+    }
+    }
+}
+
+/// srgb_to_linear() at 4097 evenly spaced values in [0,1]; interpolated linearly, the table is within 3e-8 of it
+inline const float *srgb_to_linear_table()
+{
+    static const std::vector<float> table = []
+    {
+        std::vector<float> t(4097);
+        for (size_t i = 0; i < t.size(); ++i) t[i] = srgb_to_linear(float(i) / 4096.f);
+        return t;
+    }();
+    return table.data();
+}
+
+/// srgb_to_linear() through `table` (srgb_to_linear_table()) for values in [0,1], and exactly otherwise
+inline float srgb_to_linear_lookup(float v, const float *table)
+{
+    if (!(v >= 0.f && v <= 1.f))
+        return srgb_to_linear(v);
+    const float    x = v * 4096.f;
+    const uint32_t j = std::min(uint32_t(x), 4095u);
+    return table[j] + (x - float(j)) * (table[j + 1] - table[j]);
+}
+
+/// The filter taps along one axis: output texel i reads source texel index[i * taps + t] with weight[i * taps + t]
+struct ResampleAxis
+{
+    uint32_t              taps = 0; ///< Taps per output texel; the unused ones have zero weight
+    std::vector<uint32_t> index;
+    std::vector<float>    weight;
+};
+
+inline ResampleAxis resample_axis(uint32_t src, uint32_t dst, ResampleFilter filter, AddressMode address)
+{
+    const float  scale  = std::max(1.f, float(src) / float(dst)); // widen the filter when shrinking
+    const float  radius = resample_support(filter) * scale;
+    ResampleAxis axis;
+    axis.taps = 2 * uint32_t(std::ceil(radius)) + 1;
+    axis.index.resize(size_t(dst) * axis.taps);
+    axis.weight.resize(size_t(dst) * axis.taps);
+    for (uint32_t i = 0; i < dst; ++i)
+    {
+        // the center of output texel i, in source texel coordinates
+        const float center = (float(i) + 0.5f) * float(src) / float(dst) - 0.5f;
+        const int   first  = int(std::ceil(center - radius));
+        uint32_t   *index  = axis.index.data() + size_t(i) * axis.taps;
+        float      *weight = axis.weight.data() + size_t(i) * axis.taps;
+        float       total  = 0.f;
+        for (uint32_t t = 0; t < axis.taps; ++t)
+        {
+            weight[t] = resample_kernel(filter, (float(first + int(t)) - center) / scale);
+            index[t]  = uint32_t(Sampler::address(first + int(t), int(src), address));
+            total += weight[t];
+        }
+        if (total > 0.f)
+            for (uint32_t t = 0; t < axis.taps; ++t) weight[t] /= total;
+        else // no tap under the kernel (rounding): take the nearest texel
+        {
+            const int nearest = int(std::floor(center + 0.5f)) - first;
+            for (uint32_t t = 0; t < axis.taps; ++t) weight[t] = int(t) == nearest ? 1.f : 0.f;
+        }
+    }
+    return axis;
+}
+
+} // namespace detail
+
+bool resample_rgba(const float *src, uint32_t src_width, uint32_t src_height, float *dst, uint32_t dst_width,
+                   uint32_t dst_height, const ResampleOptions &options)
+{
+    if (!src_width || !src_height || !dst_width || !dst_height)
+        return false;
+
+    const auto horizontal = detail::resample_axis(src_width, dst_width, options.filter, options.address[0]);
+    const auto vertical   = detail::resample_axis(src_height, dst_height, options.filter, options.address[1]);
+
+    // filter the rows into `rows` (src_height rows of dst_width texels), and then the columns of that into dst
+    constexpr uint32_t band       = 16;
+    const size_t       row_floats = 4 * size_t(dst_width);
+    std::vector<float> rows(row_floats * src_height);
+    parallel_for(
+        0, (src_height + band - 1) / band,
+        [&](size_t b)
+        {
+            std::vector<float> linear(options.srgb ? 4 * size_t(src_width) : 0);
+            const float       *table = options.srgb ? detail::srgb_to_linear_table() : nullptr;
+            for (uint32_t y = uint32_t(b) * band; y < std::min(src_height, uint32_t(b + 1) * band); ++y)
+            {
+                const float *in = src + 4 * size_t(src_width) * y;
+                if (options.srgb)
+                {
+                    for (size_t i = 0; i < linear.size(); ++i)
+                        linear[i] = (i & 3) == 3 ? in[i] : detail::srgb_to_linear_lookup(in[i], table);
+                    in = linear.data();
+                }
+                float *out = rows.data() + row_floats * y;
+                for (uint32_t x = 0; x < dst_width; ++x)
+                {
+                    const uint32_t *index  = horizontal.index.data() + size_t(x) * horizontal.taps;
+                    const float    *weight = horizontal.weight.data() + size_t(x) * horizontal.taps;
+                    float           acc[4] = {0.f, 0.f, 0.f, 0.f};
+                    for (uint32_t t = 0; t < horizontal.taps; ++t)
+                    {
+                        const float *texel = in + 4 * size_t(index[t]);
+                        for (int c = 0; c < 4; ++c) acc[c] += weight[t] * texel[c];
+                    }
+                    for (int c = 0; c < 4; ++c) out[4 * x + c] = acc[c];
+                }
+            }
+        },
+        options.num_threads);
+
+    // The columns are processed in blocks, so the output being accumulated stays in the L1 cache across the taps
+    constexpr size_t block = 1024;
+    parallel_for(
+        0, (dst_height + band - 1) / band,
+        [&](size_t b)
+        {
+            for (uint32_t y = uint32_t(b) * band; y < std::min(dst_height, uint32_t(b + 1) * band); ++y)
+            {
+                const uint32_t *index  = vertical.index.data() + size_t(y) * vertical.taps;
+                const float    *weight = vertical.weight.data() + size_t(y) * vertical.taps;
+                float          *out    = dst + row_floats * y;
+                for (size_t begin = 0; begin < row_floats; begin += block)
+                {
+                    const size_t end = std::min(row_floats, begin + block);
+                    std::fill(out + begin, out + end, 0.f);
+                    for (uint32_t t = 0; t < vertical.taps; ++t)
+                    {
+                        if (weight[t] == 0.f)
+                            continue;
+                        const float *in = rows.data() + row_floats * index[t];
+                        for (size_t i = begin; i < end; ++i) out[i] += weight[t] * in[i];
+                    }
+                }
+                if (options.srgb)
+                    for (size_t i = 0; i < row_floats; ++i)
+                        if ((i & 3) != 3)
+                            out[i] = linear_to_srgb(out[i]);
+            }
+        },
+        options.num_threads);
+    return true;
+}
+
+} // namespace smalldds
+
+#endif // SMALLDDS_IMPLEMENTATION
@@ -0,0 +1,170 @@
+//
+// dds2header - Compile a DDS file into a C++ header for embedding with smalldds.
+//
+// Copyright (c) 2025 Wojciech Jarosz. Distributed under the
+// Apache 2.0 License (https://opensource.org/license/apache-2-0)
+//
+// Build:
+//     c++ -std=c++17 -O2 -I.. dds2header.cpp -o dds2header
+//
+// Usage:
+//     dds2header input.dds output.h [--name identifier] [--namespace ns]
+//
+// The generated header defines `constexpr smalldds::EmbeddedDDS <identifier>`, with the file contents, the parsed
+// header and the subresource table, all computed here by DDSFile::load() and populate_image_data(). The table is
+// checked against the file contents at compile time. At runtime,
+//
+//     smalldds::DDSFile dds;
+//     dds.load(ns::identifier);
+//
+// gives a DDSFile view of the embedded data without parsing or allocating.
+//
+
+#define SMALLDDS_IMPLEMENTATION
+#include "../smalldds.h"
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace smalldds;
+
+namespace
+{
+
+/// Turn a file name into a valid C++ identifier
+std::string identifier_from_path(const std::string &path)
+{
+    auto        slash = path.find_last_of("/\\");
+    std::string name  = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    name              = name.substr(0, name.find('.'));
+    for (auto &c : name)
+        if (!std::isalnum(uint8_t(c)))
+            c = '_';
+    if (name.empty() || std::isdigit(uint8_t(name[0])))
+        name = "dds_" + name;
+    return name;
+}
+
+std::string u32_list(const uint32_t *values, size_t count)
+{
+    std::ostringstream out;
+    out << "{";
+    for (size_t i = 0; i < count; ++i) out << (i ? ", " : "") << values[i] << "u";
+    out << "}";
+    return out.str();
+}
+
+std::string header_initializer(const DDSFile::Header &h)
+{
+    const auto        &pf = h.pixel_format;
+    std::ostringstream out;
+    out << "{" << h.size << "u, " << h.flags << "u, " << h.height << "u, " << h.width << "u, " << h.pitch_or_linear_size
+        << "u, " << h.depth << "u, " << h.mipmap_count << "u, " << u32_list(h.reserved1, 11) << ",\n"
+        << "     {" << pf.size << "u, " << pf.flags << "u, " << pf.fourCC << "u, " << pf.bit_count << "u, "
+        << u32_list(pf.masks, 4) << "},\n"
+        << "     " << h.caps1 << "u, " << h.caps2 << "u, " << h.caps3 << "u, " << h.caps4 << "u, " << h.reserved2
+        << "u}";
+    return out.str();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::string input, output, name, ns;
+    bool        usage_error = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--name" && i + 1 < argc)
+            name = argv[++i];
+        else if (arg == "--namespace" && i + 1 < argc)
+            ns = argv[++i];
+        else if (input.empty())
+            input = arg;
+        else if (output.empty())
+            output = arg;
+        else
+            usage_error = true;
+    }
+    if (usage_error || input.empty() || output.empty())
+    {
+        std::fprintf(stderr, "Usage: %s input.dds output.h [--name identifier] [--namespace ns]\n", argv[0]);
+        return 1;
+    }
+    if (name.empty())
+        name = identifier_from_path(input);
+
+    DDSFile dds;
+    auto    res = dds.load(input.c_str());
+    if (res.type != Result::Error)
+        res = dds.populate_image_data();
+    if (!res.message.empty())
+        std::fprintf(stderr, "%s\n", res.message.c_str());
+    if (res.type == Result::Error)
+        return 1;
+
+    std::ofstream out(output);
+    if (!out)
+    {
+        std::fprintf(stderr, "Cannot write %s\n", output.c_str());
+        return 1;
+    }
+
+    out << "// Generated by dds2header from " << input << ". Do not edit.\n"
+        << "// " << format_name(dds.format()) << ", " << dds.width() << "x" << dds.height() << "x" << dds.depth()
+        << ", " << dds.mip_count() << " mips, " << dds.array_size() << " slices\n\n"
+        << "#pragma once\n\n#include \"smalldds.h\"\n\n";
+    if (!ns.empty())
+        out << "namespace " << ns << "\n{\n\n";
+
+    // A char array (rather than a string literal) has no length limits on any compiler
+    out << "inline constexpr char " << name << "_data[] = {";
+    char buf[16];
+    for (size_t i = 0; i < dds.dds.size(); ++i)
+    {
+        std::snprintf(buf, sizeof(buf), "'\\x%02X',", dds.dds[i]);
+        out << (i % 16 ? "" : "\n    ") << buf;
+    }
+    out << "\n};\n\n";
+
+    const auto *base = reinterpret_cast<const char *>(dds.dds.data());
+    out << "inline constexpr smalldds::DDSFile::ImageData " << name << "_images[] = {\n";
+    for (const auto &img : dds.image_data)
+        out << "    {" << img.width << "u, " << img.height << "u, " << img.depth << "u, std::string_view{" << name
+            << "_data, sizeof(" << name << "_data)}.substr(" << (img.chars.data() - base) << ", " << img.chars.size()
+            << ")},\n";
+    out << "};\n\n";
+
+    out << "inline constexpr smalldds::EmbeddedDDS " << name << " = {\n"
+        << "    std::string_view{" << name << "_data, sizeof(" << name << "_data)},\n"
+        << "    " << header_initializer(dds.header) << ",\n"
+        << "    " << (dds.has_DXT10_header ? "true" : "false") << ",\n"
+        << "    {smalldds::DDSFile::DXGIFormat(" << uint32_t(dds.header_DXT10.format)
+        << "u), smalldds::DDSFile::TextureDimension(" << uint32_t(dds.header_DXT10.resource_dimension) << "u), "
+        << dds.header_DXT10.misc_flag << "u, " << dds.header_DXT10.array_size << "u, " << dds.header_DXT10.misc_flag2
+        << "u},\n"
+        << "    " << (dds.is_cubemap ? "true" : "false") << ",\n"
+        << "    smalldds::DDSFile::Compression(" << uint32_t(dds.compression) << "u),\n"
+        << "    " << dds.bpp << ",\n"
+        << "    " << dds.num_channels << ",\n"
+        << "    " << dds.alpha_mode << "u,\n"
+        << "    smalldds::DDSFile::ColorTransform(" << uint32_t(dds.color_transform) << "u),\n"
+        << "    " << (dds.bitmasked ? "true" : "false") << ",\n"
+        << "    " << (dds.bitmask_has_alpha ? "true" : "false") << ",\n"
+        << "    " << (dds.bitmask_has_rgb ? "true" : "false") << ",\n"
+        << "    " << (dds.bitmask_was_bump_du_dv ? "true" : "false") << ",\n"
+        << "    " << u32_list(dds.bit_counts, 4) << ",\n"
+        << "    " << u32_list(dds.right_shifts, 4) << ",\n"
+        << "    " << name << "_images,\n"
+        << "    " << dds.image_data.size() << "u,\n"
+        << "};\n\n"
+        << "static_assert(" << name << ".validate(), \"Embedded DDS layout does not match its data\");\n";
+
+    if (!ns.empty())
+        out << "\n} // namespace " << ns << "\n";
+
+    return out ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+//
+// ddsconvert - Batch-convert DDS files with smalldds' multi-stage conversion pipeline.
+//
+// Copyright (c) 2025 Wojciech Jarosz. Distributed under the
+// Apache 2.0 License (https://opensource.org/license/apache-2-0)
+//
+// Build:
+//     c++ -std=c++17 -O2 -I.. ddsconvert.cpp -o ddsconvert -lpthread
+//
+// Usage:
+//     ddsconvert [options] input.dds... --out directory
+//     ddsconvert [options] --jobs list.txt
+//
+// Options:
+//     --format name         Output format, e.g. BC7_UNorm or R8G8B8A8_UNorm_SRGB (default: that of the source)
+//     --auto-bc [rmse]      Pick a block-compressed format per texture, within an RMS error (default 0.02)
+//     --resize wxh          Resample textures to w x h; w x 0 or 0 x h keep the aspect ratio
+//     --filter name         Filter for --resize: box, mitchell (default) or lanczos
+//     --max-size n          Halve textures until they fit in n x n
+//     --mips                Generate a full chain of mips
+//     --normal-map [xy]     With --mips, renormalize the normals in r, g, b; xy first rebuilds b from r and g
+//     --toksvig             With --normal-map, widen the roughness in alpha by the spread of the normals of each mip
+//     --alpha-coverage t    With --mips, keep the fraction of texels with alpha >= t the same in every mip
+//     --swizzle xyzw        Output channels from r, g, b, a, 0 and 1, e.g. rrr1
+//     --metadata            Append hashes and statistics of the output and the options to each file
+//     --threads r,d,t,e,w   Threads of the read, decode, transform, encode and write stages (0: all cores)
+//     --queue n             Textures that may wait between two stages (default 4)
+//     --cache directory     Take the outputs of unchanged inputs (with the same options) from a cache, and add new ones
+//     --cache-hard-links    Hard link instead of copy files to and from the cache where they can't be reflinked; the
+//                           outputs then share their data with the cache and must not be modified in place
+//
+// Each line of a jobs list holds an input and an output path, separated by a tab. Output files in --out get the name
+// of their input file. Errors and warnings are reported per file, and the exit code is 1 if any conversion failed.
+//
+
+#define SMALLDDS_IMPLEMENTATION
+#include "../smalldds_pipeline.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+using namespace smalldds;
+
+namespace
+{
+
+bool equal_nocase(const std::string &a, const char *b)
+{
+    size_t i = 0;
+    for (; i < a.size() && b[i]; ++i)
+        if (std::tolower(uint8_t(a[i])) != std::tolower(uint8_t(b[i])))
+            return false;
+    return i == a.size() && !b[i];
+}
+
+/// Look up a DXGI format by its name, as printed by format_name()
+bool parse_format(const std::string &name, DDSFile::DXGIFormat &format)
+{
+    for (uint32_t f = 1; f <= uint32_t(DDSFile::A4B4G4R4_UNorm); ++f)
+        if (equal_nocase(name, format_name(DDSFile::DXGIFormat(f))))
+        {
+            format = DDSFile::DXGIFormat(f);
+            return true;
+        }
+    return false;
+}
+
+bool parse_swizzle(const std::string &text, uint8_t swizzle[4])
+{
+    static const char channels[] = "rgba01";
+    if (text.size() != 4)
+        return false;
+    for (int c = 0; c < 4; ++c)
+    {
+        const char *found = std::strchr(channels, std::tolower(uint8_t(text[c])));
+        if (!found || !*found)
+            return false;
+        swizzle[c] = uint8_t(found - channels);
+    }
+    return true;
+}
+
+bool parse_threads(const std::string &text, PipelineOptions &options)
+{
+    uint32_t *counts[] = {&options.read_threads, &options.decode_threads, &options.transform_threads,
+                          &options.encode_threads, &options.write_threads};
+    const char *p      = text.c_str();
+    for (int s = 0; s < 5; ++s)
+    {
+        char *end;
+        *counts[s] = uint32_t(std::strtoul(p, &end, 10));
+        if (end == p || (s < 4 ? *end != ',' : *end != '\0'))
+            return false;
+        p = end + 1;
+    }
+    return true;
+}
+
+std::string file_name(const std::string &path)
+{
+    auto slash = path.find_last_of("/\\");
+    return path.substr(slash == std::string::npos ? 0 : slash + 1);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<ConversionJob> jobs;
+    std::vector<std::string>   inputs;
+    std::string                out_dir, jobs_file;
+    ConversionSettings         settings;
+    PipelineOptions            options;
+    bool                       usage_error = false;
+
+    for (int i = 1; i < argc && !usage_error; ++i)
+    {
+        std::string arg  = argv[i];
+        bool        more = i + 1 < argc;
+        if (arg == "--format" && more)
+            usage_error = !parse_format(argv[++i], settings.format);
+        else if (arg == "--auto-bc")
+        {
+            settings.select_bc = true;
+            if (more && std::isdigit(uint8_t(argv[i + 1][0])))
+                settings.bc.max_rmse = float(std::atof(argv[++i]));
+        }
+        else if (arg == "--resize" && more)
+            usage_error = std::sscanf(argv[++i], "%ux%u", &settings.resize_width, &settings.resize_height) != 2;
+        else if (arg == "--filter" && more)
+        {
+            std::string name = argv[++i];
+            if (name == "box")
+                settings.resize_filter = ResampleFilter::Box;
+            else if (name == "mitchell")
+                settings.resize_filter = ResampleFilter::Mitchell;
+            else if (name == "lanczos")
+                settings.resize_filter = ResampleFilter::Lanczos3;
+            else
+                usage_error = true;
+        }
+        else if (arg == "--max-size" && more)
+            settings.max_size = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--mips")
+            settings.generate_mips = true;
+        else if (arg == "--normal-map")
+        {
+            settings.mips.normal_map = true;
+            if (more && std::strcmp(argv[i + 1], "xy") == 0)
+            {
+                settings.mips.reconstruct_z = true;
+                ++i;
+            }
+        }
+        else if (arg == "--toksvig")
+            settings.mips.toksvig = true;
+        else if (arg == "--alpha-coverage" && more)
+            settings.mips.alpha_cutoff = float(std::atof(argv[++i]));
+        else if (arg == "--swizzle" && more)
+            usage_error = !parse_swizzle(argv[++i], settings.swizzle);
+        else if (arg == "--metadata")
+            settings.metadata = true;
+        else if (arg == "--threads" && more)
+            usage_error = !parse_threads(argv[++i], options);
+        else if (arg == "--queue" && more)
+            options.queue_capacity = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--cache" && more)
+            options.cache_directory = argv[++i];
+        else if (arg == "--cache-hard-links")
+            options.cache_hard_links = true;
+        else if (arg == "--out" && more)
+            out_dir = argv[++i];
+        else if (arg == "--jobs" && more)
+            jobs_file = argv[++i];
+        else if (arg.size() > 1 && arg[0] == '-')
+            usage_error = true;
+        else
+            inputs.push_back(arg);
+    }
+
+    if (!jobs_file.empty())
+    {
+        std::ifstream list(jobs_file);
+        if (!list)
+        {
+            std::fprintf(stderr, "Cannot read %s\n", jobs_file.c_str());
+            return 1;
+        }
+        for (std::string line; std::getline(list, line);)
+        {
+            auto tab = line.find('\t');
+            if (tab != std::string::npos)
+                jobs.push_back({line.substr(0, tab), line.substr(tab + 1), settings});
+            else if (!line.empty())
+                std::fprintf(stderr, "Ignoring line without a tab in %s: %s\n", jobs_file.c_str(), line.c_str());
+        }
+    }
+    if (!inputs.empty() && out_dir.empty())
+        usage_error = true;
+    for (const auto &input : inputs) jobs.push_back({input, out_dir + "/" + file_name(input), settings});
+
+    if (usage_error || jobs.empty())
+    {
+        std::fprintf(stderr,
+                     "Usage: %s [options] input.dds... --out directory\n"
+                     "       %s [options] --jobs list.txt\n"
+                     "Options: --format name, --auto-bc [rmse], --resize wxh, --filter name, --max-size n, --mips,\n"
+                     "         --normal-map [xy], --toksvig, --alpha-coverage t, --swizzle xyzw, --metadata,\n"
+                     "         --threads r,d,t,e,w, --queue n, --cache directory, --cache-hard-links\n",
+                     argv[0], argv[0]);
+        return 1;
+    }
+
+    std::mutex report;
+    options.on_complete = [&](size_t job, const Result &r)
+    {
+        std::lock_guard<std::mutex> lock(report);
+        if (r.type >= Result::Warning)
+            std::fprintf(stderr, "%s: %s\n", jobs[job].input.c_str(), r.message.c_str());
+    };
+
+    ConversionPipeline pipeline(options);
+    for (const auto &job : jobs) pipeline.submit(job);
+    auto results = pipeline.finish();
+
+    size_t failed = 0;
+    for (const auto &r : results) failed += r.type == Result::Error;
+    std::printf("Converted %zu of %zu files.\n", results.size() - failed, results.size());
+    return failed ? 1 : 0;
+}